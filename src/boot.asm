@@ -9,8 +9,10 @@ bits 32  ;nasm directive - 32 bit
         global start ;to set symbols from source code as global 
         extern kmain ;kmain is the function in C file
 
-        ; Define the code segment selector for the GDT
+        ; GDT selectors (src/kernel/include/gdt.h)
         CODE_SEG equ 0x08
+        DATA_SEG equ 0x10
+        PERCPU_SEG equ 0x28
 
         ; Interrupt Service Routines (ISRs) - Assembly Stubs
         ; These push the interrupt number and call the C handler
@@ -62,15 +64,78 @@ ISR_NOERRCODE 29
 ISR_NOERRCODE 30
 ISR_NOERRCODE 31
 
+        ; Hardware IRQ stubs: IRQ 0-15 are remapped to vectors 32-47
+%macro IRQ 2
+global irq%1
+irq%1:
+    push dword 0
+    push dword %2
+    jmp isr_common_stub
+%endmacro
+
+IRQ 0, 32   ; PIT timer
+IRQ 1, 33   ; Keyboard
+IRQ 2, 34   ; Cascade (never raised)
+IRQ 3, 35   ; COM2
+IRQ 4, 36   ; COM1
+IRQ 5, 37   ; LPT2
+IRQ 6, 38   ; Floppy
+IRQ 7, 39   ; LPT1 / spurious master
+IRQ 8, 40   ; CMOS RTC
+IRQ 9, 41
+IRQ 10, 42
+IRQ 11, 43
+IRQ 12, 44  ; PS/2 mouse
+IRQ 13, 45  ; FPU
+IRQ 14, 46  ; Primary ATA
+IRQ 15, 47  ; Secondary ATA / spurious slave
+
+        ; Local APIC vectors, pushed as dwords so 255 is not sign-extended
+%macro LOCAL_VECTOR 1
+global isr%1
+isr%1:
+    push dword 0
+    push dword %1
+    jmp isr_common_stub
+%endmacro
+
+LOCAL_VECTOR 48   ; Local APIC timer
+LOCAL_VECTOR 240  ; SMP wakeup IPI
+LOCAL_VECTOR 241  ; SMP TLB shootdown IPI
+LOCAL_VECTOR 255  ; Local APIC spurious
+
 extern isr_handler ; C handler for interrupts
 
 isr_common_stub:
     ; Save registers
     pusha
-    ; Call the C handler
+    push ds
+    push es
+    push fs
+    push gs
+    ; From ring 3 the data segments are the user's: switch to the kernel's and the per-CPU gs
+    test byte [esp + 60], 3 ; cs of the interrupted frame, past the segments, pusha and the two stub words
+    jz .kernel_segments
+    mov ax, DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, PERCPU_SEG
+    mov gs, ax
+    cld
+.kernel_segments:
+    ; Call the C handler with a pointer to the saved register frame
+    push esp
     call isr_handler
+    add esp, 4
     ; Restore registers
+    pop gs
+    pop fs
+    pop es
+    pop ds
     popa
+    ; Drop the interrupt number and error code
+    add esp, 8
     ; Return from interrupt
     iret
 
@@ -79,6 +144,7 @@ isr_common_stub:
          mov esp, stack_space ;set stack pointer
          push ebx ; Push Multiboot info address
          push eax ; Push Multiboot magic number
+         xor ebp, ebp ; Terminates the frame-pointer chain for stack walks
          call kmain ;calls the main kernel function from c file
          hlt ;halts the CPU
          
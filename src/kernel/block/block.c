@@ -0,0 +1,54 @@
+#include "../include/block.h"
+#include "../include/types.h"
+#include "../include/spinlock.h"
+#include "../include/printk.h"
+
+static block_device_t *devices[BLOCK_MAX_DEVICES];
+static uint32_t num_devices;
+static spinlock_t devices_lock = SPINLOCK_INIT;
+
+int block_register(block_device_t *dev) {
+    uint32_t flags = spin_lock_irqsave(&devices_lock);
+    if (num_devices == BLOCK_MAX_DEVICES) {
+        spin_unlock_irqrestore(&devices_lock, flags);
+        printk(KERN_WARNING, "Block device table full, %s not registered", dev->name);
+        return -1;
+    }
+    dev->id = num_devices;
+    dev->next_block = 0;
+    devices[num_devices++] = dev;
+    spin_unlock_irqrestore(&devices_lock, flags);
+    printk(KERN_DEBUG, "Block device %s: %u blocks of %u bytes", dev->name, dev->blocks, BLOCK_SIZE);
+    return 0;
+}
+
+block_device_t *block_device(uint32_t index) {
+    return index < num_devices ? devices[index] : 0;
+}
+
+uint32_t block_device_count() {
+    return num_devices;
+}
+
+// Written so that block + count cannot wrap
+static int in_range(block_device_t *dev, uint32_t block, uint32_t count) {
+    return count != 0 && block < dev->blocks && count <= dev->blocks - block;
+}
+
+int block_read(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers) {
+    if (!in_range(dev, block, count)) {
+        return -1;
+    }
+    dev->stats.reads++;
+    dev->stats.blocks_read += count;
+    return dev->ops->read(dev, block, count, buffers);
+}
+
+int block_write(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers) {
+    if (!in_range(dev, block, count)) {
+        return -1;
+    }
+    dev->stats.writes++;
+    dev->stats.blocks_written += count;
+    return dev->ops->write(dev, block, count, buffers);
+}
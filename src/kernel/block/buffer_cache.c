@@ -0,0 +1,277 @@
+#include "../include/buffer_cache.h"
+#include "../include/types.h"
+#include "../include/block.h"
+#include "../include/kmalloc.h"
+#include "../include/kstring.h"
+#include "../include/spinlock.h"
+#include "../include/printk.h"
+
+typedef struct {
+    buffer_t *buffers;
+    uint8_t *data;          // One pool for all buffer data
+    uint32_t count;
+    buffer_t **hash;
+    uint32_t hash_bits;
+    buffer_t *lru_head;     // Least recently read
+    buffer_t *lru_tail;
+    uint32_t readahead;
+} bcache_t;
+
+static bcache_t cache;
+static bcache_stats_t stats;
+
+// Requests are issued with the lock held. That suits the ramdisk; a driver that waits
+// for an interrupt will need per-buffer locks instead.
+static spinlock_t bcache_lock = SPINLOCK_INIT;
+
+static inline uint32_t hash_block(block_device_t *dev, uint32_t block) {
+    return ((block ^ (dev->id << 24)) * 2654435761u) >> (32 - cache.hash_bits);
+}
+
+static buffer_t *lookup(block_device_t *dev, uint32_t block) {
+    for (buffer_t *buf = cache.hash[hash_block(dev, block)]; buf != 0; buf = buf->hash_next) {
+        if (buf->dev == dev && buf->block == block) {
+            return buf;
+        }
+    }
+    return 0;
+}
+
+static void unhash(buffer_t *buf) {
+    buffer_t **link = &cache.hash[hash_block(buf->dev, buf->block)];
+    while (*link != buf) {
+        link = &(*link)->hash_next;
+    }
+    *link = buf->hash_next;
+    buf->dev = 0;
+    buf->flags = 0;
+}
+
+static void lru_remove(buffer_t *buf) {
+    if (buf->lru_prev != 0) {
+        buf->lru_prev->lru_next = buf->lru_next;
+    } else {
+        cache.lru_head = buf->lru_next;
+    }
+    if (buf->lru_next != 0) {
+        buf->lru_next->lru_prev = buf->lru_prev;
+    } else {
+        cache.lru_tail = buf->lru_prev;
+    }
+}
+
+static void lru_append(buffer_t *buf) {
+    buf->lru_prev = cache.lru_tail;
+    buf->lru_next = 0;
+    if (cache.lru_tail != 0) {
+        cache.lru_tail->lru_next = buf;
+    } else {
+        cache.lru_head = buf;
+    }
+    cache.lru_tail = buf;
+}
+
+static int write_back(buffer_t *buf) {
+    if (block_write(buf->dev, buf->block, 1, &buf->data) != 0) {
+        return -1;
+    }
+    buf->flags &= ~BUF_DIRTY;
+    stats.writebacks++;
+    return 0;
+}
+
+// Least recently read unheld buffer, emptied, held and moved to the recent end. 0 if
+// every buffer is held or a dirty victim could not be written back.
+static buffer_t *take_victim() {
+    buffer_t *buf = cache.lru_head;
+    while (buf != 0 && buf->refs != 0) {
+        buf = buf->lru_next;
+    }
+    if (buf == 0) {
+        return 0;
+    }
+    if (buf->dev != 0) {
+        if ((buf->flags & BUF_DIRTY) && write_back(buf) != 0) {
+            return 0;
+        }
+        unhash(buf);
+        stats.evictions++;
+    }
+    buf->refs = 1;
+    lru_remove(buf);
+    lru_append(buf);
+    return buf;
+}
+
+int init_buffer_cache(uint32_t buffers, uint32_t readahead) {
+    if (buffers == 0) {
+        return -1;
+    }
+    if (readahead > BCACHE_MAX_READAHEAD) {
+        readahead = BCACHE_MAX_READAHEAD;
+    }
+    uint32_t hash_bits = 1;
+    while ((1u << hash_bits) < buffers) {
+        hash_bits++;
+    }
+    bcache_t next;
+    next.buffers = (buffer_t *)kmalloc(buffers * sizeof(buffer_t));
+    next.data = (uint8_t *)kmalloc(buffers * BLOCK_SIZE);
+    next.hash = (buffer_t **)kmalloc((1u << hash_bits) * sizeof(buffer_t *));
+    if (next.buffers == 0 || next.data == 0 || next.hash == 0) {
+        kfree(next.buffers);
+        kfree(next.data);
+        kfree(next.hash);
+        return -1;
+    }
+    next.count = buffers;
+    next.hash_bits = hash_bits;
+    next.readahead = readahead;
+    memset(next.hash, 0, (1u << hash_bits) * sizeof(buffer_t *));
+    for (uint32_t i = 0; i < buffers; i++) {
+        buffer_t *buf = &next.buffers[i];
+        memset(buf, 0, sizeof(buffer_t));
+        buf->data = next.data + i * BLOCK_SIZE;
+        buf->lru_prev = i > 0 ? &next.buffers[i - 1] : 0;
+        buf->lru_next = i + 1 < buffers ? &next.buffers[i + 1] : 0;
+    }
+    next.lru_head = &next.buffers[0];
+    next.lru_tail = &next.buffers[buffers - 1];
+
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < cache.count; i++) {
+        if (cache.buffers[i].refs != 0) {
+            spin_unlock_irqrestore(&bcache_lock, flags);
+            kfree(next.buffers);
+            kfree(next.data);
+            kfree(next.hash);
+            return -1;
+        }
+        if (cache.buffers[i].flags & BUF_DIRTY) {
+            write_back(&cache.buffers[i]);
+        }
+    }
+    bcache_t old = cache;
+    cache = next;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+
+    if (old.count != 0) {
+        kfree(old.buffers);
+        kfree(old.data);
+        kfree(old.hash);
+    }
+    printk(KERN_DEBUG, "Buffer cache: %u buffers, %u hash buckets, read-ahead %u blocks",
+           buffers, 1u << hash_bits, readahead);
+    return 0;
+}
+
+buffer_t *bread(block_device_t *dev, uint32_t block) {
+    if (block >= dev->blocks) {
+        return 0;
+    }
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    if (cache.count == 0) {
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        return 0;
+    }
+    int sequential = block == dev->next_block;
+    dev->next_block = block + 1;
+
+    buffer_t *buf = lookup(dev, block);
+    if (buf != 0) {
+        stats.hits++;
+        if (buf->flags & BUF_READAHEAD) {
+            buf->flags &= ~BUF_READAHEAD;
+            stats.readahead_hits++;
+        }
+        buf->refs++;
+        lru_remove(buf);
+        lru_append(buf);
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        return buf;
+    }
+    stats.misses++;
+
+    // The block, and for a sequential reader the uncached blocks after it, in one request
+    uint32_t window = sequential ? cache.readahead + 1 : 1;
+    buffer_t *fetched[BCACHE_MAX_READAHEAD + 1];
+    uint8_t *data[BCACHE_MAX_READAHEAD + 1];
+    uint32_t count = 0;
+    while (count < window) {
+        uint32_t next = block + count;
+        if (count > 0 && (next >= dev->blocks || lookup(dev, next) != 0)) {
+            break;
+        }
+        buffer_t *victim = take_victim();
+        if (victim == 0) {
+            break;
+        }
+        victim->dev = dev;
+        victim->block = next;
+        uint32_t bucket = hash_block(dev, next);
+        victim->hash_next = cache.hash[bucket];
+        cache.hash[bucket] = victim;
+        fetched[count] = victim;
+        data[count] = victim->data;
+        count++;
+    }
+
+    if (count == 0 || block_read(dev, block, count, data) != 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            unhash(fetched[i]);
+            fetched[i]->refs = 0;
+        }
+        spin_unlock_irqrestore(&bcache_lock, flags);
+        return 0;
+    }
+    fetched[0]->flags = BUF_VALID;
+    for (uint32_t i = 1; i < count; i++) {
+        fetched[i]->flags = BUF_VALID | BUF_READAHEAD;
+        fetched[i]->refs = 0;
+    }
+    stats.readahead += count - 1;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+    return fetched[0];
+}
+
+void bdirty(buffer_t *buf) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    buf->flags |= BUF_DIRTY;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+void brelse(buffer_t *buf) {
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    buf->refs--;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+int bcache_sync(block_device_t *dev) {
+    int status = 0;
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < cache.count; i++) {
+        buffer_t *buf = &cache.buffers[i];
+        if ((buf->flags & BUF_DIRTY) && (dev == 0 || buf->dev == dev) && write_back(buf) != 0) {
+            status = -1;
+        }
+    }
+    spin_unlock_irqrestore(&bcache_lock, flags);
+    return status;
+}
+
+void bcache_invalidate(block_device_t *dev) {
+    bcache_sync(dev);
+    uint32_t flags = spin_lock_irqsave(&bcache_lock);
+    for (uint32_t i = 0; i < cache.count; i++) {
+        buffer_t *buf = &cache.buffers[i];
+        if (buf->dev == dev && buf->refs == 0 && !(buf->flags & BUF_DIRTY)) {
+            unhash(buf);
+        }
+    }
+    dev->next_block = 0;
+    spin_unlock_irqrestore(&bcache_lock, flags);
+}
+
+bcache_stats_t bcache_stats() {
+    return stats;
+}
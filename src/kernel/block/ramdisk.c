@@ -0,0 +1,88 @@
+#include "../include/ramdisk.h"
+#include "../include/types.h"
+#include "../include/block.h"
+#include "../include/multiboot.h"
+#include "../include/elf.h"
+#include "../include/kstring.h"
+#include "../include/timer.h"
+#include "../include/printk.h"
+
+typedef struct {
+    block_device_t dev;
+    uint8_t *base;
+    uint32_t delay_us;
+} ramdisk_t;
+
+// Static, so the boot image can be registered before any allocator is up
+static ramdisk_t ramdisks[RAMDISK_MAX];
+static uint32_t num_ramdisks;
+
+static int ramdisk_read(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers) {
+    ramdisk_t *disk = (ramdisk_t *)dev->driver_data;
+    if (disk->delay_us != 0) {
+        timer_udelay(disk->delay_us);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(buffers[i], disk->base + (block + i) * BLOCK_SIZE, BLOCK_SIZE);
+    }
+    return 0;
+}
+
+static int ramdisk_write(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers) {
+    ramdisk_t *disk = (ramdisk_t *)dev->driver_data;
+    if (disk->delay_us != 0) {
+        timer_udelay(disk->delay_us);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(disk->base + (block + i) * BLOCK_SIZE, buffers[i], BLOCK_SIZE);
+    }
+    return 0;
+}
+
+static const block_ops_t ramdisk_ops = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+};
+
+block_device_t *ramdisk_create(const char *name, uint32_t base, uint32_t size) {
+    if (num_ramdisks == RAMDISK_MAX || size < BLOCK_SIZE) {
+        return 0;
+    }
+    ramdisk_t *disk = &ramdisks[num_ramdisks];
+    disk->base = (uint8_t *)base;
+    disk->delay_us = 0;
+    disk->dev.name = name;
+    disk->dev.blocks = size / BLOCK_SIZE;
+    disk->dev.ops = &ramdisk_ops;
+    disk->dev.driver_data = disk;
+    if (block_register(&disk->dev) != 0) {
+        return 0;
+    }
+    num_ramdisks++;
+    return &disk->dev;
+}
+
+void ramdisk_set_request_delay(block_device_t *dev, uint32_t microseconds) {
+    ((ramdisk_t *)dev->driver_data)->delay_us = microseconds;
+}
+
+uint32_t init_ramdisk(multiboot_info_t *mbi) {
+    if (!(mbi->flags & MULTIBOOT_FLAG_MODS)) {
+        return 0;
+    }
+    multiboot_module_t *modules = (multiboot_module_t *)mbi->mods_addr;
+    for (uint32_t m = 0; m < mbi->mods_count; m++) {
+        uint32_t size = modules[m].mod_end - modules[m].mod_start;
+        if (size >= sizeof(uint32_t) && *(const uint32_t *)modules[m].mod_start == ELF_MAGIC) {
+            continue; // Symbols, not a disk
+        }
+        block_device_t *dev = ramdisk_create("rd0", modules[m].mod_start, size);
+        if (dev == 0) {
+            printk(KERN_WARNING, "Boot module at 0x%08x is smaller than a block, no ramdisk", modules[m].mod_start);
+            return 0;
+        }
+        printk(KERN_INFO, "Ramdisk rd0: %u KB image at 0x%08x", size / 1024, modules[m].mod_start);
+        return dev->blocks;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include "apic.h"
+#include "pic.h"
+#include "cpu.h"
+#include "paging.h"
+#include "vmalloc.h"
+#include "percpu.h"
+
+#define LAPIC_DEFAULT_BASE  0xFEE00000
+#define IOAPIC_DEFAULT_BASE 0xFEC00000
+#define APIC_BASE_ENABLE    (1 << 11)
+#define LAPIC_SVR_ENABLE    0x100
+
+#define IOAPIC_REGSEL   0x00
+#define IOAPIC_WINDOW   0x10
+#define IOAPIC_VERSION  0x01
+#define IOAPIC_REDIR(n) (0x10 + 2 * (n))
+
+#define REDIR_ACTIVE_LOW (1 << 13)
+#define REDIR_LEVEL      (1 << 15)
+#define REDIR_MASKED     (1 << 16)
+
+#define ICR_DELIVERY_PENDING (1 << 12)
+
+// ACPI MADT entry types
+#define MADT_LAPIC    0
+#define MADT_IOAPIC   1
+#define MADT_OVERRIDE 2
+
+#define MADT_LAPIC_ENABLED 1
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem[6];
+    char oem_table[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+static volatile uint32_t *lapic;
+static volatile uint32_t *ioapic;
+static int active;
+
+// ISA IRQ -> IOAPIC pin and polarity/trigger flags, identity unless the MADT overrides it
+static uint8_t irq_pin[NUM_IRQS];
+static uint32_t irq_flags[NUM_IRQS];
+
+// Local APIC IDs of the usable CPUs, in MADT order
+static uint8_t cpu_apic_ids[SMP_MAX_CPUS];
+static uint32_t num_cpus;
+
+uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    return ioapic[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    ioapic[IOAPIC_WINDOW / 4] = value;
+}
+
+int apic_active() {
+    return active;
+}
+
+void apic_eoi() {
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+uint32_t lapic_id() {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t command) {
+    uint32_t flags = irq_save();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING) {
+        __asm__ __volatile__ ("pause");
+    }
+    irq_restore(flags);
+}
+
+uint32_t apic_cpu_count() {
+    return num_cpus;
+}
+
+uint32_t apic_cpu_id(uint32_t index) {
+    return cpu_apic_ids[index];
+}
+
+void ioapic_set_masked(uint8_t irq, int masked) {
+    uint32_t low = (IRQ_BASE + irq) | irq_flags[irq] | (masked ? REDIR_MASKED : 0);
+    ioapic_write(IOAPIC_REDIR(irq_pin[irq]) + 1, lapic_read(LAPIC_ID) & 0xFF000000); // Deliver to this CPU
+    ioapic_write(IOAPIC_REDIR(irq_pin[irq]), low);
+}
+
+static int acpi_checksum_ok(const uint8_t *table, uint32_t length) {
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += table[i];
+    }
+    return sum == 0;
+}
+
+// Only tables inside the identity/direct map can be read without mapping them first
+static int acpi_readable(uint32_t address, uint32_t length) {
+    return address != 0 && address + length <= paging_direct_map_end() && address + length > address;
+}
+
+static acpi_header_t *find_madt() {
+    // The RSDP sits on a 16-byte boundary in the BIOS area
+    const uint8_t *rsdp = 0;
+    for (uint32_t address = 0xE0000; address < 0x100000; address += 16) {
+        const char *p = (const char *)address;
+        if (p[0] == 'R' && p[1] == 'S' && p[2] == 'D' && p[3] == ' ' &&
+            p[4] == 'P' && p[5] == 'T' && p[6] == 'R' && p[7] == ' ' &&
+            acpi_checksum_ok((const uint8_t *)address, 20)) {
+            rsdp = (const uint8_t *)address;
+            break;
+        }
+    }
+    if (rsdp == 0) {
+        return 0;
+    }
+
+    uint32_t rsdt_address = *(const uint32_t *)(rsdp + 16);
+    if (!acpi_readable(rsdt_address, sizeof(acpi_header_t))) {
+        return 0;
+    }
+    acpi_header_t *rsdt = (acpi_header_t *)rsdt_address;
+    if (!acpi_readable(rsdt_address, rsdt->length)) {
+        return 0;
+    }
+    uint32_t *entries = (uint32_t *)(rsdt + 1);
+    uint32_t count = (rsdt->length - sizeof(acpi_header_t)) / 4;
+    for (uint32_t i = 0; i < count; i++) {
+        acpi_header_t *table = (acpi_header_t *)entries[i];
+        if (acpi_readable(entries[i], sizeof(acpi_header_t)) &&
+            table->signature[0] == 'A' && table->signature[1] == 'P' &&
+            table->signature[2] == 'I' && table->signature[3] == 'C' &&
+            acpi_readable(entries[i], table->length)) {
+            return table;
+        }
+    }
+    return 0;
+}
+
+// Read the IOAPIC address, ISA overrides (e.g. the PIT on pin 2) and the CPUs' Local
+// APIC IDs from the MADT
+static uint32_t parse_madt() {
+    uint32_t ioapic_address = IOAPIC_DEFAULT_BASE;
+    num_cpus = 0;
+    for (int i = 0; i < NUM_IRQS; i++) {
+        irq_pin[i] = i;
+        irq_flags[i] = 0;
+    }
+
+    acpi_header_t *madt = find_madt();
+    if (madt == 0) {
+        return ioapic_address;
+    }
+    uint8_t *entry = (uint8_t *)madt + sizeof(acpi_header_t) + 8; // Skip LAPIC address and flags
+    uint8_t *end = (uint8_t *)madt + madt->length;
+    int have_ioapic = 0;
+    while (entry + 2 <= end && entry[1] >= 2) {
+        if (entry[0] == MADT_LAPIC && (*(uint32_t *)(entry + 4) & MADT_LAPIC_ENABLED) &&
+            num_cpus < SMP_MAX_CPUS) {
+            cpu_apic_ids[num_cpus++] = entry[3];
+        } else if (entry[0] == MADT_IOAPIC && !have_ioapic && *(uint32_t *)(entry + 8) == 0) {
+            ioapic_address = *(uint32_t *)(entry + 4); // The IOAPIC serving GSI 0
+            have_ioapic = 1;
+        } else if (entry[0] == MADT_OVERRIDE && entry[3] < NUM_IRQS) {
+            uint8_t irq = entry[3];
+            uint32_t gsi = *(uint32_t *)(entry + 4);
+            uint16_t flags = *(uint16_t *)(entry + 8);
+            irq_pin[irq] = gsi;
+            irq_flags[irq] = ((flags & 0x3) == 0x3 ? REDIR_ACTIVE_LOW : 0) |
+                             (((flags >> 2) & 0x3) == 0x3 ? REDIR_LEVEL : 0);
+        }
+        entry += entry[1];
+    }
+    return ioapic_address;
+}
+
+int init_apic() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_APIC)) {
+        return -1;
+    }
+
+    uint64_t base_msr = rdmsr(MSR_APIC_BASE);
+    uint32_t lapic_base = (uint32_t)base_msr & 0xFFFFF000;
+    if (lapic_base == 0) {
+        lapic_base = LAPIC_DEFAULT_BASE;
+    }
+    uint32_t ioapic_base = parse_madt();
+
+    lapic = (volatile uint32_t *)ioremap(lapic_base, 4096);
+    ioapic = (volatile uint32_t *)ioremap(ioapic_base, 4096);
+    if (lapic == 0 || ioapic == 0) {
+        return -1;
+    }
+    wrmsr(MSR_APIC_BASE, base_msr | APIC_BASE_ENABLE);
+
+    uint32_t flags = irq_save();
+
+    // Mask everything at the IOAPIC, then move over the lines the PIC had enabled
+    uint32_t max_redir = (ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF;
+    for (uint32_t pin = 0; pin <= max_redir; pin++) {
+        ioapic_write(IOAPIC_REDIR(pin), REDIR_MASKED);
+    }
+    uint16_t pic_mask = pic_get_mask();
+    pic_set_mask(0xFFFF);
+    for (int irq = 0; irq < NUM_IRQS; irq++) {
+        if (irq != 2 && irq_pin[irq] <= max_redir) {
+            ioapic_set_masked(irq, (pic_mask >> irq) & 1);
+        }
+    }
+
+    // LINT0 carries the 8259 in virtual-wire mode; masking it stops PIC deliveries
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    active = 1;
+
+    irq_restore(flags);
+    return 0;
+}
+
+void init_apic_ap() {
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
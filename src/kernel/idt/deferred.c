@@ -0,0 +1,92 @@
+#include "deferred.h"
+#include "cpu.h"
+#include "sched.h"
+
+#define RING_MASK (DEFERRED_RING_SIZE - 1)
+
+// Bounded ring with a sequence number per slot. A producer claims a slot by advancing
+// head with a compare-and-swap, fills it, then publishes it by bumping its sequence,
+// so an interrupt that lands between claim and publish can still queue its own item.
+typedef struct {
+    volatile uint32_t sequence;
+    deferred_fn_t fn;
+    void *ctx;
+} deferred_slot_t;
+
+static deferred_slot_t ring[DEFERRED_RING_SIZE];
+static volatile uint32_t head; // Next slot to claim
+static volatile uint32_t tail; // Next slot to run
+static volatile int draining;
+static deferred_stats_t stats;
+
+void init_deferred_work() {
+    for (uint32_t i = 0; i < DEFERRED_RING_SIZE; i++) {
+        ring[i].sequence = i;
+    }
+    head = tail = 0;
+}
+
+int defer_work(deferred_fn_t fn, void *ctx) {
+    uint32_t position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    deferred_slot_t *slot;
+    while (1) {
+        slot = &ring[position & RING_MASK];
+        int diff = (int)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&head, &position, position + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        } else {
+            position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+    slot->fn = fn;
+    slot->ctx = ctx;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&stats.queued, 1, __ATOMIC_RELAXED);
+    uint32_t pending = position + 1 - tail;
+    if (pending > stats.max_pending) {
+        stats.max_pending = pending;
+    }
+    return 0;
+}
+
+uint32_t run_deferred_work(uint32_t budget) {
+    // A drainer switched out with draining set would make every other drain return 0
+    // until it ran again, so it keeps the CPU until it is done
+    preempt_disable();
+    if (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE)) {
+        preempt_enable();
+        return 0;
+    }
+    uint32_t done = 0;
+    while (done < budget) {
+        deferred_slot_t *slot = &ring[tail & RING_MASK];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != tail + 1) {
+            break; // Empty, or the next item is claimed but not yet published
+        }
+        deferred_fn_t fn = slot->fn;
+        void *ctx = slot->ctx;
+        __atomic_store_n(&slot->sequence, tail + DEFERRED_RING_SIZE, __ATOMIC_RELEASE);
+        tail++;
+        fn(ctx);
+        done++;
+    }
+    __atomic_fetch_add(&stats.run, done, __ATOMIC_RELAXED);
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+    preempt_enable();
+    return done;
+}
+
+int deferred_work_pending() {
+    return __atomic_load_n(&ring[tail & RING_MASK].sequence, __ATOMIC_ACQUIRE) == tail + 1;
+}
+
+deferred_stats_t deferred_work_stats() {
+    return stats;
+}
@@ -0,0 +1,61 @@
+#include "gdt.h"
+#include "types.h"
+
+// One table per CPU: the per-CPU segment and the TSS differ in their base
+static gdt_entry_t gdts[SMP_MAX_CPUS][GDT_ENTRIES];
+static gdt_ptr_t gdt_ptrs[SMP_MAX_CPUS];
+static tss_t tsses[SMP_MAX_CPUS];
+
+static void set_gdt_entry(gdt_entry_t *entry, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    entry->limit_low = limit & 0xFFFF;
+    entry->base_low = base & 0xFFFF;
+    entry->base_mid = (base >> 16) & 0xFF;
+    entry->access = access;
+    entry->granularity = ((limit >> 16) & 0x0F) | (flags & 0xF0);
+    entry->base_high = (base >> 24) & 0xFF;
+}
+
+void gdt_init_cpu(cpu_t *cpu) {
+    gdt_entry_t *gdt = gdts[cpu->id];
+    set_gdt_entry(&gdt[0], 0, 0, 0, 0);
+    set_gdt_entry(&gdt[GDT_KERNEL_CODE / 8], 0, 0xFFFFF, 0x9A, 0xC0); // Ring 0 code, flat 4GB
+    set_gdt_entry(&gdt[GDT_KERNEL_DATA / 8], 0, 0xFFFFF, 0x92, 0xC0); // Ring 0 data, flat 4GB
+    set_gdt_entry(&gdt[GDT_USER_CODE / 8], 0, 0xFFFFF, 0xFA, 0xC0);   // Ring 3 code, flat 4GB
+    set_gdt_entry(&gdt[GDT_USER_DATA / 8], 0, 0xFFFFF, 0xF2, 0xC0);   // Ring 3 data, flat 4GB
+    set_gdt_entry(&gdt[GDT_PERCPU / 8], (uint32_t)cpu, sizeof(cpu_t) - 1, 0x92, 0x40); // Byte granular
+
+    tss_t *tss = &tsses[cpu->id];
+    tss->ss0 = GDT_KERNEL_DATA;
+    tss->iomap_base = sizeof(tss_t);
+    set_gdt_entry(&gdt[GDT_TSS / 8], (uint32_t)tss, sizeof(tss_t) - 1, 0x89, 0x00); // Available 32-bit TSS
+
+    cpu->self = cpu;
+    gdt_ptrs[cpu->id].limit = sizeof(gdts[0]) - 1;
+    gdt_ptrs[cpu->id].base = (uint32_t)gdt;
+
+    // A far jump reloads cs; the data selectors take effect when loaded
+    __asm__ __volatile__ (
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"
+        "1:\n\t"
+        "mov %2, %%ax\n\t"
+        "mov %%ax, %%ds\n\t"
+        "mov %%ax, %%es\n\t"
+        "mov %%ax, %%fs\n\t"
+        "mov %%ax, %%ss\n\t"
+        "mov %3, %%ax\n\t"
+        "mov %%ax, %%gs\n\t"
+        "mov %4, %%ax\n\t"
+        "ltr %%ax"
+        : : "m" (gdt_ptrs[cpu->id]), "i" (GDT_KERNEL_CODE), "i" (GDT_KERNEL_DATA), "i" (GDT_PERCPU),
+            "i" (GDT_TSS)
+        : "eax", "memory");
+}
+
+tss_t *gdt_tss(cpu_t *cpu) {
+    return &tsses[cpu->id];
+}
+
+void gdt_set_kernel_stack(uint32_t esp0) {
+    tsses[this_cpu()->id].esp0 = esp0;
+}
@@ -1,12 +1,29 @@
 #include "idt.h"
 #include "io.h"
-#include "../main/kmain.h" // For print_string
+#include "pic.h"
+#include "apic.h"
+#include "deferred.h"
+#include "printk.h"
+#include "kstring.h"
+#include "sched.h"
+#include "smp.h"
+#include "percpu.h"
+#include "spinlock.h"
 
 #define NUM_IDT_ENTRIES 256
 
 IDTEntry idt_entries[NUM_IDT_ENTRIES];
 IDTR idt_ptr;
 
+typedef struct {
+    interrupt_handler_t handler;
+    void *ctx;
+} handler_entry_t;
+
+static handler_entry_t handlers[NUM_IDT_ENTRIES];
+static uint32_t spurious_irqs;
+static spinlock_t handlers_lock = SPINLOCK_INIT; // Also serializes IOAPIC/PIC mask updates
+
 // Function to set an IDT entry
 void set_idt_entry(uint8_t entry_num, uint32_t handler_address, uint16_t selector, uint8_t type_attr) {
     idt_entries[entry_num].offset_low = handler_address & 0xFFFF;
@@ -22,9 +39,7 @@ void init_idt() {
     idt_ptr.base = (uint32_t)&idt_entries;
 
     // Clear all IDT entries
-    for (int i = 0; i < NUM_IDT_ENTRIES; i++) {
-        set_idt_entry(i, 0, 0, 0);
-    }
+    memset(idt_entries, 0, sizeof(idt_entries));
 
     // Set up handlers for the first 32 interrupts (exceptions)
     set_idt_entry(0, (uint32_t)isr0, 0x08, 0x8E);  // Divide by Zero
@@ -51,15 +66,112 @@ void init_idt() {
     set_idt_entry(21, (uint32_t)isr21, 0x08, 0x8E); // Control Protection Exception
     // 22-31 are reserved
 
-    // Load the IDT
+    // Hardware IRQs, remapped past the exception vectors
+    void (*irq_stubs[NUM_IRQS])() = {
+        irq0, irq1, irq2, irq3, irq4, irq5, irq6, irq7,
+        irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15
+    };
+    for (int i = 0; i < NUM_IRQS; i++) {
+        set_idt_entry(IRQ_BASE + i, (uint32_t)irq_stubs[i], 0x08, 0x8E);
+    }
+    pic_remap();
+
+    // Local APIC vectors, unused until init_apic() switches over
+    set_idt_entry(APIC_TIMER_VECTOR, (uint32_t)isr48, 0x08, 0x8E);
+    set_idt_entry(APIC_SPURIOUS_VECTOR, (uint32_t)isr255, 0x08, 0x8E);
+    set_idt_entry(SMP_WAKE_VECTOR, (uint32_t)isr240, 0x08, 0x8E);
+    set_idt_entry(SMP_TLB_VECTOR, (uint32_t)isr241, 0x08, 0x8E);
+
+    idt_load();
+}
+
+// All CPUs share the one table
+void idt_load() {
     __asm__ __volatile__ ("lidt %0" : : "m" (idt_ptr));
 }
 
+void register_irq_handler(uint8_t vector, interrupt_handler_t handler, void *ctx) {
+    uint32_t flags = spin_lock_irqsave(&handlers_lock);
+    handlers[vector].ctx = ctx;
+    handlers[vector].handler = handler;
+    if (vector >= IRQ_BASE && vector < IRQ_BASE + NUM_IRQS) {
+        uint8_t irq = vector - IRQ_BASE;
+        if (apic_active()) {
+            ioapic_set_masked(irq, handler == 0);
+        } else if (handler) {
+            pic_unmask(irq);
+        } else {
+            pic_mask(irq);
+        }
+    }
+    spin_unlock_irqrestore(&handlers_lock, flags);
+}
+
+static void unhandled_exception(registers_t *regs) {
+    printk(KERN_EMERG, "EXCEPTION %u err 0x%08x eip 0x%08x", regs->int_no, regs->err_code, regs->eip);
+    log_panic();
+    while (1) {
+        __asm__ __volatile__ ("cli\nhlt");
+    }
+}
+
+// Runs after the EOI, so further interrupts (including nested drains, which return
+// at once) can be taken while the deferred work executes
+static void irq_exit() {
+    if (deferred_work_pending()) {
+        __asm__ __volatile__ ("sti" ::: "memory");
+        run_deferred_work(DEFERRED_IRQ_EXIT_BUDGET);
+        __asm__ __volatile__ ("cli" ::: "memory");
+    }
+    // The interrupted frame stays on this thread's stack until it is switched back to
+    sched_irq_exit();
+}
+
 // Generic C interrupt handler
-void isr_handler(void) {
-    print_string("Interrupt received!", 24, 61); // Print on bottom right
-    // For now, just acknowledge the interrupt if it's from the PIC
-    // Later, we'll add more sophisticated PIC handling
-    outb(0x20, 0x20); // EOI to master PIC
-    outb(0xA0, 0x20); // EOI to slave PIC
-}
\ No newline at end of file
+void isr_handler(registers_t *regs) {
+    handler_entry_t *entry = &handlers[regs->int_no & 0xFF];
+
+    if (regs->int_no < IRQ_BASE) {
+        if (!entry->handler) {
+            unhandled_exception(regs);
+        }
+        entry->handler(regs, entry->ctx);
+        return;
+    }
+
+    if (regs->int_no == APIC_SPURIOUS_VECTOR) {
+        spurious_irqs++; // Never acknowledged
+        return;
+    }
+    if (apic_active()) {
+        this_cpu()->irq_nesting++;
+        if (entry->handler) {
+            entry->handler(regs, entry->ctx);
+        }
+        apic_eoi();
+        this_cpu()->irq_nesting--;
+        irq_exit();
+        return;
+    }
+
+    uint8_t irq = regs->int_no - IRQ_BASE;
+    if (pic_is_spurious(irq)) {
+        spurious_irqs++;
+        return;
+    }
+    this_cpu()->irq_nesting++;
+    if (entry->handler) {
+        entry->handler(regs, entry->ctx);
+    }
+    pic_send_eoi(irq);
+    this_cpu()->irq_nesting--;
+    irq_exit();
+}
+
+int in_interrupt() {
+    return this_cpu()->irq_nesting != 0;
+}
+
+uint32_t irq_spurious_count() {
+    return spurious_irqs;
+}
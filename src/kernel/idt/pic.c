@@ -0,0 +1,74 @@
+#include "pic.h"
+#include "io.h"
+
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA    0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA    0xA1
+
+#define PIC_EOI      0x20
+#define PIC_READ_ISR 0x0B // OCW3: next read of the command port returns the in-service register
+
+#define ICW1_INIT    0x11 // Edge triggered, cascade, ICW4 follows
+#define ICW4_8086    0x01
+
+#define CASCADE_IRQ  2
+
+void pic_remap() {
+    outb(PIC1_COMMAND, ICW1_INIT);
+    outb(PIC2_COMMAND, ICW1_INIT);
+    outb(PIC1_DATA, IRQ_BASE);        // ICW2: master vector offset
+    outb(PIC2_DATA, IRQ_BASE + 8);    // ICW2: slave vector offset
+    outb(PIC1_DATA, 1 << CASCADE_IRQ); // ICW3: slave on IRQ 2
+    outb(PIC2_DATA, CASCADE_IRQ);     // ICW3: slave cascade identity
+    outb(PIC1_DATA, ICW4_8086);
+    outb(PIC2_DATA, ICW4_8086);
+
+    // Everything stays masked until a handler is registered
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_send_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+int pic_is_spurious(uint8_t irq) {
+    if (irq == 7) {
+        outb(PIC1_COMMAND, PIC_READ_ISR);
+        return (inb(PIC1_COMMAND) & 0x80) == 0;
+    }
+    if (irq == 15) {
+        outb(PIC2_COMMAND, PIC_READ_ISR);
+        if ((inb(PIC2_COMMAND) & 0x80) == 0) {
+            outb(PIC1_COMMAND, PIC_EOI); // The master did see a real IRQ 2
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void pic_mask(uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq % 8)));
+}
+
+void pic_unmask(uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq % 8)));
+    if (irq >= 8) {
+        pic_unmask(CASCADE_IRQ);
+    }
+}
+
+uint16_t pic_get_mask() {
+    return inb(PIC1_DATA) | (inb(PIC2_DATA) << 8);
+}
+
+void pic_set_mask(uint16_t mask) {
+    outb(PIC1_DATA, mask & 0xFF);
+    outb(PIC2_DATA, mask >> 8);
+}
@@ -0,0 +1,218 @@
+#include "timer.h"
+#include "apic.h"
+#include "pic.h"
+#include "cpu.h"
+#include "io.h"
+
+#define PIT_FREQUENCY   1193182
+#define PIT_CHANNEL0    0x40
+#define PIT_CHANNEL2    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE_PORT   0x61 // Bit 0 gates channel 2, bit 5 reads its output
+
+#define PIT_CH0_ONESHOT 0x30 // Channel 0, lobyte/hibyte, mode 0 (interrupt on terminal count)
+#define PIT_CH2_ONESHOT 0xB0 // Channel 2, lobyte/hibyte, mode 0
+
+#define CALIBRATION_US 10000
+#define APIC_DIVIDE_16 0x3
+
+static int mode;
+static uint32_t tsc_per_window;  // TSC cycles in CALIBRATION_US
+static uint32_t apic_per_window; // APIC timer ticks in CALIBRATION_US
+
+// Each client has its own one-shot deadline in TSC cycles (0 when idle); the hardware
+// is armed for the earliest one
+typedef struct {
+    interrupt_handler_t callback;
+    void *ctx;
+    uint64_t deadline;
+} timer_client_t;
+
+static timer_client_t clients[TIMER_NUM_CLIENTS];
+
+static const char *mode_names[] = { "TSC-deadline", "APIC one-shot", "PIT one-shot" };
+
+// Let PIT channel 2 count down CALIBRATION_US and measure the TSC (and APIC timer) meanwhile
+static void calibrate(int with_apic) {
+    uint16_t count = PIT_FREQUENCY / (1000000 / CALIBRATION_US);
+
+    uint8_t gate = inb(PIT_GATE_PORT) & ~0x02; // Speaker off
+    outb(PIT_GATE_PORT, gate & ~0x01);
+    outb(PIT_COMMAND, PIT_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, count >> 8);
+
+    if (with_apic) {
+        lapic_write(LAPIC_TIMER_DIVIDE, APIC_DIVIDE_16);
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    }
+    uint64_t start = rdtsc();
+    outb(PIT_GATE_PORT, gate | 0x01); // Start counting
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+    }
+    uint64_t end = rdtsc();
+    if (with_apic) {
+        apic_per_window = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+        lapic_write(LAPIC_TIMER_INITIAL, 0);
+    }
+    outb(PIT_GATE_PORT, gate);
+    tsc_per_window = (uint32_t)(end - start);
+}
+
+static void program_hardware();
+
+static void timer_interrupt(registers_t *regs, void *ctx) {
+    (void)ctx;
+    // A deadline due within a microsecond counts as reached: the hardware rounds
+    uint64_t now = rdtsc() + timer_tsc_per_us();
+    for (int i = 0; i < TIMER_NUM_CLIENTS; i++) {
+        if (clients[i].deadline != 0 && clients[i].deadline <= now) {
+            clients[i].deadline = 0;
+            if (clients[i].callback) {
+                clients[i].callback(regs, clients[i].ctx); // May re-arm itself
+            }
+        }
+    }
+    program_hardware();
+}
+
+void init_timer() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    calibrate(apic_active());
+
+    if (apic_active()) {
+        mode = (ecx & CPUID_ECX_TSC_DEADLINE) ? TIMER_TSC_DEADLINE : TIMER_APIC_ONESHOT;
+        register_irq_handler(APIC_TIMER_VECTOR, timer_interrupt, 0);
+        lapic_write(LAPIC_LVT_TIMER, APIC_TIMER_VECTOR |
+                    (mode == TIMER_TSC_DEADLINE ? LAPIC_TIMER_TSC_DEADLINE : LAPIC_TIMER_ONESHOT));
+    } else {
+        mode = TIMER_PIT_ONESHOT;
+        // Replace the BIOS's periodic 18.2Hz tick: in mode 0 the output stays low until a count is written
+        outb(PIT_COMMAND, PIT_CH0_ONESHOT);
+        register_irq_handler(IRQ_BASE + 0, timer_interrupt, 0);
+    }
+}
+
+void timer_set_client_callback(int client, interrupt_handler_t callback, void *ctx) {
+    uint32_t flags = irq_save();
+    clients[client].ctx = ctx;
+    clients[client].callback = callback;
+    irq_restore(flags);
+}
+
+void timer_set_callback(interrupt_handler_t callback, void *ctx) {
+    timer_set_client_callback(TIMER_CLIENT_DEFAULT, callback, ctx);
+}
+
+// Scale microseconds by a per-CALIBRATION_US rate, clamped to 32 bits
+static uint32_t scale(uint32_t microseconds, uint32_t per_window) {
+    uint64_t product = (uint64_t)microseconds * per_window;
+    if ((uint32_t)(product >> 32) >= CALIBRATION_US) {
+        return 0xFFFFFFFF;
+    }
+    return udiv64_32(product, CALIBRATION_US);
+}
+
+// Fire the hardware once, microseconds from now
+static void arm_hardware(uint32_t microseconds) {
+    if (microseconds == 0) {
+        microseconds = 1;
+    }
+    if (mode == TIMER_APIC_ONESHOT) {
+        uint32_t ticks = scale(microseconds, apic_per_window);
+        lapic_write(LAPIC_TIMER_INITIAL, ticks ? ticks : 1);
+    } else {
+        uint32_t count = scale(microseconds, PIT_FREQUENCY / (1000000 / CALIBRATION_US));
+        if (count > 0xFFFF) {
+            count = 0xFFFF; // The interrupt comes early and program_hardware() re-arms
+        } else if (count == 0) {
+            count = 1; // 0 would mean 65536
+        }
+        outb(PIT_COMMAND, PIT_CH0_ONESHOT);
+        outb(PIT_CHANNEL0, count & 0xFF);
+        outb(PIT_CHANNEL0, count >> 8);
+    }
+}
+
+static void cancel_hardware() {
+    if (mode == TIMER_TSC_DEADLINE) {
+        wrmsr(MSR_TSC_DEADLINE, 0);
+    } else if (mode == TIMER_APIC_ONESHOT) {
+        lapic_write(LAPIC_TIMER_INITIAL, 0);
+    } else {
+        outb(PIT_COMMAND, PIT_CH0_ONESHOT);
+    }
+}
+
+// Arm the hardware for the earliest client deadline. Called with interrupts off.
+static void program_hardware() {
+    uint64_t earliest = 0;
+    for (int i = 0; i < TIMER_NUM_CLIENTS; i++) {
+        if (clients[i].deadline != 0 && (earliest == 0 || clients[i].deadline < earliest)) {
+            earliest = clients[i].deadline;
+        }
+    }
+    if (earliest == 0) {
+        cancel_hardware();
+        return;
+    }
+    if (mode == TIMER_TSC_DEADLINE) {
+        wrmsr(MSR_TSC_DEADLINE, earliest);
+        return;
+    }
+    uint64_t now = rdtsc();
+    uint64_t remaining = earliest > now ? earliest - now : 0;
+    uint32_t tsc_per_us = timer_tsc_per_us();
+    if ((uint32_t)(remaining >> 32) >= tsc_per_us) {
+        arm_hardware(0xFFFFFFFF);
+    } else {
+        arm_hardware(udiv64_32(remaining, tsc_per_us));
+    }
+}
+
+void timer_arm_client(int client, uint32_t microseconds) {
+    uint32_t flags = irq_save();
+    if (microseconds == 0) {
+        microseconds = 1;
+    }
+    clients[client].deadline = rdtsc() + (uint64_t)microseconds * timer_tsc_per_us();
+    program_hardware();
+    irq_restore(flags);
+}
+
+void timer_cancel_client(int client) {
+    uint32_t flags = irq_save();
+    clients[client].deadline = 0;
+    program_hardware();
+    irq_restore(flags);
+}
+
+void timer_arm(uint32_t microseconds) {
+    timer_arm_client(TIMER_CLIENT_DEFAULT, microseconds);
+}
+
+void timer_cancel() {
+    timer_cancel_client(TIMER_CLIENT_DEFAULT);
+}
+
+uint32_t timer_tsc_per_us() {
+    return tsc_per_window / CALIBRATION_US;
+}
+
+void timer_udelay(uint32_t microseconds) {
+    uint64_t end = rdtsc() + (uint64_t)microseconds * timer_tsc_per_us();
+    while (rdtsc() < end) {
+        __asm__ __volatile__ ("pause");
+    }
+}
+
+int timer_mode() {
+    return mode;
+}
+
+const char *timer_mode_name() {
+    return mode_names[mode];
+}
@@ -0,0 +1,69 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "types.h"
+
+// Vectors owned by the Local APIC itself (ISA IRQs keep IRQ_BASE + irq)
+#define APIC_TIMER_VECTOR    48
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// Local APIC register offsets
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+
+// LVT bits
+#define LAPIC_LVT_MASKED       0x10000
+#define LAPIC_TIMER_ONESHOT    0x00000
+#define LAPIC_TIMER_TSC_DEADLINE 0x40000
+
+// Interrupt command register: delivery modes and level bits
+#define ICR_FIXED         0x00000
+#define ICR_INIT          0x00500
+#define ICR_STARTUP       0x00600
+#define ICR_LEVEL_ASSERT  0x04000
+#define ICR_LEVEL_TRIGGER 0x08000
+
+// Function to switch interrupt delivery from the 8259 to the Local APIC and IOAPIC.
+// Returns 0 on success, -1 if the CPU or machine has no APIC (the PIC stays in use).
+int init_apic();
+
+// Non-zero once init_apic() has taken over from the PIC
+int apic_active();
+
+// Function to enable the Local APIC of an application processor (the MMIO mapping and
+// the IOAPIC are shared, set up once by init_apic())
+void init_apic_ap();
+
+// Function to acknowledge the current interrupt (a single MMIO write)
+void apic_eoi();
+
+// Local APIC ID of the calling CPU
+uint32_t lapic_id();
+
+// Function to send an inter-processor interrupt (ICR_* command, plus the vector for
+// fixed and startup IPIs) and wait until the APIC has delivered it
+void lapic_send_ipi(uint32_t apic_id, uint32_t command);
+
+// CPUs the MADT lists as enabled (0 without a MADT), and their Local APIC IDs
+uint32_t apic_cpu_count();
+uint32_t apic_cpu_id(uint32_t index);
+
+// Local APIC register access
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+
+// Function to mask or unmask an ISA IRQ at the IOAPIC
+void ioapic_set_masked(uint8_t irq, int masked);
+
+#endif // APIC_H
@@ -0,0 +1,52 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "types.h"
+
+// Bytes per block. Every device is addressed in these units; a disk with 512-byte
+// sectors transfers two per block.
+#define BLOCK_SIZE 1024
+
+// Registered devices
+#define BLOCK_MAX_DEVICES 8
+
+typedef struct block_device block_device_t;
+
+// Driver entry points. A request covers count consecutive blocks from block, with
+// block i transferred to or from buffers[i] (a scatter list, as DMA descriptors take
+// it). Return 0, or -1 if the device failed.
+typedef struct {
+    int (*read)(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers);
+    int (*write)(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers);
+} block_ops_t;
+
+typedef struct {
+    uint32_t reads;          // Read requests passed to the driver
+    uint32_t writes;         // Write requests passed to the driver
+    uint32_t blocks_read;
+    uint32_t blocks_written;
+} block_stats_t;
+
+struct block_device {
+    const char *name;
+    uint32_t blocks;         // Capacity in BLOCK_SIZE units
+    const block_ops_t *ops;
+    void *driver_data;
+    uint32_t id;             // Index in the device table, set by block_register()
+    uint32_t next_block;     // Buffer cache: block after the last one read, for read-ahead
+    block_stats_t stats;
+};
+
+// Function to add a device to the table. Returns 0, or -1 if the table is full.
+int block_register(block_device_t *dev);
+
+// Registered devices by index, 0 past the end
+block_device_t *block_device(uint32_t index);
+uint32_t block_device_count();
+
+// Functions to pass a request to the driver after a range check, counting it. Most
+// callers go through the buffer cache (buffer_cache.h) instead.
+int block_read(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers);
+int block_write(block_device_t *dev, uint32_t block, uint32_t count, uint8_t **buffers);
+
+#endif // BLOCK_H
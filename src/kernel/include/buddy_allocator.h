@@ -0,0 +1,31 @@
+#ifndef BUDDY_ALLOCATOR_H
+#define BUDDY_ALLOCATOR_H
+
+#include "types.h"
+
+// Block orders 0 through 10: 4KB up to 4MB
+#define BUDDY_MAX_ORDER 10
+
+// Bytes of bookkeeping needed to manage num_frames frames
+uint32_t buddy_metadata_size(uint32_t num_frames);
+
+// Function to initialize the buddy allocator with empty free lists.
+// metadata must point to buddy_metadata_size(num_frames) bytes outside managed memory.
+void buddy_init(void *metadata, uint32_t num_frames);
+
+// Function to add the free frames [first_frame, end_frame) as maximal aligned blocks
+void buddy_add_range(uint32_t first_frame, uint32_t end_frame);
+
+// Function to allocate a block of 2^order frames, aligned to its size (0 on failure)
+uint32_t buddy_alloc(uint32_t order);
+
+// Function to free a block returned by buddy_alloc(order), merging it with free buddies
+void buddy_free(uint32_t addr, uint32_t order);
+
+// Number of frames currently on the free lists
+uint32_t buddy_free_count();
+
+// Smallest order whose block holds count frames
+uint32_t buddy_order_for(uint32_t count);
+
+#endif // BUDDY_ALLOCATOR_H
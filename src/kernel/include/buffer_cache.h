@@ -0,0 +1,66 @@
+#ifndef BUFFER_CACHE_H
+#define BUFFER_CACHE_H
+
+#include "types.h"
+#include "block.h"
+
+// Buffers kmain() sets up, and the blocks fetched after a sequential miss's own
+#define BCACHE_DEFAULT_BUFFERS   64
+#define BCACHE_DEFAULT_READAHEAD 7
+#define BCACHE_MAX_READAHEAD     31
+
+// buffer_t flags
+#define BUF_VALID     0x1 // data holds the block
+#define BUF_DIRTY     0x2 // data is newer than the device
+#define BUF_READAHEAD 0x4 // Fetched ahead, not asked for yet
+
+typedef struct buffer {
+    block_device_t *dev;      // 0 while the buffer holds no block
+    uint32_t block;
+    uint8_t *data;            // BLOCK_SIZE bytes
+    uint32_t flags;
+    uint32_t refs;            // bread() holders; a held buffer is never evicted
+    struct buffer *hash_next;
+    struct buffer *lru_prev;  // The list runs from least to most recently read
+    struct buffer *lru_next;
+} buffer_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;       // Buffers reused for another block
+    uint32_t readahead;       // Blocks fetched ahead of a sequential reader
+    uint32_t readahead_hits;  // ...that it then read
+    uint32_t writebacks;      // Dirty blocks written to their device
+} bcache_stats_t;
+
+// Function to set up the cache with a number of buffers, hashed on (device, block)
+// and evicted least recently used first. A miss at the block after the previous read
+// of the same device also fetches up to readahead following blocks in the same
+// request. Calling it again resizes the cache: dirty buffers are written back first.
+// Returns 0, or -1 (keeping the old cache) if memory runs out or a buffer is held.
+int init_buffer_cache(uint32_t buffers, uint32_t readahead);
+
+// Function to get a block, from the cache or else from the device. The buffer stays
+// held until brelse(). Returns 0 if the block is out of range, the device failed or
+// every buffer is held.
+buffer_t *bread(block_device_t *dev, uint32_t block);
+
+// Function to mark a held buffer's data changed. It reaches the device when the buffer
+// is evicted or synced (write-back).
+void bdirty(buffer_t *buf);
+
+// Function to give back a buffer from bread()
+void brelse(buffer_t *buf);
+
+// Function to write back the dirty buffers of a device (0: of all devices). Returns 0,
+// or -1 if a write failed; those buffers stay dirty.
+int bcache_sync(block_device_t *dev);
+
+// Function to sync a device and drop its unheld buffers, e.g. after the blocks changed
+// underneath the cache or to start a benchmark cold
+void bcache_invalidate(block_device_t *dev);
+
+bcache_stats_t bcache_stats();
+
+#endif // BUFFER_CACHE_H
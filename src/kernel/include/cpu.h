@@ -0,0 +1,106 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "types.h"
+
+// Read the time-stamp counter
+static inline uint64_t rdtsc() {
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_EDX_FPU (1 << 0)
+#define CPUID_EDX_PSE (1 << 3)
+#define CPUID_EDX_APIC (1 << 9)
+#define CPUID_EDX_SEP (1 << 11) // SYSENTER/SYSEXIT
+#define CPUID_EDX_PGE (1 << 13)
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE (1 << 25)
+#define CPUID_EDX_SSE2 (1 << 26)
+
+// CPUID leaf 1 ECX feature bits
+#define CPUID_ECX_TSC_DEADLINE (1 << 24)
+
+// Model-specific registers
+#define MSR_APIC_BASE    0x1B
+#define MSR_TSC_DEADLINE 0x6E0
+
+// CR0 bits
+#define CR0_MP (1 << 1) // wait/fwait trap on TS too
+#define CR0_EM (1 << 2) // Emulate the FPU: every x87 instruction raises #NM
+#define CR0_TS (1 << 3) // Task switched: the next FPU/SSE instruction raises #NM
+#define CR0_NE (1 << 5) // Native x87 error reporting (#MF)
+
+// CR4 bits
+#define CR4_PSE (1 << 4)
+#define CR4_PGE (1 << 7)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+// Execute CPUID for the given leaf
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ __volatile__ ("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (0));
+}
+
+// Read a model-specific register
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+// Write a model-specific register
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__ ("wrmsr" : : "c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
+
+// 64-by-32 bit division with divl, since libgcc is not linked.
+// The quotient must fit in 32 bits.
+static inline uint32_t udiv64_32(uint64_t dividend, uint32_t divisor) {
+    uint32_t quotient, remainder;
+    __asm__ ("divl %4" : "=a" (quotient), "=d" (remainder)
+             : "a" ((uint32_t)dividend), "d" ((uint32_t)(dividend >> 32)), "rm" (divisor));
+    return quotient;
+}
+
+// 64-by-32 bit division for any quotient: the high word first, then the remainder
+// with the low word, so neither divl can overflow
+static inline uint64_t udiv64(uint64_t dividend, uint32_t divisor, uint32_t *remainder) {
+    uint32_t high = (uint32_t)(dividend >> 32);
+    uint32_t quotient_low, rest;
+    __asm__ ("divl %4" : "=a" (quotient_low), "=d" (rest)
+             : "a" ((uint32_t)dividend), "d" (high % divisor), "rm" (divisor));
+    if (remainder != 0) {
+        *remainder = rest;
+    }
+    return ((uint64_t)(high / divisor) << 32) | quotient_low;
+}
+
+#ifdef KERNEL_HOST_BUILD
+// A host process cannot mask interrupts (and has none to mask)
+static inline uint32_t irq_save() {
+    return 0;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    (void)flags;
+}
+#else
+// Disable interrupts and return the previous EFLAGS
+static inline uint32_t irq_save() {
+    uint32_t flags;
+    __asm__ __volatile__ ("pushf\n\tpop %0\n\tcli" : "=r" (flags) :: "memory");
+    return flags;
+}
+
+// Re-enable interrupts if they were enabled when irq_save() was called
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        __asm__ __volatile__ ("sti" ::: "memory");
+    }
+}
+#endif
+
+#endif // CPU_H
@@ -0,0 +1,39 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include "types.h"
+
+// Slots in the deferred-work ring (a power of two)
+#define DEFERRED_RING_SIZE 64
+
+// Items run on the way out of an interrupt; the rest waits for the next exit or the idle loop
+#define DEFERRED_IRQ_EXIT_BUDGET 8
+
+typedef void (*deferred_fn_t)(void *ctx);
+
+typedef struct {
+    uint32_t queued;
+    uint32_t run;
+    uint32_t dropped;     // defer_work() calls that found the ring full
+    uint32_t max_pending;
+} deferred_stats_t;
+
+// Function to set up the ring; call before interrupts are enabled
+void init_deferred_work();
+
+// Function to queue fn(ctx) to run later with interrupts enabled. Lock-free and safe
+// from interrupt handlers. Returns 0 on success, -1 if the ring is full.
+int defer_work(deferred_fn_t fn, void *ctx);
+
+// Function to run up to budget queued items, oldest first. Returns the number run.
+// Only one caller drains at a time; a nested call returns 0. Preemption is off while
+// it runs, so keep the budget small outside interrupts.
+uint32_t run_deferred_work(uint32_t budget);
+
+// Non-zero if items are waiting
+int deferred_work_pending();
+
+// Current counters
+deferred_stats_t deferred_work_stats();
+
+#endif // DEFERRED_H
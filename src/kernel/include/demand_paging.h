@@ -0,0 +1,40 @@
+#ifndef DEMAND_PAGING_H
+#define DEMAND_PAGING_H
+
+#include "types.h"
+#include "idt.h"
+
+// Page-fault error code bits
+#define PF_PRESENT  0x01 // 0: page not present, 1: protection violation
+#define PF_WRITE    0x02 // Fault caused by a write
+#define PF_USER     0x04 // Fault raised in user mode
+#define PF_RESERVED 0x08 // Reserved bit set in a paging entry
+#define PF_FETCH    0x10 // Fault caused by an instruction fetch
+
+// Maximum number of lazy regions reserved at the same time
+#define MAX_LAZY_REGIONS 16
+
+typedef struct {
+    uint32_t read_faults;     // Not-present reads served with the shared zero page
+    uint32_t write_faults;    // Writes that received a private zeroed frame
+    uint32_t frames_allocated; // Frames handed to lazy regions so far
+    uint32_t user_faults;     // Ring 3 faults, each of which killed its thread
+} demand_paging_stats_t;
+
+// Function to set up the shared read-only zero page
+void init_demand_paging();
+
+// Function to reserve [virtual_address, virtual_address + size) without backing it.
+// Pages get a zeroed frame on their first write. Returns 0 on success, -1 on failure.
+int reserve_lazy_region(uint32_t virtual_address, uint32_t size);
+
+// Function to release a lazy region and every frame its pages received
+void release_lazy_region(uint32_t virtual_address);
+
+// Page-fault (vector 14) handler, installed by init_demand_paging
+void page_fault_handler(registers_t *regs);
+
+// Current fault and frame counters
+demand_paging_stats_t demand_paging_stats();
+
+#endif // DEMAND_PAGING_H
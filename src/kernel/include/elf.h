@@ -0,0 +1,58 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include "types.h"
+
+// The parts of the 32-bit ELF format the kernel reads: its own section headers and
+// symbol table, as passed by the boot loader or loaded as a module
+
+#define ELF_MAGIC 0x464C457F // "\x7FELF" read as a little-endian word
+
+typedef struct {
+    uint8_t  ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed)) elf32_header_t;
+
+// Section types
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;      // Load address, where the boot loader placed the section
+    uint32_t offset;    // Position in the file
+    uint32_t size;
+    uint32_t link;      // For SHT_SYMTAB: index of its string table
+    uint32_t info;
+    uint32_t addralign;
+    uint32_t entsize;
+} __attribute__((packed)) elf32_section_header_t;
+
+// Symbol types (low 4 bits of info)
+#define STT_FUNC 2
+#define ELF32_ST_TYPE(info) ((info) & 0xF)
+
+typedef struct {
+    uint32_t name;  // Offset into the linked string table
+    uint32_t value;
+    uint32_t size;
+    uint8_t  info;
+    uint8_t  other;
+    uint16_t shndx;
+} __attribute__((packed)) elf32_symbol_t;
+
+#endif // ELF_H
@@ -0,0 +1,45 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "types.h"
+
+struct thread;
+
+// FXSAVE/FXRSTOR image: x87, MMX and SSE registers plus MXCSR, 16-byte aligned
+#define FPU_STATE_SIZE 512
+
+typedef struct {
+    uint32_t traps;       // Device Not Available (#NM) exceptions taken
+    uint32_t saves;       // Thread states written back with FXSAVE
+    uint32_t restores;    // Thread states loaded with FXRSTOR
+    uint32_t kernel_uses; // kernel_fpu_begin() sections entered
+} fpu_stats_t;
+
+// Function to enable x87/SSE on the boot CPU (CR0.MP and NE set, EM clear; CR4.OSFXSR
+// and OSXMMEXCPT) and install the lazy-switch #NM handler. Needs FXSR; without it the
+// FPU stays off and kernel_fpu_begin() always fails. Call after init_idt().
+void init_fpu();
+
+// The same control register setup on an application processor
+void fpu_init_cpu();
+
+// Non-zero once init_fpu() enabled the FPU
+int fpu_enabled();
+
+// Functions to bracket kernel SIMD code (memcpy, checksums, zeroing). Between them the
+// xmm registers belong to the caller: the thread state that was loaded is saved first,
+// and preemption is off. Returns 0 when the FPU cannot be used here (it is off, or this
+// interrupted another kernel FPU section); fall back to integer code and skip the end
+// call. The section must not block or yield.
+int kernel_fpu_begin();
+void kernel_fpu_end();
+
+// Scheduler hooks. fpu_switch() sets CR0.TS unless next's state is the one loaded, so
+// its first FPU instruction traps and the handler swaps states then. fpu_release()
+// forgets an exiting thread's loaded state.
+void fpu_switch(struct thread *next);
+void fpu_release(struct thread *thread);
+
+fpu_stats_t fpu_stats();
+
+#endif // FPU_H
@@ -4,6 +4,26 @@
 #include "types.h"
 #include "multiboot.h"
 
+// The bitmap, its summary and the buddy links are placed from this physical address
+// up (or past boot modules loaded there), and must end below FRAME_METADATA_LIMIT (the
+// kernel reaches them through the identity map of the first 4MB). A host build may
+// move them.
+#ifndef FRAME_METADATA_BASE
+#define FRAME_METADATA_BASE  0x200000
+#endif
+#ifndef FRAME_METADATA_LIMIT
+#define FRAME_METADATA_LIMIT 0x400000
+#endif
+
+// Frames below this address are never handed out: frame 0 (address 0 is the failure
+// value) and the page the SMP start-up trampoline is copied to (SMP_TRAMPOLINE_BASE)
+#define FRAME_LOW_RESERVED 0x9000
+
+// Per-CPU cache of single frames: its capacity, and the frames moved to or from the
+// shared backend at once when it runs empty or full
+#define FRAME_CACHE_SIZE  64
+#define FRAME_CACHE_BATCH 32
+
 // Function to initialize the frame allocator
 void init_frame_allocator(multiboot_info_t *mbi);
 
@@ -13,4 +33,32 @@ uint32_t alloc_frame();
 // Function to free a physical frame
 void free_frame(uint32_t addr);
 
+// Function to allocate count physically contiguous frames.
+// alignment is in bytes and must be a power of two (0 or PAGE_SIZE for none).
+// Returns the physical address of the first frame, or 0 on failure.
+uint32_t alloc_frames(uint32_t count, uint32_t alignment);
+
+// Function to free count contiguous frames starting at addr
+void free_frames(uint32_t addr, uint32_t count);
+
+// Function to turn the per-CPU caches off (every allocation then takes the backend
+// lock, which benchmarks compare against) or back on. Each CPU empties its own cache
+// on its next call.
+void frame_cache_set_enabled(int enabled);
+
+// Number of frames currently free, including those in per-CPU caches
+uint32_t frame_allocator_free_count();
+
+// Number of frames tracked by the bitmap
+uint32_t frame_allocator_total_count();
+
+// Bitmap backend, built only when it is the one selected (FRAME_ALLOCATOR=bitmap).
+// These bypass the caches and the lock; use the functions above.
+#ifndef FRAME_ALLOCATOR_BUDDY
+uint32_t bitmap_alloc_frame();
+uint32_t bitmap_alloc_frames(uint32_t count, uint32_t alignment);
+void bitmap_free_frames(uint32_t addr, uint32_t count);
+uint32_t bitmap_free_count();
+#endif
+
 #endif // FRAME_ALLOCATOR_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include "types.h"
+#include "percpu.h"
+
+// Segment selectors, the same on every CPU. The kernel code and data selectors match
+// the ones the boot loader left, so nothing changes for code running before
+// init_boot_cpu(). SYSENTER/SYSEXIT derive the other three from GDT_KERNEL_CODE, so
+// the kernel and user pairs must stay in this order.
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x18 // Ring 3 selectors carry RPL 3: GDT_USER_CODE | 3
+#define GDT_USER_DATA   0x20
+#define GDT_PERCPU      0x28 // Data segment based at the CPU's cpu_t, loaded into gs
+#define GDT_TSS         0x30
+
+#define GDT_ENTRIES 7
+
+// Structure for a GDT entry
+typedef struct {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;         // Present, DPL, type
+    uint8_t granularity;    // Limit bits 16-19, 4KB granularity and 32-bit flags
+    uint8_t base_high;
+} __attribute__((packed)) gdt_entry_t;
+
+// Structure for the GDTR
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+// 32-bit task state segment. Only ss0:esp0 is used: the stack the CPU switches to when
+// an interrupt or int 0x80 arrives from ring 3. No I/O bitmap, so in/out fault there.
+typedef struct {
+    uint32_t prev_task;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+// Function to build a CPU's GDT, load it, reload every segment register (gs with the
+// per-CPU segment) and load the task register. Runs once on the CPU itself.
+void gdt_init_cpu(cpu_t *cpu);
+
+// A CPU's TSS, loaded into its task register by gdt_init_cpu()
+tss_t *gdt_tss(cpu_t *cpu);
+
+// Function to set the stack the calling CPU enters the kernel on from ring 3
+void gdt_set_kernel_stack(uint32_t esp0);
+
+#endif // GDT_H
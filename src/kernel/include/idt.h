@@ -18,9 +18,34 @@ typedef struct {
     uint32_t base;          // Base address of the IDT
 } __attribute__((packed)) IDTR;
 
+// Register frame built by isr_common_stub, lowest address first
+typedef struct {
+    uint32_t gs, fs, es, ds;                         // Interrupted segments
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax; // Pushed by pusha
+    uint32_t int_no, err_code;                       // Pushed by the ISR stub
+    uint32_t eip, cs, eflags;                        // Pushed by the CPU
+    uint32_t useresp, ss;                            // Only present when cs & 3 (from ring 3)
+} registers_t;
+
+// Interrupt handler, called with the saved register frame and the registered context
+typedef void (*interrupt_handler_t)(registers_t *regs, void *ctx);
+
 // Function to initialize the IDT
 void init_idt();
 
+// Function to load the IDT on the calling CPU (init_idt() does it for the boot CPU)
+void idt_load();
+
+// Function to install a handler for a vector. For IRQ vectors the line is unmasked
+// at the PIC (or IOAPIC once init_apic() ran); lines without a handler stay masked.
+void register_irq_handler(uint8_t vector, interrupt_handler_t handler, void *ctx);
+
+// Number of spurious interrupts (PIC IRQ 7/15 or the APIC spurious vector) dropped so far
+uint32_t irq_spurious_count();
+
+// Non-zero inside an IRQ handler, before its EOI: no thread switch may happen there
+int in_interrupt();
+
 // Function to set an IDT entry
 void set_idt_entry(uint8_t entry_num, uint32_t handler_address, uint16_t selector, uint8_t type_attr);
 
@@ -58,7 +83,31 @@ extern void isr29();
 extern void isr30();
 extern void isr31();
 
+// External assembly IRQ stubs (vectors IRQ_BASE to IRQ_BASE + 15)
+extern void irq0();
+extern void irq1();
+extern void irq2();
+extern void irq3();
+extern void irq4();
+extern void irq5();
+extern void irq6();
+extern void irq7();
+extern void irq8();
+extern void irq9();
+extern void irq10();
+extern void irq11();
+extern void irq12();
+extern void irq13();
+extern void irq14();
+extern void irq15();
+
+// External assembly stubs for Local APIC vectors
+extern void isr48();
+extern void isr240();
+extern void isr241();
+extern void isr255();
+
 // Generic C interrupt handler
-void isr_handler(void);
+void isr_handler(registers_t *regs);
 
 #endif // IDT_H
\ No newline at end of file
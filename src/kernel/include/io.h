@@ -6,8 +6,36 @@
 void outb(uint16_t port, uint8_t value);
 uint8_t inb(uint16_t port);
 
-// Serial port functions
-void serial_init();
+// Serial port (COM1) settings
+#define SERIAL_DEFAULT_BAUD   115200
+#define SERIAL_TX_BUFFER_SIZE 4096 // Power of two
+#define SERIAL_RX_BUFFER_SIZE 256  // Power of two
+
+typedef struct {
+    uint32_t tx_bytes;
+    uint32_t tx_interrupts;
+    uint32_t tx_ring_full;  // Writes that had to push bytes out by polling
+    uint32_t tx_dropped;    // Bytes written from interrupt handlers to a full ring, and lost
+    uint32_t rx_bytes;
+    uint32_t rx_overruns;
+} serial_stats_t;
+
+// Serial port functions. Output is polled until serial_enable_interrupts().
+void serial_init(uint32_t baud);
+void serial_set_baud(uint32_t baud); // Up to 115200
 void serial_write(char c);
+void serial_write_string(const char *s);
+
+// Function to switch to buffered output drained by THR-empty interrupts, and buffered input
+void serial_enable_interrupts();
+
+// Function to flush the TX ring by polling and keep writing synchronously (1), e.g. on a
+// panic with interrupts off, or to go back to buffered output (0)
+void serial_set_sync(int sync);
+
+// Function to take one received character. Returns 0 on success, -1 if none is waiting.
+int serial_read(char *c);
+
+serial_stats_t serial_stats();
 
-#endif // IO_H
\ No newline at end of file
+#endif // IO_H
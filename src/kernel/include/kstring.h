@@ -0,0 +1,53 @@
+#ifndef KSTRING_H
+#define KSTRING_H
+
+#include "types.h"
+
+// Function to pick the fastest memcpy/memset for this CPU. Until it runs (and on CPUs
+// without SSE2, or before init_fpu()) the rep movsd/stosd versions are used; kmain()
+// calls it again once the FPU is on.
+void init_string_lib();
+
+// Name of the variant in use ("rep" or "sse2")
+const char *string_lib_variant();
+
+// Memory primitives, with the usual C library semantics. The host build of the memory
+// subsystem (KERNEL_HOST_BUILD, see tools/host) takes these from the C library instead.
+#ifdef KERNEL_HOST_BUILD
+#include <string.h>
+#else
+void *memcpy(void *dest, const void *src, uint32_t n);
+void *memset(void *dest, int c, uint32_t n);
+void *memmove(void *dest, const void *src, uint32_t n);
+int memcmp(const void *a, const void *b, uint32_t n);
+#endif
+
+// Function to fill n bytes with rep stosd/stosb, whichever variant memset() uses. It
+// touches no FPU state, so it suits page-sized fills where kernel_fpu_begin() would
+// cost more than the xmm stores save.
+void *memset_rep(void *dest, int c, uint32_t n);
+
+// Function to zero n bytes with non-temporal movnti stores on CPUs with SSE2
+// (memset_rep() otherwise), so clearing memory that is not read soon does not evict
+// useful cache lines. It uses general registers only and needs no kernel_fpu_begin().
+void *memzero_nontemporal(void *dest, uint32_t n);
+
+// Function to fill count 16-bit cells (e.g. VGA text cells) with value
+void *memset16(uint16_t *dest, uint16_t value, uint32_t count);
+
+#ifndef KERNEL_HOST_BUILD
+// Function to return the length of a NUL-terminated string
+size_t strlen(const char *s);
+#endif
+
+// Function to format a signed decimal into s
+void itoa(int n, char s[]);
+
+// Function to format an unsigned decimal into s. Returns the number of digits.
+uint32_t utoa_dec(uint32_t value, char *s);
+
+// Function to format value as hex with at least min_digits digits (no 0x prefix).
+// Returns the number of digits.
+uint32_t utoa_hex(uint32_t value, char *s, int min_digits, int upper);
+
+#endif // KSTRING_H
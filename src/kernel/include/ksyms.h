@@ -0,0 +1,27 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include "types.h"
+#include "multiboot.h"
+
+// Function symbols kept, and bytes of their names
+#define KSYMS_MAX       2048
+#define KSYMS_NAME_POOL 32768
+
+// Function to copy the kernel's function symbols out of the ELF section headers the
+// boot loader passed (MULTIBOOT_FLAG_ELF), or else out of a module that is an ELF
+// file with a .symtab (QEMU's -kernel passes no symbols; add -initrd kernel.bin).
+// Call before the frame allocator can reuse that memory. Returns the number of symbols.
+uint32_t init_ksyms(multiboot_info_t *mbi);
+
+// Index of the function containing addr, or -1 if none does
+int ksym_index(uint32_t addr);
+
+// Name and start address of a symbol by index
+const char *ksym_name(int index);
+uint32_t ksym_address(int index);
+
+// Number of symbols loaded
+uint32_t ksyms_count();
+
+#endif // KSYMS_H
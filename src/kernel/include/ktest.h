@@ -0,0 +1,57 @@
+#ifndef KTEST_H
+#define KTEST_H
+
+#include "types.h"
+
+// Registered cases of each kind
+#define KTEST_MAX_CASES  64
+#define KBENCH_MAX_CASES 32
+
+// Samples kept per benchmark; iterations beyond this are capped
+#define KBENCH_MAX_ITERATIONS 1024
+
+// QEMU's isa-debug-exit device (-device isa-debug-exit,iobase=0xf4,iosize=0x04).
+// Writing v makes QEMU exit with status (v << 1) | 1.
+#define KTEST_EXIT_PORT 0xF4
+
+// A test returns 0 on success; KTEST_ASSERT() reports and returns -1 on failure
+typedef int (*ktest_fn_t)(void);
+
+// A benchmark runs one iteration of the operation being measured per call
+typedef void (*kbench_fn_t)(void *ctx);
+
+#define KTEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            ktest_fail(#cond, __FILE__, __LINE__); \
+            return -1; \
+        } \
+    } while (0)
+
+// Functions to add a case to the run list. name must be a literal (it is not copied).
+void ktest_register(const char *name, ktest_fn_t fn);
+void kbench_register(const char *name, kbench_fn_t fn, void *ctx, uint32_t iterations);
+
+// Function to record why the running test failed (used by KTEST_ASSERT)
+void ktest_fail(const char *expr, const char *file, int line);
+
+// Function to run every registered test. Writes to the log:
+//   KTEST_START
+//   KTEST PASS <name> <cycles>
+//   KTEST FAIL <name> <cycles> <file>:<line> <expression>
+//   KTEST_STOP <passed> <failed>
+// Returns the number of failed tests.
+int ktest_run_all();
+
+// Function to time every registered benchmark, one rdtsc pair per iteration with the
+// rdtsc overhead taken out, after one untimed warm-up call. Writes to the log:
+//   KBENCH_START
+//   KBENCH <name> <iterations> <min> <median> <p99>
+//   KBENCH_STOP
+void kbench_run_all();
+
+// Function to flush the log and leave QEMU with status (failures ? 3 : 1). Halts if
+// the isa-debug-exit device is not present.
+void ktest_exit(int failures);
+
+#endif // KTEST_H
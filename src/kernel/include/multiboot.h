@@ -12,7 +12,12 @@ typedef struct multiboot_info {
     uint32_t cmdline;
     uint32_t mods_count;
     uint32_t mods_addr;
-    uint32_t syms[3];
+    // ELF section header table (MULTIBOOT_FLAG_ELF): entry count, entry size, address
+    // and the index of the section name string table. The a.out variant is unused.
+    uint32_t elf_num;
+    uint32_t elf_size;
+    uint32_t elf_addr;
+    uint32_t elf_shndx;
     uint32_t mmap_length;
     uint32_t mmap_addr;
     uint32_t drives_length;
@@ -38,6 +43,14 @@ typedef struct multiboot_mmap_entry {
     uint32_t type;
 } __attribute__((packed,gcc_struct)) multiboot_mmap_entry_t;
 
+// Boot module (MULTIBOOT_FLAG_MODS), mods_count of them at mods_addr
+typedef struct multiboot_module {
+    uint32_t mod_start;
+    uint32_t mod_end;   // First byte past the module
+    uint32_t string;    // Module command line
+    uint32_t reserved;
+} __attribute__((packed,gcc_struct)) multiboot_module_t;
+
 // Multiboot flags
 #define MULTIBOOT_FLAG_MEM     0x001
 #define MULTIBOOT_FLAG_BOOTDEV 0x002
@@ -33,10 +33,63 @@ typedef struct {
     uint32_t frame : 20; // Page physical address
 } __attribute__((packed)) PAGE_TABLE_ENTRY;
 
+// Mapping flags for map_range()
+#define PAGE_PRESENT 0x001
+#define PAGE_RW      0x002
+#define PAGE_USER    0x004
+#define PAGE_PWT     0x008 // Write-through
+#define PAGE_PCD     0x010 // Cache disabled, for device memory
+#define PAGE_GLOBAL  0x100 // Kept in the TLB across CR3 reloads (needs CR4.PGE)
+
+// Physical memory is identity mapped up to here at most; higher addresses are kernel windows
+#define DIRECT_MAP_LIMIT 0xC0000000
+
 // Function to initialize paging
 void init_paging();
 
+// Function to extend the identity map over all RAM below ram_end using 4MB pages
+void init_direct_map(uint32_t ram_end);
+
+// End of the identity-mapped region; frames below it are directly addressable
+uint32_t paging_direct_map_end();
+
+// Non-zero when 4MB pages (CR4.PSE) are available
+int paging_large_pages_enabled();
+
 // Function to map a virtual address to a physical address
 void map_page(uint32_t virtual_address, uint32_t physical_address);
 
+// Batches with more invalidations than this flush the whole TLB instead of using invlpg
+#define TLB_FLUSH_THRESHOLD 32
+
+// Function to drop this CPU's TLB entries for count addresses: one invlpg each, or a
+// full flush above TLB_FLUSH_THRESHOLD (toggling CR4.PGE if global entries are among
+// them). The range functions below call it, and smp_tlb_shootdown() for the other CPUs.
+void tlb_invalidate(const uint32_t *addresses, uint32_t count, int global);
+
+// Function to map size bytes, using 4MB pages wherever both addresses are 4MB aligned
+// and a whole 4MB span remains, and 4KB pages elsewhere. Missing page tables are
+// allocated before anything changes and the TLB is flushed once at the end.
+// Returns 0 on success, -1 if a page table could not be allocated.
+int map_range(uint32_t virtual_address, uint32_t physical_address, uint32_t size, uint32_t flags);
+
+// Function to remove the mappings of size bytes, with one TLB flush for the whole range.
+// 4MB pages the range covers only in part are split first; if a page table cannot be
+// allocated for that, nothing is unmapped and -1 is returned. Returns 0 on success.
+int unmap_range(uint32_t virtual_address, uint32_t size);
+
+// Function to change the PAGE_RW/PAGE_USER/PAGE_GLOBAL flags of present mappings in a
+// range. Fails like unmap_range(), changing nothing. Returns 0 on success.
+int protect_range(uint32_t virtual_address, uint32_t size, uint32_t flags);
+
+// Function to remove the mapping of the 4KB page at virtual_address (0 or -1 as above)
+int unmap_page(uint32_t virtual_address);
+
+// Physical address mapped at virtual_address, or 0 if it is not mapped
+uint32_t get_physical_address(uint32_t virtual_address);
+
+// PAGE_PRESENT, PAGE_RW and PAGE_USER as they apply to an access at virtual_address
+// (set only if both the directory and the table entry allow it), or 0 if not mapped
+uint32_t get_page_flags(uint32_t virtual_address);
+
 #endif // PAGING_H
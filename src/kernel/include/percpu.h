@@ -0,0 +1,37 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include "types.h"
+
+#define SMP_MAX_CPUS 8
+
+struct thread;
+
+// Per-CPU area. Each CPU's GDT has a data segment based at its own cpu_t, loaded into
+// gs, so this_cpu() is a single load of the self pointer at gs:0.
+typedef struct cpu {
+    struct cpu *self;
+    uint32_t id;                     // 0 for the boot CPU, then in start-up order
+    uint32_t apic_id;
+    volatile int online;
+    volatile int idle;               // Halted in work_loop(): new work needs an IPI
+    uint32_t stack;                  // Lowest address of its kernel stack (0 on the boot CPU)
+    struct thread *current;          // Running thread, only ever set on the boot CPU (sched.c)
+    volatile uint32_t preempt_count;
+    volatile int need_resched;
+    volatile uint32_t irq_nesting;   // IRQ handlers entered and not yet acknowledged
+    struct thread *fpu_owner;        // Thread whose FPU state is in the registers (fpu.c)
+    volatile int fpu_in_kernel;      // Inside kernel_fpu_begin()/kernel_fpu_end()
+} cpu_t;
+
+#ifdef KERNEL_HOST_BUILD
+cpu_t *this_cpu();
+#else
+static inline cpu_t *this_cpu() {
+    cpu_t *cpu;
+    __asm__ ("mov %%gs:0, %0" : "=r" (cpu));
+    return cpu;
+}
+#endif
+
+#endif // PERCPU_H
@@ -0,0 +1,32 @@
+#ifndef PIC_H
+#define PIC_H
+
+#include "types.h"
+
+// Vectors used for IRQ 0-7 (master) and IRQ 8-15 (slave) after remapping
+#define IRQ_BASE 32
+#define NUM_IRQS 16
+
+// Function to move the 8259 pair to IRQ_BASE and mask every line
+void pic_remap();
+
+// Function to send EOI only to the controller(s) that raised the IRQ
+void pic_send_eoi(uint8_t irq);
+
+// Non-zero if IRQ 7 or 15 fired without being in service (a spurious interrupt).
+// A spurious IRQ 15 still needs an EOI to the master, which this sends.
+int pic_is_spurious(uint8_t irq);
+
+// Function to mask an IRQ line
+void pic_mask(uint8_t irq);
+
+// Function to unmask an IRQ line (and the cascade for slave lines)
+void pic_unmask(uint8_t irq);
+
+// Current mask of all 16 lines (bit n set = IRQ n masked)
+uint16_t pic_get_mask();
+
+// Function to replace the mask of all 16 lines
+void pic_set_mask(uint16_t mask);
+
+#endif // PIC_H
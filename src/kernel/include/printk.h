@@ -0,0 +1,48 @@
+#ifndef PRINTK_H
+#define PRINTK_H
+
+#include "types.h"
+
+// Message levels, most severe first
+#define KERN_EMERG   0
+#define KERN_ALERT   1
+#define KERN_CRIT    2
+#define KERN_ERR     3
+#define KERN_WARNING 4
+#define KERN_NOTICE  5
+#define KERN_INFO    6
+#define KERN_DEBUG   7
+
+// Records kept in the log ring (a power of two); the oldest are overwritten
+#define LOG_RING_RECORDS 512
+
+// Longest message kept, including the terminator; longer ones are truncated
+#define LOG_TEXT_MAX 116
+
+// Console sinks fed from the ring
+#define LOG_SINK_VGA    0
+#define LOG_SINK_SERIAL 1
+#define LOG_NUM_SINKS   2
+
+// Function to format a message into the log ring. Supports %s %c %d %i %u %x %X %p %%
+// with an optional 0 flag and width. Safe from interrupt handlers: the message is
+// only formatted and stored here, and the consoles print it later from deferred work.
+// Levels up to KERN_ERR are also flushed to the consoles at once.
+void printk(int level, const char *fmt, ...);
+
+// Function to let a sink print messages up to (and including) level
+void log_set_level(int sink, int level);
+
+// Function to print everything the sinks have not consumed yet
+void log_flush();
+
+// Function to write every record still in the ring to serial, synchronously
+void log_dump();
+
+// Function for panic paths: flush the consoles and dump the log with interrupts off
+void log_panic();
+
+// Records overwritten before a sink could print them
+uint32_t log_lost(int sink);
+
+#endif // PRINTK_H
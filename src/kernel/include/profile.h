@@ -0,0 +1,37 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+
+// Samples kept per run; later ones are counted as dropped
+#define PROFILE_MAX_SAMPLES 2048
+
+// Frames recorded per sample: the interrupted EIP plus return addresses off the EBP chain
+#define PROFILE_MAX_DEPTH 16
+
+// Frame pointers further than this above the interrupted EBP end the walk
+#define PROFILE_STACK_SPAN 0x4000
+
+#define PROFILE_DEFAULT_INTERVAL_US 1000
+
+// Function to start sampling every interval_us from the one-shot timer. The profiler
+// owns the timer callback until profile_stop(), and samples only arrive while
+// interrupts are enabled.
+void profile_start(uint32_t interval_us);
+
+// Function to stop sampling
+void profile_stop();
+
+// Samples recorded so far
+uint32_t profile_sample_count();
+
+// Function to stop sampling if needed and write the profile to COM1, symbolized
+// through ksyms:
+//   PROFILE_START <samples> <dropped> <interval_us>
+//   FLAT <samples> <percent> <function>        hottest functions by interrupted EIP
+//   FOLDED <outer>;...;<leaf> <samples>        one line per distinct stack
+//   PROFILE_STOP
+// The FOLDED lines are the input format of flamegraph.pl and speedscope.
+void profile_dump();
+
+#endif // PROFILE_H
@@ -0,0 +1,27 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "types.h"
+#include "multiboot.h"
+#include "block.h"
+
+// Ramdisks that can exist at once (the boot image plus scratch disks for tests)
+#define RAMDISK_MAX 4
+
+// Function to register the first boot module that is not an ELF file (init_ksyms()
+// takes those) as block device "rd0": make run RAMDISK=disk.img, or a GRUB module
+// line. The frame allocator keeps module memory, and the image is used in place, so
+// writes change it until reboot. Call before init_frame_allocator(), while the module
+// list is intact. Returns the number of blocks, 0 without an image.
+uint32_t init_ramdisk(multiboot_info_t *mbi);
+
+// Function to make a block device of size bytes of direct-mapped memory at base (from
+// alloc_frames(), say); a partial last block is left out. Returns 0 once RAMDISK_MAX
+// exist or the device table is full.
+block_device_t *ramdisk_create(const char *name, uint32_t base, uint32_t size);
+
+// Busy-wait added to every request (0 by default). Benchmarks use it to model a disk,
+// where the per-request cost, not the copy, dominates.
+void ramdisk_set_request_delay(block_device_t *dev, uint32_t microseconds);
+
+#endif // RAMDISK_H
@@ -0,0 +1,91 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "types.h"
+#include "fpu.h"
+
+// Priorities 0 (highest) to SCHED_PRIORITIES - 1; the boot thread drops to the lowest
+// one when kmain() reaches its idle loop
+#define SCHED_PRIORITIES       32
+#define SCHED_DEFAULT_PRIORITY 16
+#define SCHED_IDLE_PRIORITY    (SCHED_PRIORITIES - 1)
+
+// Time slice given to a thread while another one of the same priority is ready
+#define SCHED_TIMESLICE_US 10000
+
+// Kernel stack per thread; the lowest word holds THREAD_STACK_MAGIC to catch overflows
+#define THREAD_STACK_PAGES 2
+#define THREAD_STACK_MAGIC 0x57ACC0DE
+
+// Thread states
+#define THREAD_READY   0 // On its run queue
+#define THREAD_RUNNING 1 // On the CPU, not queued
+#define THREAD_BLOCKED 2 // Waiting for thread_wake()
+#define THREAD_DEAD    3 // Exited, freed once another thread runs
+
+typedef void (*thread_fn_t)(void *arg);
+
+// Thread control block, a fixed-size object from the "thread" slab cache
+typedef struct thread {
+    uint32_t esp;              // Saved stack pointer while switched out (switch_context)
+    uint32_t id;
+    int state;
+    int priority;
+    const char *name;          // Must outlive the thread (a literal)
+    struct thread *next;       // Run queue links
+    struct thread *prev;
+    thread_fn_t entry;
+    void *arg;
+    uint32_t stack;            // Lowest address of the stack, 0 for the boot thread
+    uint64_t runtime;          // TSC cycles spent on the CPU
+    uint64_t switched_in;      // TSC when it last got the CPU
+    uint32_t switches;         // Times it got the CPU
+    int fpu_used;              // fpu_state holds its FPU registers (set on its first FPU use)
+    uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16))); // FXSAVE area while not loaded
+} thread_t;
+
+typedef struct {
+    uint32_t context_switches;
+    uint32_t preemptions;      // Reschedules on interrupt exit (time slice or a woken thread)
+    uint32_t threads_created;
+    uint32_t threads_exited;
+} sched_stats_t;
+
+// Function to turn the running boot code into the first thread. Call once the slab
+// allocator and the timer are up.
+void init_sched();
+
+// Function to create a thread that runs entry(arg) and exits when it returns. If it
+// has a higher priority than the caller it runs at once. Returns 0 when out of memory.
+thread_t *thread_create(const char *name, thread_fn_t entry, void *arg, int priority);
+
+// Function to end the calling thread
+void thread_exit() __attribute__((noreturn));
+
+// Function to give the CPU to the next ready thread of the same or a higher priority
+void sched_yield();
+
+// Function to stop the calling thread until thread_wake() (callable from interrupts)
+void thread_block();
+void thread_wake(thread_t *thread);
+
+// Function to move a thread to another priority (0 for the caller)
+void sched_set_priority(thread_t *thread, int priority);
+
+thread_t *thread_current();
+
+// Function to pick the highest-priority ready thread and switch to it. The running
+// thread goes to the back of its queue unless it blocked or exited.
+void schedule();
+
+// Functions to keep the calling thread on the CPU through a critical section. They
+// nest; a preemption that came due meanwhile happens in the last preempt_enable().
+void preempt_disable();
+void preempt_enable();
+
+// Called on the way out of an interrupt: switches if a preemption is due
+void sched_irq_exit();
+
+sched_stats_t sched_stats();
+
+#endif // SCHED_H
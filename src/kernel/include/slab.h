@@ -0,0 +1,49 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "types.h"
+#include "spinlock.h"
+
+// Largest object a slab cache can hold
+#define SLAB_MAX_OBJECT_SIZE 4096
+
+// A slab starts with its header. Below SLAB_LARGE_OBJECT it is one page; objects of
+// that size and up get slabs of SLAB_LARGE_PAGES pages, aligned to their size, so the
+// header costs a few percent instead of up to half a page.
+#define SLAB_LARGE_OBJECT 512
+#define SLAB_LARGE_PAGES  8
+
+typedef struct slab slab_t;
+
+// Object cache: slabs of equally sized objects
+typedef struct kmem_cache {
+    const char *name;
+    uint32_t object_size;      // Bytes per object, rounded up to the alignment
+    uint32_t first_offset;     // Offset of the first object within a slab
+    uint32_t objects_per_slab;
+    uint32_t slab_pages;       // 1, or SLAB_LARGE_PAGES
+    slab_t *partial;           // Slabs with at least one free object
+    slab_t *full;              // Slabs with no free objects
+    slab_t *empty;             // At most one fully free slab kept for reuse
+    uint32_t active_objects;
+    uint32_t num_slabs;
+    spinlock_t lock;           // Guards the slab lists and counters
+} kmem_cache_t;
+
+// Function to create a cache of objects of the given size and alignment (power of two).
+// Returns 0 if size is larger than SLAB_MAX_OBJECT_SIZE.
+kmem_cache_t *kmem_cache_create(const char *name, uint32_t size, uint32_t align);
+
+// Function to release a cache and all its slabs (all objects must be freed)
+void kmem_cache_destroy(kmem_cache_t *cache);
+
+// Function to allocate an object from a cache
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+// Function to return an object to its cache
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+// Cache owning an object, found through the header of its slab (0 if not a slab object)
+kmem_cache_t *kmem_cache_of(void *obj);
+
+#endif // SLAB_H
@@ -0,0 +1,44 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "types.h"
+#include "percpu.h"
+
+// Physical page the AP start-up trampoline is copied to. It must be below 1MB and
+// 4KB aligned (the startup IPI vector is its page number), and is kept out of the
+// frame allocator (FRAME_LOW_RESERVED). trampoline.asm assumes the same address.
+#define SMP_TRAMPOLINE_BASE 0x8000
+
+// Kernel stack of each application processor
+#define SMP_AP_STACK_PAGES 2
+
+// Fixed IPI that wakes a CPU halted in work_loop()
+#define SMP_WAKE_VECTOR 0xF0
+
+// Fixed IPI that asks a CPU to drop stale TLB entries (smp_tlb_shootdown())
+#define SMP_TLB_VECTOR 0xF1
+
+// Function to set up the boot CPU's per-CPU area and GDT. Call first thing in kmain():
+// this_cpu() is only valid afterwards.
+void init_boot_cpu();
+
+// Function to start every other CPU the MADT lists with INIT-SIPI-SIPI. Each one loads
+// its own GDT and the shared IDT, then runs work_loop(). Needs the Local APIC (init_apic())
+// and a calibrated TSC (init_timer()). Returns the number of CPUs online.
+uint32_t init_smp();
+
+// Number of CPUs online, and the per-CPU area of CPU id (0 to smp_cpu_count() - 1)
+uint32_t smp_cpu_count();
+cpu_t *smp_cpu(uint32_t id);
+
+// Function to send SMP_WAKE_VECTOR to a CPU
+void smp_wake(cpu_t *cpu);
+
+// Function to make every other online CPU run tlb_invalidate() on the same addresses,
+// and wait until all have. The range functions in paging.c call it after their local
+// flush. Interrupts are off meanwhile, and a CPU waiting to send its own shootdown
+// answers the one in flight. Whoever changes a mapping other CPUs may use must not
+// hold a lock that another CPU could be spinning on with interrupts off.
+void smp_tlb_shootdown(const uint32_t *addresses, uint32_t count, int global);
+
+#endif // SMP_H
@@ -0,0 +1,48 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "types.h"
+#include "cpu.h"
+
+// Ticket lock: a CPU takes the next ticket and waits until owner reaches it, so
+// waiters get the lock in arrival order instead of whoever wins the cache line
+typedef struct {
+    volatile uint16_t owner; // Ticket being served
+    volatile uint16_t next;  // Next ticket to hand out
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock(spinlock_t *lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        __asm__ __volatile__ ("pause");
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+// Non-zero if the lock was free and is now held
+static inline int spin_trylock(spinlock_t *lock) {
+    uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint16_t expected = owner;
+    return __atomic_compare_exchange_n(&lock->next, &expected, (uint16_t)(owner + 1), 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// For data also touched from interrupt handlers: interrupts stay off while the lock is
+// held, so a handler on the same CPU cannot spin on it forever
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
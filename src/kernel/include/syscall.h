@@ -0,0 +1,62 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "types.h"
+
+// Software interrupt for system calls, a DPL 3 gate so ring 3 may raise it
+#define SYSCALL_VECTOR 0x80
+
+// Size of the system call table
+#define SYSCALL_MAX 32
+
+// Returned for numbers without a handler
+#define SYSCALL_ENOSYS ((uint32_t)-1)
+
+// Returned when a pointer argument is not readable (or writable) from ring 3
+#define SYSCALL_EFAULT ((uint32_t)-2)
+
+// Virtual range user programs are mapped in: above the direct map, below vmalloc.
+// Pointer arguments must lie inside it, on present PAGE_USER pages.
+#define USER_SPACE_START 0xC8000000
+#define USER_SPACE_END   0xD0000000
+
+// System call numbers
+#define SYS_EXIT   0 // (status): ends the calling thread
+#define SYS_NULL   1 // (): returns 0, for measuring the entry and exit paths
+#define SYS_GETTID 2 // (): id of the calling thread
+#define SYS_WRITE  3 // (buffer, length): writes to the console, returns length or SYSCALL_EFAULT
+
+// Calling convention, the same through both entry paths: eax holds the number, ebx,
+// esi, edi and ebp the arguments, and eax the result. Arguments stay in registers; the
+// kernel never reads the user stack.
+//   int 0x80  preserves every other register.
+//   SYSENTER  takes the return address in edx and the user esp in ecx, and SYSEXIT
+//             resumes there; ecx and edx are clobbered.
+typedef uint32_t (*syscall_fn_t)(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+
+typedef struct {
+    uint32_t int80;     // Calls through int 0x80
+    uint32_t sysenter;  // Calls through SYSENTER
+    uint32_t unknown;   // Numbers without a handler
+} syscall_stats_t;
+
+// Function to install the int 0x80 gate and the built-in system calls, and program the
+// SYSENTER MSRs of the calling CPU when it has them. Call after init_idt().
+void init_syscalls();
+
+// Non-zero when the CPU supports SYSENTER/SYSEXIT
+int syscall_sysenter_supported();
+
+// Function to install a handler for a system call number (0 removes it)
+void syscall_register(uint32_t number, syscall_fn_t fn);
+
+// Called by both entry stubs with interrupts enabled
+uint32_t syscall_dispatch(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+
+// Function to drop to ring 3 at eip with the given user stack, with interrupts enabled.
+// The calling thread's kernel stack takes every later entry back into the kernel.
+void user_enter(uint32_t eip, uint32_t esp) __attribute__((noreturn));
+
+syscall_stats_t syscall_stats();
+
+#endif // SYSCALL_H
@@ -0,0 +1,46 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+#include "idt.h"
+
+// One-shot timer sources, best first
+#define TIMER_TSC_DEADLINE 0 // Local APIC in TSC-deadline mode
+#define TIMER_APIC_ONESHOT 1 // Local APIC timer counting down
+#define TIMER_PIT_ONESHOT  2 // 8254 channel 0 in mode 0 on IRQ 0 (PIC fallback)
+
+// Function to calibrate the TSC (and APIC timer) against the PIT and pick a one-shot source.
+// Call after init_apic(); with the PIC still in charge the PIT is used.
+void init_timer();
+
+// Independent one-shots sharing the hardware timer, which is armed for the earliest
+// deadline. Delays past the hardware maximum (about 55ms on the PIT) take several
+// interrupts but still fire on time.
+#define TIMER_CLIENT_DEFAULT 0 // timer_set_callback()/timer_arm()/timer_cancel()
+#define TIMER_CLIENT_SCHED   1 // Scheduler time slices
+#define TIMER_NUM_CLIENTS    2
+
+// Functions to install a client's callback, run from the timer interrupt, and to fire it
+// once, microseconds from now. There is no periodic tick: the callback re-arms if it
+// wants another one. Arming again moves the deadline.
+void timer_set_client_callback(int client, interrupt_handler_t callback, void *ctx);
+void timer_arm_client(int client, uint32_t microseconds);
+void timer_cancel_client(int client);
+
+// The same for TIMER_CLIENT_DEFAULT
+void timer_set_callback(interrupt_handler_t callback, void *ctx);
+void timer_arm(uint32_t microseconds);
+void timer_cancel();
+
+// Calibrated TSC frequency
+uint32_t timer_tsc_per_us();
+
+// Function to spin for a number of microseconds on the TSC (for hardware sequences
+// too short, or too early, for the one-shot timer)
+void timer_udelay(uint32_t microseconds);
+
+// The source picked by init_timer()
+int timer_mode();
+const char *timer_mode_name();
+
+#endif // TIMER_H
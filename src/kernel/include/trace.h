@@ -0,0 +1,20 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+
+// Number of events kept; older events are overwritten once the ring is full
+#define TRACE_RING_SIZE 256
+
+// Function to record the start of a named phase
+void trace_begin(const char *name);
+
+// Function to record the end of a named phase
+void trace_end(const char *name);
+
+// Function to dump all recorded events to COM1, one per line:
+//   TRACE <B|E> <64-bit TSC in hex> <name>
+// framed by TRACE_START / TRACE_STOP lines (parsed by tools/boot_trace.py)
+void trace_dump();
+
+#endif // TRACE_H
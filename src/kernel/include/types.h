@@ -4,5 +4,10 @@
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
+typedef unsigned long long uint64_t;
+
+// The compiler's own size type (unsigned int on i386), so declarations of builtins
+// such as strlen() match it
+typedef __SIZE_TYPE__ size_t;
 
 #endif // TYPES_H
\ No newline at end of file
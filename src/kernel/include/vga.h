@@ -0,0 +1,24 @@
+#ifndef VGA_H
+#define VGA_H
+
+#include "types.h"
+
+#define VGA_COLUMNS 80
+#define VGA_ROWS    25
+
+// Text colours (foreground on black)
+#define VGA_COLOR_GREEN      0x02
+#define VGA_COLOR_RED        0x04
+#define VGA_COLOR_LIGHT_GREY 0x07
+#define VGA_COLOR_LIGHT_RED  0x0C
+#define VGA_COLOR_YELLOW     0x0E
+
+// Function to clear the screen and reset the console to the top of VGA memory
+void vga_console_init();
+
+// Function to append a line (without '\n') at the bottom of the console.
+// Scrolls by moving the CRTC start address; text is only copied when the
+// 32KB of text memory wraps, about once every 180 lines.
+void vga_console_write_line(const char *s, uint8_t color);
+
+#endif // VGA_H
@@ -0,0 +1,27 @@
+#ifndef VMALLOC_H
+#define VMALLOC_H
+
+#include "types.h"
+
+// Kernel virtual window for vmalloc(), above the identity map and the test windows
+#define VMALLOC_START 0xF0000000
+#define VMALLOC_END   0xFFC00000
+
+// Unmapped pages left after each allocation to catch overruns (0 to disable)
+#define VMALLOC_GUARD_PAGES 1
+
+// Function to allocate size bytes that are contiguous in virtual memory only.
+// Each page is backed by its own frame, so no contiguous physical run is needed.
+void *vmalloc(uint32_t size);
+
+// Function to free a vmalloc() allocation and its frames
+void vfree(void *ptr);
+
+// Function to map size bytes of device memory at physical_address, uncached.
+// Returns the virtual address of physical_address, or 0 on failure.
+void *ioremap(uint32_t physical_address, uint32_t size);
+
+// Function to remove an ioremap() mapping; the device memory itself is untouched
+void iounmap(void *ptr);
+
+#endif // VMALLOC_H
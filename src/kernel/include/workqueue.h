@@ -0,0 +1,39 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "types.h"
+
+// Items each CPU's queue holds (a power of two)
+#define WORK_QUEUE_SIZE 256
+
+typedef void (*work_fn_t)(void *ctx);
+
+typedef struct {
+    uint32_t queued;   // Items queued on this CPU
+    uint32_t run;      // Items this CPU ran, its own or stolen
+    uint32_t stolen;   // Items this CPU took from another CPU's queue
+} work_stats_t;
+
+// Function to queue fn(ctx) on a CPU's queue (callable from interrupts). An idle target
+// is woken to run it. Otherwise, when the queue backs up or is the caller's own, one
+// idle CPU is woken to steal from it. Returns 0 on success, -1 if the queue is full.
+int work_queue_on(uint32_t cpu, work_fn_t fn, void *ctx);
+
+// The same on the calling CPU's queue
+int work_queue(work_fn_t fn, void *ctx);
+
+// Function to run one item: the newest from the calling CPU's own queue (its data is
+// likely still cached), otherwise the oldest from another CPU's. Returns 0 if every
+// queue was empty.
+int work_run_one();
+
+// Non-zero if any CPU has queued work
+int work_pending();
+
+// Loop run by every application processor: run work, steal work, or halt until an IPI
+void work_loop() __attribute__((noreturn));
+
+// Counters of one CPU
+work_stats_t work_stats(uint32_t cpu);
+
+#endif // WORKQUEUE_H
@@ -0,0 +1,31 @@
+#ifndef ZERO_POOL_H
+#define ZERO_POOL_H
+
+#include "types.h"
+
+// Number of pre-zeroed frames kept ready
+#define ZERO_POOL_SIZE 64
+
+typedef struct {
+    uint32_t hits;    // alloc_zeroed_frame() served from the pool
+    uint32_t misses;  // alloc_zeroed_frame() had to zero on the spot
+    uint32_t refills; // Frames zeroed ahead of time by zero_pool_refill()
+} zero_pool_stats_t;
+
+// Function to allocate a frame whose contents are all zero (0 on failure)
+uint32_t alloc_zeroed_frame();
+
+// Function to zero up to max_frames frames into the pool; returns how many were added.
+// Called from the idle loop with interrupts enabled.
+uint32_t zero_pool_refill(uint32_t max_frames);
+
+// Number of frames currently in the pool
+uint32_t zero_pool_count();
+
+// Current hit/miss/refill counters
+zero_pool_stats_t zero_pool_stats();
+
+// Function to clear one frame through the direct map with memset_rep()
+void zero_frame(uint32_t frame);
+
+#endif // ZERO_POOL_H
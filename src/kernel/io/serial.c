@@ -0,0 +1,227 @@
+#include "../include/io.h"
+#include "../include/idt.h"
+#include "../include/pic.h"
+#include "../include/spinlock.h"
+
+#define SERIAL_COM1_BASE 0x3F8
+#define SERIAL_COM1_IRQ  4
+
+#define SERIAL_DATA_PORT(base)          (base)
+#define SERIAL_INTERRUPT_ENABLE_PORT(base) (base + 1)
+#define SERIAL_FIFO_COMMAND_PORT(base)  (base + 2) // Interrupt identification when read
+#define SERIAL_LINE_COMMAND_PORT(base)  (base + 3)
+#define SERIAL_MODEM_COMMAND_PORT(base) (base + 4)
+#define SERIAL_LINE_STATUS_PORT(base)   (base + 5)
+#define SERIAL_MODEM_STATUS_PORT(base)  (base + 6)
+
+#define SERIAL_BASE_CLOCK 115200 // Divisor 1
+#define SERIAL_FIFO_DEPTH 16
+
+#define LSR_DATA_READY 0x01
+#define LSR_OVERRUN    0x02
+#define LSR_THR_EMPTY  0x20
+
+#define IER_RX_AVAILABLE 0x01
+#define IER_THR_EMPTY    0x02
+
+#define IIR_NONE_PENDING 0x01
+#define IIR_MODEM_STATUS 0x0
+#define IIR_THR_EMPTY    0x1
+#define IIR_RX_AVAILABLE 0x2
+#define IIR_LINE_STATUS  0x3
+#define IIR_RX_TIMEOUT   0x6
+
+// Waits for serial_lock on the way into synchronous output, in case the holder is the
+// CPU that is panicking
+#define SYNC_LOCK_ATTEMPTS 1000000
+
+#define TX_MASK (SERIAL_TX_BUFFER_SIZE - 1)
+#define RX_MASK (SERIAL_RX_BUFFER_SIZE - 1)
+
+static char tx_ring[SERIAL_TX_BUFFER_SIZE];
+static uint32_t tx_head; // Next byte to queue
+static uint32_t tx_tail; // Next byte to hand to the UART
+static char rx_ring[SERIAL_RX_BUFFER_SIZE];
+static volatile uint32_t rx_head;
+static volatile uint32_t rx_tail;
+
+static int irq_ready;  // serial_enable_interrupts() ran
+static int buffered;   // THR-empty interrupts drain the TX ring
+static int tx_running; // A THR-empty interrupt is still due
+static serial_stats_t stats;
+
+// Guards the TX ring, the flags above and the counters: APs print too, and the
+// THR-empty interrupt may run on another CPU than the writer
+static spinlock_t serial_lock = SPINLOCK_INIT;
+
+// Initializes the serial port for polled output
+void serial_init(uint32_t baud) {
+    // Disable all interrupts
+    outb(SERIAL_INTERRUPT_ENABLE_PORT(SERIAL_COM1_BASE), 0x00);
+
+    serial_set_baud(baud);
+
+    // Enable FIFO, clear them, with 14-byte threshold
+    outb(SERIAL_FIFO_COMMAND_PORT(SERIAL_COM1_BASE), 0xC7);
+
+    // Enable IRQs (OUT2), set RTS/DSR
+    outb(SERIAL_MODEM_COMMAND_PORT(SERIAL_COM1_BASE), 0x0B);
+}
+
+void serial_set_baud(uint32_t baud) {
+    uint32_t divisor = baud == 0 || baud > SERIAL_BASE_CLOCK ? 1 : SERIAL_BASE_CLOCK / baud;
+
+    // Enable DLAB (Divisor Latch Access Bit) to set baud rate
+    outb(SERIAL_LINE_COMMAND_PORT(SERIAL_COM1_BASE), 0x80);
+    outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), divisor & 0xFF);
+    outb(SERIAL_INTERRUPT_ENABLE_PORT(SERIAL_COM1_BASE), (divisor >> 8) & 0xFF);
+
+    // Set line protocol: 8 bits, no parity, one stop bit (8N1); clears DLAB
+    outb(SERIAL_LINE_COMMAND_PORT(SERIAL_COM1_BASE), 0x03);
+}
+
+// Check if the serial transmit buffer is empty
+int serial_is_transmit_empty() {
+   return inb(SERIAL_LINE_STATUS_PORT(SERIAL_COM1_BASE)) & LSR_THR_EMPTY;
+}
+
+static void write_polled(char c) {
+   while (serial_is_transmit_empty() == 0); // Wait for transmit buffer to be empty
+   outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), c);
+}
+
+// Move up to a FIFO's worth of queued bytes to the UART; needs THR empty and serial_lock
+static void fill_fifo() {
+    int sent = 0;
+    while (sent < SERIAL_FIFO_DEPTH && tx_tail != tx_head) {
+        outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), tx_ring[tx_tail & TX_MASK]);
+        tx_tail++;
+        sent++;
+    }
+    stats.tx_bytes += sent;
+    tx_running = sent != 0;
+}
+
+static void receive() {
+    while (inb(SERIAL_LINE_STATUS_PORT(SERIAL_COM1_BASE)) & LSR_DATA_READY) {
+        char c = inb(SERIAL_DATA_PORT(SERIAL_COM1_BASE));
+        if (rx_head - rx_tail < SERIAL_RX_BUFFER_SIZE) {
+            rx_ring[rx_head & RX_MASK] = c;
+            rx_head++;
+            stats.rx_bytes++;
+        } else {
+            stats.rx_overruns++;
+        }
+    }
+}
+
+static void serial_interrupt(registers_t *regs, void *ctx) {
+    (void)regs;
+    (void)ctx;
+    uint8_t iir;
+    spin_lock(&serial_lock); // Interrupts are already off
+    while (!((iir = inb(SERIAL_FIFO_COMMAND_PORT(SERIAL_COM1_BASE))) & IIR_NONE_PENDING)) {
+        switch ((iir >> 1) & 0x7) {
+        case IIR_THR_EMPTY:
+            stats.tx_interrupts++;
+            fill_fifo();
+            break;
+        case IIR_RX_AVAILABLE:
+        case IIR_RX_TIMEOUT:
+            receive();
+            break;
+        case IIR_LINE_STATUS:
+            if (inb(SERIAL_LINE_STATUS_PORT(SERIAL_COM1_BASE)) & LSR_OVERRUN) {
+                stats.rx_overruns++;
+            }
+            break;
+        default:
+            inb(SERIAL_MODEM_STATUS_PORT(SERIAL_COM1_BASE));
+            break;
+        }
+    }
+    spin_unlock(&serial_lock);
+}
+
+void serial_enable_interrupts() {
+    register_irq_handler(IRQ_BASE + SERIAL_COM1_IRQ, serial_interrupt, 0);
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    irq_ready = 1;
+    buffered = 1;
+    outb(SERIAL_INTERRUPT_ENABLE_PORT(SERIAL_COM1_BASE), IER_RX_AVAILABLE | IER_THR_EMPTY);
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+// Write a character to the serial port. Once interrupts are enabled this only queues it.
+// On a full ring, thread context pushes the oldest byte out by polling, so bulk dumps
+// (trace_dump(), profile_dump(), KTEST lines) stay whole; an interrupt handler must not
+// wait for the line and drops the byte instead.
+void serial_write(char c) {
+    if (!buffered) {
+        write_polled(c); // Synchronous mode is for panics, so no lock
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    if (tx_head - tx_tail == SERIAL_TX_BUFFER_SIZE) {
+        if (in_interrupt()) {
+            stats.tx_dropped++;
+            spin_unlock_irqrestore(&serial_lock, flags);
+            return;
+        }
+        stats.tx_ring_full++;
+        write_polled(tx_ring[tx_tail & TX_MASK]);
+        tx_tail++;
+        stats.tx_bytes++;
+    }
+    tx_ring[tx_head & TX_MASK] = c;
+    tx_head++;
+    if (!tx_running && serial_is_transmit_empty()) {
+        fill_fifo(); // Idle UART: start the chain of THR-empty interrupts
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+// Write a string to the serial port
+void serial_write_string(const char *s) {
+   while (*s != '\0') {
+       serial_write(*s++);
+   }
+}
+
+void serial_set_sync(int sync) {
+    uint32_t flags = irq_save();
+    // A panic may come from inside the lock on this CPU, so give up waiting after a while
+    int locked = 0;
+    for (uint32_t attempt = 0; !locked && attempt < SYNC_LOCK_ATTEMPTS; attempt++) {
+        locked = spin_trylock(&serial_lock);
+    }
+    if (sync) {
+        // Push out everything already queued, then bypass the ring from now on
+        while (tx_tail != tx_head) {
+            write_polled(tx_ring[tx_tail & TX_MASK]);
+            tx_tail++;
+            stats.tx_bytes++;
+        }
+        buffered = 0;
+        tx_running = 0;
+    } else {
+        buffered = irq_ready;
+    }
+    if (locked) {
+        spin_unlock(&serial_lock);
+    }
+    irq_restore(flags);
+}
+
+int serial_read(char *c) {
+    if (rx_tail == rx_head) {
+        return -1;
+    }
+    *c = rx_ring[rx_tail & RX_MASK];
+    rx_tail++;
+    return 0;
+}
+
+serial_stats_t serial_stats() {
+    return stats;
+}
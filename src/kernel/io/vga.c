@@ -0,0 +1,48 @@
+#include "vga.h"
+#include "io.h"
+#include "kstring.h"
+
+#define VGA_MEMORY       ((volatile uint16_t *)0xB8000)
+#define VGA_BUFFER_ROWS  204 // 32KB of text memory / 160 bytes per row
+#define CRTC_INDEX       0x3D4
+#define CRTC_DATA        0x3D5
+#define CRTC_CURSOR_START 0x0A
+#define CRTC_START_HIGH   0x0C // Followed by CRTC_START_LOW
+#define CURSOR_DISABLE    0x20
+
+static int next_row; // Row of VGA memory the next line goes to
+
+static void crtc_write16(uint8_t high_register, uint16_t value) {
+    outb(CRTC_INDEX, high_register);
+    outb(CRTC_DATA, value >> 8);
+    outb(CRTC_INDEX, high_register + 1);
+    outb(CRTC_DATA, value & 0xFF);
+}
+
+void vga_console_init() {
+    memset16((uint16_t *)VGA_MEMORY, (VGA_COLOR_GREEN << 8) | ' ', VGA_BUFFER_ROWS * VGA_COLUMNS);
+    next_row = 0;
+    crtc_write16(CRTC_START_HIGH, 0);
+    outb(CRTC_INDEX, CRTC_CURSOR_START);
+    outb(CRTC_DATA, CURSOR_DISABLE);
+}
+
+void vga_console_write_line(const char *s, uint8_t color) {
+    if (next_row == VGA_BUFFER_ROWS) {
+        // Out of text memory: bring the visible rows (but the last) back to the top
+        memcpy((void *)VGA_MEMORY, (const void *)(VGA_MEMORY + (VGA_BUFFER_ROWS - VGA_ROWS + 1) * VGA_COLUMNS),
+               (VGA_ROWS - 1) * VGA_COLUMNS * 2);
+        next_row = VGA_ROWS - 1;
+    }
+
+    volatile uint16_t *line = VGA_MEMORY + next_row * VGA_COLUMNS;
+    int col = 0;
+    for (; s[col] != '\0' && col < VGA_COLUMNS; col++) {
+        line[col] = (color << 8) | (uint8_t)s[col];
+    }
+    memset16((uint16_t *)line + col, (color << 8) | ' ', VGA_COLUMNS - col);
+    next_row++;
+
+    int top = next_row > VGA_ROWS ? next_row - VGA_ROWS : 0;
+    crtc_write16(CRTC_START_HIGH, top * VGA_COLUMNS);
+}
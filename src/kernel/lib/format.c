@@ -0,0 +1,75 @@
+#include "kstring.h"
+
+// Two digits per table entry, so each division by 100 emits a pair
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+uint32_t utoa_dec(uint32_t value, char *s) {
+    // Digits are produced from the right into a scratch buffer, so no reverse pass is needed
+    char tmp[10];
+    char *p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--p = digit_pairs[value * 2 + 1];
+        *--p = digit_pairs[value * 2];
+    } else {
+        *--p = '0' + value;
+    }
+    uint32_t length = tmp + sizeof(tmp) - p;
+    for (uint32_t i = 0; i < length; i++) {
+        s[i] = p[i];
+    }
+    s[length] = '\0';
+    return length;
+}
+
+void itoa(int n, char s[]) {
+    if (n < 0) {
+        *s++ = '-';
+        utoa_dec(-(uint32_t)n, s);
+    } else {
+        utoa_dec(n, s);
+    }
+}
+
+uint32_t utoa_hex(uint32_t value, char *s, int min_digits, int upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    // Count significant nibbles from the highest set bit instead of dividing
+    int length = 1;
+    if (value != 0) {
+        int top_bit;
+        __asm__ ("bsr %1, %0" : "=r" (top_bit) : "rm" (value));
+        length = top_bit / 4 + 1;
+    }
+    if (length < min_digits) {
+        length = min_digits > 8 ? 8 : min_digits;
+    }
+    for (int i = length - 1; i >= 0; i--) {
+        s[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+    s[length] = '\0';
+    return length;
+}
+
+size_t strlen(const char *s) {
+    size_t i = 0;
+    while (s[i] != '\0')
+        i++;
+    return i;
+}
@@ -0,0 +1,218 @@
+#include "kstring.h"
+#include "cpu.h"
+#include "fpu.h"
+
+// Copies at least this large go through the SSE2 loop; below it rep movsd wins, more so
+// with the CR0.TS writes of kernel_fpu_begin()/kernel_fpu_end() on top
+#define SSE2_MIN_SIZE 1024
+
+// From this size on, stores bypass the cache: the destination would only evict useful lines
+#define SSE2_NONTEMPORAL_SIZE (256 * 1024)
+
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+typedef void *(*memcpy_fn_t)(void *dest, const void *src, uint32_t n);
+typedef void *(*memset_fn_t)(void *dest, int c, uint32_t n);
+
+static void *memcpy_rep(void *dest, const void *src, uint32_t n);
+
+static memcpy_fn_t memcpy_impl = memcpy_rep;
+static memset_fn_t memset_impl = memset_rep;
+static const char *variant = "rep";
+static int has_movnti; // SSE2, which movnti needs; unlike the xmm stores it works with the FPU off
+
+static void *memcpy_rep(void *dest, const void *src, uint32_t n) {
+    void *d = dest;
+    uint32_t dwords = n >> 2;
+    uint32_t bytes = n & 3;
+    __asm__ __volatile__ ("rep movsl" : "+D" (d), "+S" (src), "+c" (dwords) : : "memory");
+    __asm__ __volatile__ ("rep movsb" : "+D" (d), "+S" (src), "+c" (bytes) : : "memory");
+    return dest;
+}
+
+void *memset_rep(void *dest, int c, uint32_t n) {
+    void *d = dest;
+    uint32_t pattern = (uint8_t)c * 0x01010101;
+    uint32_t dwords = n >> 2;
+    uint32_t bytes = n & 3;
+    __asm__ __volatile__ ("rep stosl" : "+D" (d), "+c" (dwords) : "a" (pattern) : "memory");
+    __asm__ __volatile__ ("rep stosb" : "+D" (d), "+c" (bytes) : "a" (pattern) : "memory");
+    return dest;
+}
+
+// Align the destination to 16 bytes with rep, move 64-byte blocks through xmm0-3,
+// and finish the tail with rep. target("sse2") lets the asm clobber xmm registers in a
+// kernel otherwise built for the plain i386 register set; kernel_fpu_begin() saves the
+// thread state they may hold, and fails inside an interrupt that cut another copy short.
+__attribute__((target("sse2")))
+static void *memcpy_sse2(void *dest, const void *src, uint32_t n) {
+    if (n < SSE2_MIN_SIZE || !kernel_fpu_begin()) {
+        return memcpy_rep(dest, src, n);
+    }
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+    uint32_t head = (16 - ((uint32_t)d & 15)) & 15;
+    memcpy_rep(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    uint32_t blocks = n / 64;
+    if (n >= SSE2_NONTEMPORAL_SIZE) {
+        for (; blocks != 0; blocks--, d += 64, s += 64) {
+            __asm__ __volatile__ (
+                "movdqu   (%1), %%xmm0\n\t"
+                "movdqu 16(%1), %%xmm1\n\t"
+                "movdqu 32(%1), %%xmm2\n\t"
+                "movdqu 48(%1), %%xmm3\n\t"
+                "movntdq %%xmm0,   (%0)\n\t"
+                "movntdq %%xmm1, 16(%0)\n\t"
+                "movntdq %%xmm2, 32(%0)\n\t"
+                "movntdq %%xmm3, 48(%0)"
+                : : "r" (d), "r" (s) : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        }
+        __asm__ __volatile__ ("sfence" ::: "memory");
+    } else {
+        for (; blocks != 0; blocks--, d += 64, s += 64) {
+            __asm__ __volatile__ (
+                "movdqu   (%1), %%xmm0\n\t"
+                "movdqu 16(%1), %%xmm1\n\t"
+                "movdqu 32(%1), %%xmm2\n\t"
+                "movdqu 48(%1), %%xmm3\n\t"
+                "movdqa %%xmm0,   (%0)\n\t"
+                "movdqa %%xmm1, 16(%0)\n\t"
+                "movdqa %%xmm2, 32(%0)\n\t"
+                "movdqa %%xmm3, 48(%0)"
+                : : "r" (d), "r" (s) : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        }
+    }
+    kernel_fpu_end();
+    memcpy_rep(d, s, n & 63);
+    return dest;
+}
+
+__attribute__((target("sse2")))
+static void *memset_sse2(void *dest, int c, uint32_t n) {
+    if (n < SSE2_MIN_SIZE || !kernel_fpu_begin()) {
+        return memset_rep(dest, c, n);
+    }
+    uint8_t *d = (uint8_t *)dest;
+    uint32_t head = (16 - ((uint32_t)d & 15)) & 15;
+    memset_rep(d, c, head);
+    d += head;
+    n -= head;
+
+    // The broadcast is redone per block so xmm0 never has to live across asm statements
+    uint32_t pattern = (uint8_t)c * 0x01010101;
+    uint32_t blocks = n / 64;
+    int nontemporal = n >= SSE2_NONTEMPORAL_SIZE;
+    for (; blocks != 0; blocks--, d += 64) {
+        if (nontemporal) {
+            __asm__ __volatile__ (
+                "movd %1, %%xmm0\n\t"
+                "pshufd $0, %%xmm0, %%xmm0\n\t"
+                "movntdq %%xmm0,   (%0)\n\t"
+                "movntdq %%xmm0, 16(%0)\n\t"
+                "movntdq %%xmm0, 32(%0)\n\t"
+                "movntdq %%xmm0, 48(%0)" : : "r" (d), "r" (pattern) : "memory", "xmm0");
+        } else {
+            __asm__ __volatile__ (
+                "movd %1, %%xmm0\n\t"
+                "pshufd $0, %%xmm0, %%xmm0\n\t"
+                "movdqa %%xmm0,   (%0)\n\t"
+                "movdqa %%xmm0, 16(%0)\n\t"
+                "movdqa %%xmm0, 32(%0)\n\t"
+                "movdqa %%xmm0, 48(%0)" : : "r" (d), "r" (pattern) : "memory", "xmm0");
+        }
+    }
+    if (nontemporal) {
+        __asm__ __volatile__ ("sfence" ::: "memory");
+    }
+    kernel_fpu_end();
+    memset_rep(d, c, n & 63);
+    return dest;
+}
+
+void init_string_lib() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    has_movnti = (edx & CPUID_EDX_SSE2) != 0;
+    // xmm registers fault (#UD) until init_fpu() sets CR4.OSFXSR
+    if ((edx & CPUID_EDX_SSE2) && fpu_enabled()) {
+        memcpy_impl = memcpy_sse2;
+        memset_impl = memset_sse2;
+        variant = "sse2";
+    } else {
+        memcpy_impl = memcpy_rep;
+        memset_impl = memset_rep;
+        variant = "rep";
+    }
+}
+
+const char *string_lib_variant() {
+    return variant;
+}
+
+void *memcpy(void *dest, const void *src, uint32_t n) {
+    return memcpy_impl(dest, src, n);
+}
+
+void *memset(void *dest, int c, uint32_t n) {
+    return memset_impl(dest, c, n);
+}
+
+void *memzero_nontemporal(void *dest, uint32_t n) {
+    if (!has_movnti || ((uint32_t)dest & 3)) {
+        return memset_rep(dest, 0, n);
+    }
+    word_t *d = (word_t *)dest;
+    for (uint32_t blocks = n / 16; blocks != 0; blocks--, d += 4) {
+        __asm__ __volatile__ (
+            "movnti %1,   (%0)\n\t"
+            "movnti %1,  4(%0)\n\t"
+            "movnti %1,  8(%0)\n\t"
+            "movnti %1, 12(%0)" : : "r" (d), "r" (0) : "memory");
+    }
+    __asm__ __volatile__ ("sfence" ::: "memory"); // Order the stores before the memory is handed out
+    memset_rep(d, 0, n & 15);
+    return dest;
+}
+
+void *memmove(void *dest, const void *src, uint32_t n) {
+    if ((uint32_t)dest - (uint32_t)src >= n) {
+        return memcpy(dest, src, n); // No overlap, or dest below src: a forward copy is safe
+    }
+    // Copy backwards: the trailing bytes first, then whole dwords
+    void *d = (uint8_t *)dest + n - 1;
+    const void *s = (const uint8_t *)src + n - 1;
+    uint32_t bytes = n & 3;
+    uint32_t dwords = n >> 2;
+    __asm__ __volatile__ ("std\n\trep movsb" : "+D" (d), "+S" (s), "+c" (bytes) : : "memory");
+    d = (uint8_t *)d - 3;
+    s = (const uint8_t *)s - 3;
+    __asm__ __volatile__ ("rep movsl\n\tcld" : "+D" (d), "+S" (s), "+c" (dwords) : : "memory");
+    return dest;
+}
+
+int memcmp(const void *a, const void *b, uint32_t n) {
+    const uint8_t *p = (const uint8_t *)a;
+    const uint8_t *q = (const uint8_t *)b;
+    // Skip equal dwords, then find the first differing byte
+    while (n >= 4 && *(const word_t *)p == *(const word_t *)q) {
+        p += 4;
+        q += 4;
+        n -= 4;
+    }
+    for (; n != 0; n--, p++, q++) {
+        if (*p != *q) {
+            return *p - *q;
+        }
+    }
+    return 0;
+}
+
+void *memset16(uint16_t *dest, uint16_t value, uint32_t count) {
+    void *d = dest;
+    __asm__ __volatile__ ("rep stosw" : "+D" (d), "+c" (count) : "a" (value) : "memory");
+    return dest;
+}
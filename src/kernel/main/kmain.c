@@ -5,230 +5,1682 @@
 #include "../include/paging.h"
 #include "../include/frame_allocator.h"
 #include "../include/kmalloc.h"
+#include "../include/slab.h"
 #include "../include/io.h"
+#include "../include/cpu.h"
+#include "../include/trace.h"
+#include "../include/demand_paging.h"
+#include "../include/zero_pool.h"
+#include "../include/vmalloc.h"
+#include "../include/apic.h"
+#include "../include/timer.h"
+#include "../include/deferred.h"
+#include "../include/printk.h"
+#include "../include/vga.h"
+#include "../include/kstring.h"
+#include "../include/ktest.h"
+#include "../include/ksyms.h"
+#include "../include/profile.h"
+#include "../include/sched.h"
+#include "../include/smp.h"
+#include "../include/workqueue.h"
+#include "../include/spinlock.h"
+#include "../include/syscall.h"
+#include "../include/fpu.h"
+#include "../include/block.h"
+#include "../include/ramdisk.h"
+#include "../include/buffer_cache.h"
 
-void print_string(const char *s, int row, int col) {
-    // Print to screen
-    char *videomemptr = (char *)0xb8000;
-    unsigned int offset = (row * 80 + col) * 2;
-    unsigned int j = 0;
-    while (s[j] != '\0') {
-        videomemptr[offset] = s[j];
-        videomemptr[offset + 1] = 0x02;
-        j++;
-        offset += 2;
+int boot_verbose = 0;
+
+// What the kernel command line asked for: a normal boot, or only the tests/benchmarks
+#define BOOT_NORMAL 0
+#define BOOT_KTEST  1 // "ktest": run the registered tests, then exit QEMU
+#define BOOT_KBENCH 2 // "kbench": run the registered benchmarks, then exit QEMU
+
+static int boot_mode = BOOT_NORMAL;
+
+// Non-zero when the command line contains "profile": sample from the timer until boot
+// (or the ktest/kbench run) ends, then write the profile to COM1
+static int boot_profile = 0;
+
+// Non-zero when the command line contains "selftest": a normal boot then also runs the
+// registered tests and the reports below (test_*, bench_*) before going idle. Some of
+// them take the timer or exhaust memory, so a plain boot skips them.
+static int boot_selftest = 0;
+
+#define STRESS_MAX_FRAMES 16384 // Enough to fill the 64MB QEMU guest
+#define STRESS_SAMPLES 64
+
+static uint32_t stress_frames[STRESS_MAX_FRAMES];
+
+// Average cycles for STRESS_SAMPLES alloc_frame() calls; the frames are freed again
+static uint32_t time_frame_allocs(uint32_t *samples) {
+    uint64_t start = rdtsc();
+    for (int i = 0; i < STRESS_SAMPLES; i++) {
+        samples[i] = alloc_frame();
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    for (int i = 0; i < STRESS_SAMPLES; i++) {
+        free_frame(samples[i]);
+    }
+    return cycles / STRESS_SAMPLES;
+}
+
+// Fill physical memory step by step and time alloc_frame() at each occupancy level.
+// The backend is timed with the per-CPU caches off, since with them on most
+// allocations never reach it; the cached number is printed next to it.
+static void test_frame_allocator_latency() {
+    static const uint32_t levels[] = { 0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 99 };
+    uint32_t samples[STRESS_SAMPLES];
+    uint32_t pool = frame_allocator_free_count();
+    uint32_t held = 0;
+
+    if (pool > STRESS_MAX_FRAMES) {
+        pool = STRESS_MAX_FRAMES;
+    }
+    printk(KERN_INFO, "--- FRAME ALLOCATOR LATENCY TEST START ---");
+
+    for (uint32_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        uint32_t target = pool * levels[l] / 100;
+        if (target + STRESS_SAMPLES > pool) {
+            target = pool - STRESS_SAMPLES;
+        }
+        while (held < target) {
+            uint32_t frame = alloc_frame();
+            if (frame == 0) {
+                break;
+            }
+            stress_frames[held++] = frame;
+        }
+
+        frame_cache_set_enabled(0);
+        free_frame(alloc_frame()); // Drain this CPU's cache outside the timed loop
+        uint32_t backend = time_frame_allocs(samples);
+        frame_cache_set_enabled(1);
+        uint32_t cached = time_frame_allocs(samples);
+
+        printk(KERN_INFO, "  Occupancy %%: %2u   cycles/alloc backend: %u  cached: %u",
+               levels[l], backend, cached);
+    }
+
+    for (uint32_t i = 0; i < held; i++) {
+        free_frame(stress_frames[i]);
+    }
+    printk(KERN_INFO, "--- FRAME ALLOCATOR LATENCY TEST END ---");
+}
+
+#define WORKLOAD_SLOTS 256
+#define WORKLOAD_ROUNDS 8
+
+#ifdef FRAME_ALLOCATOR_BUDDY
+#define FRAME_BACKEND_NAME "buddy"
+#else
+#define FRAME_BACKEND_NAME "bitmap"
+#endif
+
+static uint32_t workload_addrs[WORKLOAD_SLOTS];
+static uint32_t workload_counts[WORKLOAD_SLOTS];
+
+// Run a pseudo-random mix of 1..64 frame runs against the backend built in. Only one
+// backend exists per build, so the other is compared by booting a kernel built with
+// the other FRAME_ALLOCATOR (the host benchmark builds both).
+static void test_frame_backends() {
+    printk(KERN_INFO, "--- FRAME BACKEND WORKLOAD START ---");
+    uint32_t seed = 12345;
+    uint32_t fails = 0;
+
+    uint64_t start = rdtsc();
+    for (int round = 0; round < WORKLOAD_ROUNDS; round++) {
+        for (int i = 0; i < WORKLOAD_SLOTS; i++) {
+            seed = seed * 1103515245 + 12345;
+            if (workload_addrs[i] == 0) {
+                workload_counts[i] = 1 << ((seed >> 16) % 7);
+                workload_addrs[i] = alloc_frames(workload_counts[i], 0);
+                if (workload_addrs[i] == 0) {
+                    fails++;
+                }
+            }
+        }
+        for (int i = 0; i < WORKLOAD_SLOTS; i++) {
+            seed = seed * 1103515245 + 12345;
+            if (((seed >> 16) & 1) && workload_addrs[i] != 0) {
+                free_frames(workload_addrs[i], workload_counts[i]);
+                workload_addrs[i] = 0;
+            }
+        }
     }
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
 
-    // Print to serial
-    j = 0;
-    while (s[j] != '\0') {
-        serial_write(s[j]);
-        j++;
+    // With about half of the blocks still live, check that a 4MB run can still be found
+    uint32_t big = alloc_frames(1024, 0);
+    if (big != 0) {
+        free_frames(big, 1024);
+    }
+    for (int i = 0; i < WORKLOAD_SLOTS; i++) {
+        if (workload_addrs[i] != 0) {
+            free_frames(workload_addrs[i], workload_counts[i]);
+            workload_addrs[i] = 0;
+        }
     }
-    serial_write('\n');
+
+    printk(KERN_INFO, "  %s  cycles: %u  fails: %u  4MB run: %s",
+           FRAME_BACKEND_NAME, cycles, fails, big != 0 ? "ok" : "none");
+    printk(KERN_INFO, "--- FRAME BACKEND WORKLOAD END ---");
 }
 
-void itoa(int n, char s[]) {
-    int i, sign;
-    if ((sign = n) < 0)
-        n = -n;
-    i = 0;
-    do {
-        s[i++] = n % 10 + '0';
-    } while ((n /= 10) > 0);
-    if (sign < 0)
-        s[i++] = '-';
-    s[i] = '\0';
-    int c, j;
-    for (i = 0, j = strlen(s)-1; i<j; i++, j--) {
-        c = s[i];
-        s[i] = s[j];
-        s[j] = c;
+// Check whether a space-separated word appears on the kernel command line
+static int cmdline_has(const char *cmdline, const char *word) {
+    int len = strlen(word);
+    for (const char *p = cmdline; *p != '\0'; p++) {
+        if ((p == cmdline || p[-1] == ' ') && (p[len] == '\0' || p[len] == ' ')) {
+            int i = 0;
+            while (i < len && p[i] == word[i]) {
+                i++;
+            }
+            if (i == len) {
+                return 1;
+            }
+        }
     }
+    return 0;
 }
 
-int strlen(const char *s) {
-    int i = 0;
-    while (s[i] != '\0')
-        i++;
-    return i;
+#define TLB_SWEEP_WINDOW 0xD0000000 // 4KB mappings here, 4MB mappings right after
+#define TLB_SWEEP_SIZE   0x800000 // 8MB: 2048 small pages or 2 large pages
+#define TLB_SWEEP_PASSES 8
+
+// Touch one byte per 4KB page, so the cost is dominated by TLB misses
+static uint32_t sweep_buffer(volatile uint8_t *buffer) {
+    uint64_t start = rdtsc();
+    for (int pass = 0; pass < TLB_SWEEP_PASSES; pass++) {
+        for (uint32_t offset = 0; offset < TLB_SWEEP_SIZE; offset += 4096) {
+            buffer[offset]++;
+        }
+    }
+    return (uint32_t)(rdtsc() - start);
 }
 
-void print_hex(uint32_t value, int row, int col) {
-    char hex_digits[] = "0123456789ABCDEF";
-    char buffer[11]; // "0x" + 8 hex digits + null terminator
-    buffer[0] = '0';
-    buffer[1] = 'x';
-    buffer[10] = '\0';
+// Sweep the same physical buffer through 4KB mappings and through 4MB mappings
+static void bench_large_pages() {
+    printk(KERN_INFO, "--- 4KB VS 4MB PAGE SWEEP START ---");
+    if (!paging_large_pages_enabled()) {
+        printk(KERN_INFO, "  CPU has no PSE, skipped.");
+        printk(KERN_INFO, "--- 4KB VS 4MB PAGE SWEEP END ---");
+        return;
+    }
+    uint32_t frames = TLB_SWEEP_SIZE / 4096;
+    uint32_t buffer = alloc_frames(frames, 0x400000);
+    if (buffer == 0) {
+        printk(KERN_INFO, "  No 8MB run available, skipped.");
+        printk(KERN_INFO, "--- 4KB VS 4MB PAGE SWEEP END ---");
+        return;
+    }
 
-    for (int i = 9; i >= 2; i--) {
-        buffer[i] = hex_digits[value % 16];
-        value /= 16;
+    for (uint32_t offset = 0; offset < TLB_SWEEP_SIZE; offset += 4096) {
+        map_page(TLB_SWEEP_WINDOW + offset, buffer + offset);
     }
-    print_string(buffer, row, col);
+    uint32_t small_cycles = sweep_buffer((volatile uint8_t *)TLB_SWEEP_WINDOW);
+    unmap_range(TLB_SWEEP_WINDOW, TLB_SWEEP_SIZE);
+
+    uint32_t large_window = TLB_SWEEP_WINDOW + TLB_SWEEP_SIZE;
+    map_range(large_window, buffer, TLB_SWEEP_SIZE, PAGE_RW);
+    uint32_t large_cycles = sweep_buffer((volatile uint8_t *)large_window);
+    unmap_range(large_window, TLB_SWEEP_SIZE);
+    free_frames(buffer, frames);
+
+    printk(KERN_INFO, "  4KB pages, cycles: %u", small_cycles);
+    printk(KERN_INFO, "  4MB pages, cycles: %u", large_cycles);
+    printk(KERN_INFO, "--- 4KB VS 4MB PAGE SWEEP END ---");
 }
 
+#define LAZY_TEST_REGION 0xE0000000
+#define LAZY_TEST_SIZE   0x10000000 // 256MB reserved, only a few pages touched
 
-void kmain(uint32_t multiboot_magic, uint32_t multiboot_info_addr) {
-    serial_init();
+// Reserve a large sparse region, touch a few pages and count faults and frames used
+static void test_demand_paging() {
+    printk(KERN_INFO, "--- DEMAND PAGING TEST START ---");
 
-    char *videomemptr = (char *)0xb8000;
-    unsigned int j = 0;
-    while (j < 80 * 25 * 2) {
-        videomemptr[j] = ' ';
-        videomemptr[j + 1] = 0x02;
-        j = j + 2;
+    uint32_t free_before = frame_allocator_free_count();
+    if (reserve_lazy_region(LAZY_TEST_REGION, LAZY_TEST_SIZE) != 0) {
+        printk(KERN_ERR, "  Could not reserve lazy region.");
+        printk(KERN_INFO, "--- DEMAND PAGING TEST END ---");
+        return;
     }
+    uint32_t free_reserved = frame_allocator_free_count();
 
-    print_string("Initializing IDT...", 0, 0);
-    init_idt();
+    // Read every 16th page of the first 16MB: all should see the shared zero page
+    volatile uint32_t *region = (volatile uint32_t *)LAZY_TEST_REGION;
+    uint32_t nonzero = 0;
+    for (uint32_t offset = 0; offset < 0x1000000; offset += 16 * 4096) {
+        nonzero += region[offset / 4] != 0;
+    }
+    // Write every 128th page, then read the values back
+    for (uint32_t offset = 0; offset < 0x1000000; offset += 128 * 4096) {
+        region[offset / 4] = offset;
+    }
+    for (uint32_t offset = 0; offset < 0x1000000; offset += 128 * 4096) {
+        nonzero += region[offset / 4] != offset;
+    }
+    uint32_t free_touched = frame_allocator_free_count();
+    demand_paging_stats_t stats = demand_paging_stats();
 
-    print_string("Enabling interrupts...", 1, 0);
-    __asm__ __volatile__ ("sti");
+    release_lazy_region(LAZY_TEST_REGION);
 
-    // Temporarily disable interrupts for stable output during tests
-    __asm__ __volatile__ ("cli");
-    print_string("Interrupts temporarily disabled.", 3, 0);
+    printk(KERN_INFO, "  Frames used by reservation: %u", free_before - free_reserved);
+    printk(KERN_INFO, "  Read faults: %u   Write faults: %u", stats.read_faults, stats.write_faults);
+    printk(KERN_INFO, "  Frames used after touching (incl. page tables): %u", free_reserved - free_touched);
+    printk(KERN_INFO, "  Frames still held after release: %u", free_before - frame_allocator_free_count());
+    printk(nonzero == 0 ? KERN_INFO : KERN_ERR, nonzero == 0 ? "  Data check passed." : "  Data check FAILED.");
+    printk(KERN_INFO, "--- DEMAND PAGING TEST END ---");
+}
 
-    print_string("Kernel running!", 2, 0);
+#define ZERO_BENCH_FRAMES 16
 
-    if (multiboot_magic != 0x2BADB002) {
-        print_string("Error: Invalid Multiboot magic number!", 4, 0);
-        while(1);
+// Compare alloc_zeroed_frame() served from the pre-zeroed pool with zeroing on demand
+static void bench_zero_pool() {
+    uint32_t frames[2 * ZERO_BENCH_FRAMES];
+    printk(KERN_INFO, "--- ZERO POOL BENCH START ---");
+
+    zero_pool_refill(ZERO_BENCH_FRAMES);
+    uint64_t start = rdtsc();
+    for (int i = 0; i < ZERO_BENCH_FRAMES; i++) {
+        frames[i] = alloc_zeroed_frame();
+    }
+    uint32_t hit_cycles = (uint32_t)(rdtsc() - start);
+    start = rdtsc();
+    for (int i = ZERO_BENCH_FRAMES; i < 2 * ZERO_BENCH_FRAMES; i++) {
+        frames[i] = alloc_zeroed_frame();
+    }
+    uint32_t miss_cycles = (uint32_t)(rdtsc() - start);
+    for (int i = 0; i < 2 * ZERO_BENCH_FRAMES; i++) {
+        free_frame(frames[i]);
+    }
+
+    zero_pool_stats_t stats = zero_pool_stats();
+    printk(KERN_INFO, "  Pool hit, cycles/frame: %u", hit_cycles / ZERO_BENCH_FRAMES);
+    printk(KERN_INFO, "  Pool miss, cycles/frame: %u", miss_cycles / ZERO_BENCH_FRAMES);
+    printk(KERN_INFO, "  Hits: %u   Misses: %u", stats.hits, stats.misses);
+    printk(KERN_INFO, "--- ZERO POOL BENCH END ---");
+}
+
+#define VMALLOC_TEST_SIZE 0x400000 // 4MB
+
+// Fragment physical memory so no 4MB run is left, then compare alloc_frames() with vmalloc()
+static void test_vmalloc() {
+    printk(KERN_INFO, "--- VMALLOC TEST START ---");
+
+    // Take every free frame, then give back every other one
+    uint32_t held = 0;
+    while (held < STRESS_MAX_FRAMES) {
+        uint32_t frame = alloc_frame();
+        if (frame == 0) {
+            break;
+        }
+        stress_frames[held++] = frame;
+    }
+    for (uint32_t i = 0; i < held; i += 2) {
+        free_frame(stress_frames[i]);
+    }
+
+    uint32_t run = alloc_frames(VMALLOC_TEST_SIZE / 4096, 0);
+    printk(KERN_INFO, "  alloc_frames(4MB) on fragmented memory: %s", run != 0 ? "ok" : "failed");
+    if (run != 0) {
+        free_frames(run, VMALLOC_TEST_SIZE / 4096);
+    }
+
+    uint32_t *buffer = (uint32_t *)vmalloc(VMALLOC_TEST_SIZE);
+    uint32_t errors = 0;
+    if (buffer != 0) {
+        for (uint32_t i = 0; i < VMALLOC_TEST_SIZE / 4; i += 1024) {
+            buffer[i] = i;
+        }
+        for (uint32_t i = 0; i < VMALLOC_TEST_SIZE / 4; i += 1024) {
+            errors += buffer[i] != i;
+        }
+        printk(KERN_INFO, "  vmalloc(4MB) on fragmented memory at: %p", buffer);
+        printk(errors == 0 ? KERN_INFO : KERN_ERR, errors == 0 ? "  vmalloc data check passed." : "  vmalloc data check FAILED.");
+        vfree(buffer);
     } else {
-        print_string("Multiboot magic number OK.", 4, 0);
+        printk(KERN_ERR, "  vmalloc(4MB) on fragmented memory: failed");
     }
 
-    multiboot_info_t *mbi = (multiboot_info_t *)multiboot_info_addr;
+    for (uint32_t i = 1; i < held; i += 2) {
+        free_frame(stress_frames[i]);
+    }
+    printk(KERN_INFO, "--- VMALLOC TEST END ---");
+}
 
-    print_string("Multiboot info addr: ", 5, 0);
-    print_hex(multiboot_info_addr, 5, 21);
-    print_string("Flags from addr: ", 6, 0);
-    print_hex(*((uint32_t*)multiboot_info_addr), 6, 19);
+#define TIMER_TEST_US 10000
 
-    print_string("Multiboot magic: ", 7, 0);
-    print_hex(multiboot_magic, 7, 19);
-    print_string("Multiboot flags: ", 8, 0);
-    print_hex(mbi->flags, 8, 19);
+static volatile uint64_t timer_fired_at;
 
-    init_paging();
-    print_string("Paging initialized.", 9, 0);
+static void timer_test_callback(registers_t *regs, void *ctx) {
+    (void)regs;
+    (void)ctx;
+    timer_fired_at = rdtsc();
+}
 
-    init_frame_allocator(mbi);
-    print_string("Frame allocator initialized.", 10, 0);
-
-    // Test map_page
-    print_string("Testing map_page...", 11, 0);
-    uint32_t test_virtual_address = 0xC0000000; // A high virtual address
-    uint32_t test_physical_address = alloc_frame(); // Allocate a physical frame
-    if (test_physical_address == 0) {
-        print_string("Failed to allocate physical frame for map_page test.", 11, 20);
-        while(1);
+// Arm a single one-shot and measure how far from its deadline it is delivered
+static void test_timer() {
+    printk(KERN_INFO, "--- ONE-SHOT TIMER TEST START ---");
+    printk(KERN_INFO, "  Interrupt controller: %s", apic_active() ? "Local APIC + IOAPIC" : "8259 PIC");
+    printk(KERN_INFO, "  Timer source: %s", timer_mode_name());
+    printk(KERN_INFO, "  TSC cycles per us: %u", timer_tsc_per_us());
+
+    timer_fired_at = 0;
+    timer_set_callback(timer_test_callback, 0);
+    uint64_t deadline = rdtsc() + (uint64_t)TIMER_TEST_US * timer_tsc_per_us();
+    timer_arm(TIMER_TEST_US);
+    while (timer_fired_at == 0) {
+        // sti only takes effect after the next instruction, so the wakeup cannot be missed
+        __asm__ __volatile__ ("sti\n\thlt\n\tcli");
     }
-    print_string("Allocated physical frame for map_page test at: ", 12, 0);
-    print_hex(test_physical_address, 12, 50);
-
-    map_page(test_virtual_address, test_physical_address);
-    print_string("map_page called.", 13, 0);
-
-    // Try to write to the mapped virtual address
-    print_string("Writing to mapped address...", 14, 0);
-    char *test_ptr_v = (char *)test_virtual_address;
-    *test_ptr_v = 'A';
-    *(test_ptr_v + 1) = 'B';
-    *(test_ptr_v + 2) = 'C';
-    *(test_ptr_v + 3) = 'D';
-    print_string("Write complete.", 14, 29);
-
-    // Test kmalloc and kfree
-    print_string("--- KMALLOC/KFREE TESTS START ---", 16, 0);
-
-    // Test 1: Allocate a small block
-    void *ptr1 = kmalloc(100);
-    if (ptr1 != 0) {
-        print_string("Allocated 100 bytes at: ", 12, 0);
-        print_hex((uint32_t)ptr1, 12, 25);
-        kfree(ptr1);
-        print_string("Freed 100 bytes. ", 13, 0);
+    timer_set_callback(0, 0);
+
+    int late_cycles = (int)(uint32_t)(timer_fired_at - deadline);
+    printk(KERN_INFO, "  10ms one-shot delivered (us after deadline): %d", late_cycles / (int)timer_tsc_per_us());
+    printk(KERN_INFO, "--- ONE-SHOT TIMER TEST END ---");
+}
+
+static volatile uint64_t deferred_irq_at;
+static volatile uint64_t deferred_ran_at;
+static volatile uint32_t deferred_ran_eflags;
+static volatile uint32_t deferred_counter;
+
+static void deferred_test_work(void *ctx) {
+    (void)ctx;
+    uint32_t eflags;
+    __asm__ __volatile__ ("pushf\n\tpop %0" : "=r" (eflags));
+    deferred_ran_eflags = eflags;
+    deferred_ran_at = rdtsc();
+}
+
+static void deferred_count_work(void *ctx) {
+    (void)ctx;
+    deferred_counter++;
+}
+
+// Hard-IRQ half: only timestamp and queue the rest
+static void deferred_test_callback(registers_t *regs, void *ctx) {
+    (void)regs;
+    (void)ctx;
+    deferred_irq_at = rdtsc();
+    defer_work(deferred_test_work, 0);
+}
+
+// Queue work from the timer interrupt and check it runs on IRQ exit with interrupts enabled
+static void test_deferred_work() {
+    printk(KERN_INFO, "--- DEFERRED WORK TEST START ---");
+
+    deferred_ran_at = 0;
+    timer_set_callback(deferred_test_callback, 0);
+    timer_arm(1000);
+    while (deferred_ran_at == 0) {
+        __asm__ __volatile__ ("sti\n\thlt\n\tcli");
+    }
+    timer_set_callback(0, 0);
+    printk((deferred_ran_eflags & 0x200) ? KERN_INFO : KERN_ERR,
+           "  Work queued by the timer IRQ ran with interrupts %s.",
+           (deferred_ran_eflags & 0x200) ? "enabled" : "DISABLED");
+    printk(KERN_INFO, "  IRQ to deferred work latency (cycles): %u", (uint32_t)(deferred_ran_at - deferred_irq_at));
+
+    // Fill the ring, check the overflow is refused, then drain it in budgeted passes
+    deferred_counter = 0;
+    uint32_t accepted = 0;
+    for (int i = 0; i <= DEFERRED_RING_SIZE; i++) {
+        accepted += defer_work(deferred_count_work, 0) == 0;
+    }
+    uint32_t passes = 0;
+    while (deferred_work_pending()) {
+        run_deferred_work(DEFERRED_IRQ_EXIT_BUDGET);
+        passes++;
+    }
+    if (accepted == DEFERRED_RING_SIZE && deferred_counter == DEFERRED_RING_SIZE) {
+        printk(KERN_INFO, "  Full ring refused the extra item; all queued items ran.");
     } else {
-        print_string("Failed to allocate 100 bytes.", 12, 0);
+        printk(KERN_ERR, "  Ring overflow check FAILED.");
     }
+    printk(KERN_INFO, "  Drain passes at budget 8: %u", passes);
+    printk(KERN_INFO, "--- DEFERRED WORK TEST END ---");
+}
 
-    // Test 2: Allocate a larger block
-    void *ptr2 = kmalloc(4096 * 2); // 2 pages
-    if (ptr2 != 0) {
-        print_string("Allocated 8192 bytes (2 pages) at: ", 15, 0);
-        print_hex((uint32_t)ptr2, 15, 37);
-        kfree(ptr2);
-        print_string("Freed 8192 bytes. ", 16, 0);
+#define SERIAL_TEST_LINES 16
+
+// Time the same log lines written by polling the UART and through the interrupt-driven ring
+static void test_serial() {
+    const char *line = "serial throughput test line ........................................";
+    printk(KERN_INFO, "--- SERIAL TEST START ---");
+
+    serial_set_sync(1);
+    uint64_t start = rdtsc();
+    for (int i = 0; i < SERIAL_TEST_LINES; i++) {
+        serial_write_string(line);
+        serial_write('\n');
+    }
+    uint32_t polled_cycles = (uint32_t)(rdtsc() - start);
+    serial_set_sync(0);
+
+    start = rdtsc();
+    for (int i = 0; i < SERIAL_TEST_LINES; i++) {
+        serial_write_string(line);
+        serial_write('\n');
+    }
+    uint32_t buffered_cycles = (uint32_t)(rdtsc() - start);
+
+    printk(KERN_INFO, "  Cycles per line, polled: %u", polled_cycles / SERIAL_TEST_LINES);
+    printk(KERN_INFO, "  Cycles per line, buffered: %u", buffered_cycles / SERIAL_TEST_LINES);
+    printk(KERN_INFO, "  TX interrupts so far: %u", serial_stats().tx_interrupts);
+    printk(KERN_INFO, "--- SERIAL TEST END ---");
+}
+
+#define PRINTK_BENCH_MESSAGES 64
+
+// Cost of a printk() to the caller, now that consoles are fed later from deferred work
+static void bench_printk() {
+    printk(KERN_INFO, "--- PRINTK BENCH START ---");
+    uint64_t start = rdtsc();
+    for (int i = 0; i < PRINTK_BENCH_MESSAGES; i++) {
+        printk(KERN_DEBUG, "printk bench message %d of %d, value 0x%08x", i, PRINTK_BENCH_MESSAGES, i * 0x1001);
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    printk(KERN_INFO, "  Cycles per printk (debug level, not shown): %u", cycles / PRINTK_BENCH_MESSAGES);
+    printk(KERN_INFO, "--- PRINTK BENCH END ---");
+}
+
+#define STRING_BENCH_MAX   (1024 * 1024)
+#define STRING_BENCH_TOTAL (2 * 1024 * 1024) // Bytes moved per size and routine
+
+static void byte_loop_copy(uint8_t *dest, const uint8_t *src, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        dest[i] = src[i];
+    }
+}
+
+// Throughput in MB/s (bytes per microsecond)
+static uint32_t mb_per_s(uint32_t bytes, uint32_t cycles) {
+    return cycles == 0 ? 0 : udiv64_32((uint64_t)bytes * timer_tsc_per_us(), cycles);
+}
+
+// memcpy/memset throughput from 64B to 1MB, with a plain byte loop as the baseline
+static void bench_string_lib() {
+    printk(KERN_INFO, "--- MEMCPY/MEMSET BENCH START (%s) ---", string_lib_variant());
+    uint32_t frames = STRING_BENCH_MAX / 4096;
+    uint8_t *src = (uint8_t *)alloc_frames(frames, 0);
+    uint8_t *dest = (uint8_t *)alloc_frames(frames, 0);
+    if (src == 0 || dest == 0) {
+        printk(KERN_ERR, "  Could not allocate 2 x 1MB, skipped.");
     } else {
-        print_string("Failed to allocate 8192 bytes.", 15, 0);
+        memset(src, 0x5A, STRING_BENCH_MAX);
+        for (uint32_t size = 64; size <= STRING_BENCH_MAX; size *= 4) {
+            uint32_t rounds = STRING_BENCH_TOTAL / size;
+            uint64_t start = rdtsc();
+            for (uint32_t i = 0; i < rounds; i++) {
+                memcpy(dest, src, size);
+            }
+            uint32_t copy_cycles = (uint32_t)(rdtsc() - start);
+            start = rdtsc();
+            for (uint32_t i = 0; i < rounds; i++) {
+                memset(dest, i, size);
+            }
+            uint32_t set_cycles = (uint32_t)(rdtsc() - start);
+            start = rdtsc();
+            for (uint32_t i = 0; i < rounds; i++) {
+                byte_loop_copy(dest, src, size);
+            }
+            uint32_t loop_cycles = (uint32_t)(rdtsc() - start);
+            printk(KERN_INFO, "  %7u B  memcpy %5u MB/s  memset %5u MB/s  byte loop %5u MB/s", size,
+                   mb_per_s(STRING_BENCH_TOTAL, copy_cycles), mb_per_s(STRING_BENCH_TOTAL, set_cycles),
+                   mb_per_s(STRING_BENCH_TOTAL, loop_cycles));
+        }
+        printk(memcmp(dest, src, STRING_BENCH_MAX) == 0 ? KERN_INFO : KERN_ERR,
+               memcmp(dest, src, STRING_BENCH_MAX) == 0 ? "  Data check passed." : "  Data check FAILED.");
+    }
+    if (src != 0) {
+        free_frames((uint32_t)src, frames);
     }
+    if (dest != 0) {
+        free_frames((uint32_t)dest, frames);
+    }
+    printk(KERN_INFO, "--- MEMCPY/MEMSET BENCH END ---");
+}
 
-    // Test 3: Allocate multiple blocks
-    void *ptrs[5];
-    print_string("Allocating 5 x 512 bytes: ", 18, 0);
-    for (int i = 0; i < 5; i++) {
-        ptrs[i] = kmalloc(512);
-        if (ptrs[i] != 0) {
-            print_string("  ptr[", 19 + i, 0);
-            char num_str[5];
-            itoa(i, num_str);
-            print_string(num_str, 19 + i, 6);
-            print_string("] at: ", 19 + i, 8);
-            print_hex((uint32_t)ptrs[i], 19 + i, 15);
+#define SMP_BENCH_ROUNDS 2000
+#define SMP_BENCH_BATCH  16
+
+static volatile uint32_t smp_bench_ready;
+static volatile int smp_bench_go;
+static volatile uint32_t smp_bench_done;
+
+static void smp_alloc_free_rounds() {
+    uint32_t frames[SMP_BENCH_BATCH];
+    for (uint32_t round = 0; round < SMP_BENCH_ROUNDS; round++) {
+        for (uint32_t i = 0; i < SMP_BENCH_BATCH; i++) {
+            frames[i] = alloc_frame();
+        }
+        for (uint32_t i = 0; i < SMP_BENCH_BATCH; i++) {
+            if (frames[i] != 0) {
+                free_frame(frames[i]);
+            }
+        }
+    }
+}
+
+static void smp_bench_worker(void *ctx) {
+    __atomic_fetch_add(&smp_bench_ready, 1, __ATOMIC_SEQ_CST);
+    while (!smp_bench_go) {
+        __asm__ __volatile__ ("pause");
+    }
+    smp_alloc_free_rounds();
+    __atomic_fetch_add(&smp_bench_done, 1, __ATOMIC_SEQ_CST);
+}
+
+// The same alloc/free rounds on CPUs 0 to cpus - 1 at once; TSC cycles until all finish
+static uint32_t run_parallel_frames(uint32_t cpus) {
+    smp_bench_ready = 0;
+    smp_bench_done = 0;
+    smp_bench_go = 0;
+    for (uint32_t i = 1; i < cpus; i++) {
+        work_queue_on(i, smp_bench_worker, 0);
+    }
+    while (smp_bench_ready < cpus - 1) {
+        __asm__ __volatile__ ("pause");
+    }
+    uint64_t start = rdtsc();
+    smp_bench_go = 1;
+    smp_alloc_free_rounds();
+    while (smp_bench_done < cpus - 1) {
+        __asm__ __volatile__ ("pause");
+    }
+    return (uint32_t)(rdtsc() - start);
+}
+
+// Frame alloc/free throughput against the number of CPUs, through the per-CPU caches
+// and with every call going to the locked backend
+static void bench_smp_frames() {
+    printk(KERN_INFO, "--- PARALLEL FRAME ALLOC BENCH START ---");
+    printk(KERN_INFO, "  CPUs online: %u, %u alloc/free pairs per CPU", smp_cpu_count(),
+           SMP_BENCH_ROUNDS * SMP_BENCH_BATCH);
+    for (int cached = 1; cached >= 0; cached--) {
+        frame_cache_set_enabled(cached);
+        uint32_t single_rate = 0;
+        for (uint32_t cpus = 1; cpus <= smp_cpu_count(); cpus++) {
+            uint32_t us = run_parallel_frames(cpus) / timer_tsc_per_us();
+            uint32_t ops = cpus * SMP_BENCH_ROUNDS * SMP_BENCH_BATCH * 2;
+            uint32_t ops_per_ms = us ? udiv64_32((uint64_t)ops * 1000, us) : 0;
+            if (cpus == 1) {
+                single_rate = ops_per_ms;
+            }
+            printk(KERN_INFO, "  %s, %u CPUs: %u ops/ms (x%u.%u)", cached ? "per-CPU caches" : "global lock",
+                   cpus, ops_per_ms, single_rate ? ops_per_ms / single_rate : 0,
+                   single_rate ? ops_per_ms * 10 / single_rate % 10 : 0);
+        }
+    }
+    frame_cache_set_enabled(1);
+    printk(KERN_INFO, "--- PARALLEL FRAME ALLOC BENCH END ---");
+}
+
+// Ring 3 probe of the system call paths (src/kernel/syscall/user_probe.asm): its code
+// page and a stack page whose top holds the block it reads and fills in
+#define USER_PROBE_CODE  USER_SPACE_START
+#define USER_PROBE_STACK (USER_SPACE_START + 0x10000)
+#define SYSCALL_BENCH_ITERATIONS 10000
+
+// Layout shared with user_probe.asm
+typedef struct {
+    uint32_t iterations;
+    uint32_t int80_tid;
+    uint32_t sysenter_tid;
+    uint32_t clobbered;
+    uint32_t int80_cycles;
+    uint32_t sysenter_cycles;
+    uint32_t use_sysenter;
+} user_probe_t;
+
+extern uint8_t user_probe_start[];
+extern uint8_t user_probe_end[];
+
+static uint32_t user_probe_tid;
+
+static void user_probe_thread(void *arg) {
+    user_probe_tid = thread_current()->id;
+    user_enter(USER_PROBE_CODE, USER_PROBE_STACK + 4096 - sizeof(user_probe_t));
+}
+
+// Run the probe on a thread of its own and copy out its block. The thread outranks
+// kmain, so it has made its SYS_EXIT by the time thread_create() returns. Returns -1
+// if the pages could not be set up.
+static int run_user_probe(uint32_t iterations, user_probe_t *result) {
+    uint32_t code = alloc_frame();
+    uint32_t stack = alloc_frame();
+    int status = -1;
+    if (code != 0 && stack != 0 &&
+        map_range(USER_PROBE_CODE, code, 4096, PAGE_USER) == 0 &&
+        map_range(USER_PROBE_STACK, stack, 4096, PAGE_USER | PAGE_RW) == 0) {
+        // Filled in through the direct map; the program sees the same frames up high
+        memcpy((void *)code, user_probe_start, user_probe_end - user_probe_start);
+        user_probe_t *block = (user_probe_t *)(stack + 4096 - sizeof(user_probe_t));
+        memset(block, 0, sizeof(user_probe_t));
+        block->iterations = iterations;
+        block->use_sysenter = syscall_sysenter_supported();
+        if (thread_create("user_probe", user_probe_thread, 0, SCHED_DEFAULT_PRIORITY - 1) != 0) {
+            *result = *block;
+            status = 0;
+        }
+    }
+    unmap_range(USER_PROBE_CODE, 4096);
+    unmap_range(USER_PROBE_STACK, 4096);
+    if (code != 0) {
+        free_frame(code);
+    }
+    if (stack != 0) {
+        free_frame(stack);
+    }
+    return status;
+}
+
+// Null system call round trips from ring 3 through both entry paths
+static void bench_syscalls() {
+    printk(KERN_INFO, "--- SYSTEM CALL BENCH START ---");
+    user_probe_t probe;
+    if (run_user_probe(SYSCALL_BENCH_ITERATIONS, &probe) != 0) {
+        printk(KERN_WARNING, "  No memory for the user probe");
+    } else {
+        printk(KERN_INFO, "  int 0x80 null call: %u cycles", probe.int80_cycles / SYSCALL_BENCH_ITERATIONS);
+        if (probe.use_sysenter) {
+            printk(KERN_INFO, "  SYSENTER null call: %u cycles", probe.sysenter_cycles / SYSCALL_BENCH_ITERATIONS);
         } else {
-            print_string("  Failed to allocate ptr[", 19 + i, 0);
-            char num_str[5];
-            itoa(i, num_str);
-            print_string(num_str, 19 + i, 26);
-            print_string("].", 19 + i, 27);
+            printk(KERN_INFO, "  SYSENTER not supported");
+        }
+    }
+    printk(KERN_INFO, "--- SYSTEM CALL BENCH END ---");
+}
+
+#define BCACHE_SCRATCH_BLOCKS  2048 // 2MB ramdisk for the buffer cache tests and benchmarks
+#define BCACHE_BENCH_DELAY_US  20   // Modelled per-request device cost
+#define BCACHE_BENCH_RANDOM    2048 // Random reads per run
+
+static uint8_t *scratch_base;
+static block_device_t *scratch_disk;
+
+// The scratch ramdisk, made on first use, with each block's first word set to its number
+static block_device_t *bcache_scratch_disk() {
+    if (scratch_disk == 0) {
+        scratch_base = (uint8_t *)alloc_frames(BCACHE_SCRATCH_BLOCKS * BLOCK_SIZE / 4096, 0);
+        if (scratch_base == 0) {
+            return 0;
+        }
+        scratch_disk = ramdisk_create("scratch", (uint32_t)scratch_base, BCACHE_SCRATCH_BLOCKS * BLOCK_SIZE);
+        if (scratch_disk == 0) {
+            return 0;
         }
     }
+    for (uint32_t block = 0; block < BCACHE_SCRATCH_BLOCKS; block++) {
+        *(uint32_t *)(scratch_base + block * BLOCK_SIZE) = block;
+    }
+    return scratch_disk;
+}
+
+static uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Sequential and random reads through the cache, with and without read-ahead, from a
+// ramdisk as it is and with a modelled per-request cost
+static void bench_buffer_cache() {
+    printk(KERN_INFO, "--- BUFFER CACHE BENCH START (%u buffers) ---", BCACHE_DEFAULT_BUFFERS);
+    block_device_t *dev = bcache_scratch_disk();
+    if (dev == 0) {
+        printk(KERN_ERR, "  Could not allocate the scratch ramdisk, skipped.");
+        printk(KERN_INFO, "--- BUFFER CACHE BENCH END ---");
+        return;
+    }
+    uint32_t errors = 0;
+    for (uint32_t delay = 0; delay <= BCACHE_BENCH_DELAY_US; delay += BCACHE_BENCH_DELAY_US) {
+        ramdisk_set_request_delay(dev, delay);
+        for (uint32_t readahead = 0; readahead <= BCACHE_DEFAULT_READAHEAD; readahead += BCACHE_DEFAULT_READAHEAD) {
+            init_buffer_cache(BCACHE_DEFAULT_BUFFERS, readahead);
+            bcache_invalidate(dev);
+            uint32_t requests = dev->stats.reads;
+            uint64_t start = rdtsc();
+            for (uint32_t block = 0; block < BCACHE_SCRATCH_BLOCKS; block++) {
+                buffer_t *buf = bread(dev, block);
+                if (buf == 0 || *(uint32_t *)buf->data != block) {
+                    errors++;
+                }
+                if (buf != 0) {
+                    brelse(buf);
+                }
+            }
+            uint32_t sequential_cycles = (uint32_t)(rdtsc() - start);
+            requests = dev->stats.reads - requests;
+
+            bcache_stats_t before = bcache_stats();
+            uint32_t seed = 0x2545F491;
+            start = rdtsc();
+            for (uint32_t i = 0; i < BCACHE_BENCH_RANDOM; i++) {
+                uint32_t block = xorshift32(&seed) % BCACHE_SCRATCH_BLOCKS;
+                buffer_t *buf = bread(dev, block);
+                if (buf == 0 || *(uint32_t *)buf->data != block) {
+                    errors++;
+                }
+                if (buf != 0) {
+                    brelse(buf);
+                }
+            }
+            uint32_t random_cycles = (uint32_t)(rdtsc() - start);
+            bcache_stats_t after = bcache_stats();
+            printk(KERN_INFO, "  %2u us/request, read-ahead %u: sequential %5u MB/s (%4u requests), random %5u MB/s (%2u%% hits)",
+                   delay, readahead,
+                   mb_per_s(BCACHE_SCRATCH_BLOCKS * BLOCK_SIZE, sequential_cycles), requests,
+                   mb_per_s(BCACHE_BENCH_RANDOM * BLOCK_SIZE, random_cycles),
+                   (after.hits - before.hits) * 100 / BCACHE_BENCH_RANDOM);
+        }
+    }
+    ramdisk_set_request_delay(dev, 0);
+    init_buffer_cache(BCACHE_DEFAULT_BUFFERS, BCACHE_DEFAULT_READAHEAD);
+    printk(errors == 0 ? KERN_INFO : KERN_ERR, errors == 0 ? "  Data check passed." : "  Data check FAILED.");
+    printk(KERN_INFO, "--- BUFFER CACHE BENCH END ---");
+}
+
+#define KTEST_MAP_ADDRESS 0xC0000000 // A high virtual address outside the direct map
+
+static int test_map_page() {
+    uint32_t physical = alloc_frame();
+    KTEST_ASSERT(physical != 0);
+    map_page(KTEST_MAP_ADDRESS, physical);
+    KTEST_ASSERT(get_physical_address(KTEST_MAP_ADDRESS + 0x123) == physical + 0x123);
 
-    print_string("Freeing multiple blocks: ", 25, 0);
+    // The write through the new mapping must land in the frame (seen via the direct map)
+    char *virtual = (char *)KTEST_MAP_ADDRESS;
+    virtual[0] = 'A';
+    virtual[1] = 'B';
+    virtual[2] = 'C';
+    virtual[3] = 'D';
+    KTEST_ASSERT(memcmp((void *)physical, "ABCD", 4) == 0);
+
+    unmap_page(KTEST_MAP_ADDRESS);
+    KTEST_ASSERT(get_physical_address(KTEST_MAP_ADDRESS) == 0);
+    free_frame(physical);
+    return 0;
+}
+
+static int test_kmalloc_small() {
+    uint32_t free_before = frame_allocator_free_count();
+    void *ptr = kmalloc(100);
+    KTEST_ASSERT(ptr != 0);
+    memset(ptr, 0xAA, 100);
+    kfree(ptr);
+    KTEST_ASSERT(frame_allocator_free_count() == free_before);
+    return 0;
+}
+
+static int test_kmalloc_pages() {
+    void *ptr = kmalloc(4096 * 2);
+    KTEST_ASSERT(ptr != 0);
+    memset(ptr, 0x55, 4096 * 2);
+    kfree(ptr);
+    return 0;
+}
+
+static int test_kmalloc_distinct() {
+    void *ptrs[5];
     for (int i = 0; i < 5; i++) {
-        if (ptrs[i] != 0) {
-            kfree(ptrs[i]);
-            print_string("  Freed ptr[", 26 + i, 0);
-            char num_str[5];
-            itoa(i, num_str);
-            print_string(num_str, 26 + i, 11);
-            print_string("].", 26 + i, 12);
+        ptrs[i] = kmalloc(512);
+        KTEST_ASSERT(ptrs[i] != 0);
+        for (int j = 0; j < i; j++) {
+            KTEST_ASSERT(ptrs[i] != ptrs[j]);
         }
     }
+    for (int i = 0; i < 5; i++) {
+        kfree(ptrs[i]);
+    }
+    return 0;
+}
 
-    // Test 4: Test for allocation failure (requesting more memory than available)
-    print_string("Testing large allocation failure...", 32, 0);
-    void *large_ptr = kmalloc(0xFFFFFFFF); // Request a very large amount
-    if (large_ptr == 0) {
-        print_string("Large allocation failed as expected.", 33, 0);
-    } else {
-        print_string("Large allocation succeeded unexpectedly at: ", 33, 0);
-        print_hex((uint32_t)large_ptr, 33, 45);
-        kfree(large_ptr);
+static int test_kmalloc_too_large() {
+    void *ptr = kmalloc(0xFFFFFFFF);
+    if (ptr != 0) {
+        kfree(ptr);
     }
+    KTEST_ASSERT(ptr == 0);
+    return 0;
+}
+
+// Small objects from a dedicated slab cache share pages
+static int test_slab_packing() {
+    kmem_cache_t *cache = kmem_cache_create("test-64", 64, 16);
+    KTEST_ASSERT(cache != 0);
+    void *obj1 = kmem_cache_alloc(cache);
+    void *obj2 = kmem_cache_alloc(cache);
+    int same_page = obj1 != 0 && obj2 != 0 && ((uint32_t)obj1 >> 12) == ((uint32_t)obj2 >> 12);
+    int owner = kmem_cache_of(obj1) == cache;
+    kmem_cache_free(cache, obj1);
+    kmem_cache_free(cache, obj2);
+    kmem_cache_destroy(cache);
+    KTEST_ASSERT(same_page);
+    KTEST_ASSERT(owner);
+    return 0;
+}
+
+#define SLAB_TEST_OBJECTS 15
+
+// 2KB objects share multi-page slabs, and page-sized, page-aligned ones have a cache
+static int test_slab_large_objects() {
+    void *objects[SLAB_TEST_OBJECTS];
+    uint32_t free_before = frame_allocator_free_count();
+    for (int i = 0; i < SLAB_TEST_OBJECTS; i++) {
+        objects[i] = kmalloc(2048);
+    }
+    uint32_t frames_used = free_before - frame_allocator_free_count();
+    int owned = 1;
+    for (int i = 0; i < SLAB_TEST_OBJECTS; i++) {
+        owned = owned && objects[i] != 0 && kmem_cache_of(objects[i]) == kmem_cache_of(objects[0]);
+        kfree(objects[i]);
+    }
+    KTEST_ASSERT(owned);
+    KTEST_ASSERT(frames_used <= SLAB_LARGE_PAGES); // One page per object before
+
+    kmem_cache_t *cache = kmem_cache_create("test-4096", 4096, 4096);
+    KTEST_ASSERT(cache != 0);
+    void *page1 = kmem_cache_alloc(cache);
+    void *page2 = kmem_cache_alloc(cache);
+    int aligned = page1 != 0 && page2 != 0 && ((uint32_t)page1 & 0xFFF) == 0 && ((uint32_t)page2 & 0xFFF) == 0;
+    int owner = kmem_cache_of(page1) == cache && page1 != page2;
+    kmem_cache_free(cache, page1);
+    kmem_cache_free(cache, page2);
+    kmem_cache_destroy(cache);
+    KTEST_ASSERT(aligned);
+    KTEST_ASSERT(owner);
+    return 0;
+}
+
+#define SCHED_TEST_THREADS 3
+#define SCHED_TEST_ROUNDS  3
 
-    print_string("--- KMALLOC/KFREE TESTS END ---", 35, 0);
+static volatile uint32_t sched_order[SCHED_TEST_THREADS * SCHED_TEST_ROUNDS];
+static volatile uint32_t sched_order_count;
+static volatile uint32_t sched_threads_done;
 
-    // Re-enable interrupts
+static void sched_round_robin_thread(void *arg) {
+    for (int round = 0; round < SCHED_TEST_ROUNDS; round++) {
+        sched_order[sched_order_count++] = (uint32_t)arg;
+        sched_yield();
+    }
+    sched_threads_done++;
+}
+
+// Threads of one priority take turns in creation order
+static int test_sched_round_robin() {
+    sched_order_count = 0;
+    sched_threads_done = 0;
+    for (uint32_t i = 0; i < SCHED_TEST_THREADS; i++) {
+        KTEST_ASSERT(thread_create("rr", sched_round_robin_thread, (void *)i, SCHED_DEFAULT_PRIORITY) != 0);
+    }
+    while (sched_threads_done < SCHED_TEST_THREADS) {
+        sched_yield();
+    }
+    KTEST_ASSERT(sched_order_count == SCHED_TEST_THREADS * SCHED_TEST_ROUNDS);
+    for (uint32_t i = 0; i < sched_order_count; i++) {
+        KTEST_ASSERT(sched_order[i] == i % SCHED_TEST_THREADS);
+    }
+    return 0;
+}
+
+static volatile uint32_t sched_flag;
+
+static void sched_set_flag_thread(void *arg) {
+    sched_flag = 1;
+}
+
+static void sched_block_thread(void *arg) {
+    thread_block();
+    sched_flag = 2;
+}
+
+// A higher-priority thread runs before thread_create()/thread_wake() return
+static int test_sched_priority() {
+    sched_flag = 0;
+    KTEST_ASSERT(thread_create("high", sched_set_flag_thread, 0, SCHED_DEFAULT_PRIORITY - 1) != 0);
+    KTEST_ASSERT(sched_flag == 1);
+
+    // A lower-priority one only runs once nothing outranks it, not when the caller yields
+    sched_flag = 0;
+    KTEST_ASSERT(thread_create("low", sched_set_flag_thread, 0, SCHED_DEFAULT_PRIORITY + 1) != 0);
+    sched_yield();
+    KTEST_ASSERT(sched_flag == 0);
+    sched_set_priority(0, SCHED_DEFAULT_PRIORITY + 2);
+    KTEST_ASSERT(sched_flag == 1);
+    sched_set_priority(0, SCHED_DEFAULT_PRIORITY);
+
+    sched_flag = 0;
+    thread_t *sleeper = thread_create("sleeper", sched_block_thread, 0, SCHED_DEFAULT_PRIORITY - 1);
+    KTEST_ASSERT(sleeper != 0);
+    KTEST_ASSERT(sched_flag == 0 && sleeper->state == THREAD_BLOCKED);
+    thread_wake(sleeper);
+    KTEST_ASSERT(sched_flag == 2);
+    return 0;
+}
+
+static volatile uint32_t spinner_count;
+static volatile int spinner_stop;
+
+static void sched_spinner_thread(void *arg) {
+    while (!spinner_stop) {
+        spinner_count++;
+    }
+    sched_threads_done++;
+}
+
+// A thread that never yields still loses the CPU when its time slice runs out
+static int test_sched_preempt() {
+    spinner_count = 0;
+    spinner_stop = 0;
+    sched_threads_done = 0;
+    uint32_t preemptions = sched_stats().preemptions;
+    uint32_t flags = irq_save();
     __asm__ __volatile__ ("sti");
-    print_string("Interrupts re-enabled.", 31, 0);
+    KTEST_ASSERT(thread_create("spinner", sched_spinner_thread, 0, SCHED_DEFAULT_PRIORITY) != 0);
+    while (spinner_count == 0) {
+        // Busy too: only the slice timer can hand the CPU over
+    }
+    spinner_stop = 1;
+    while (sched_threads_done == 0) {
+        sched_yield();
+    }
+    irq_restore(flags);
+    KTEST_ASSERT(sched_stats().preemptions > preemptions);
+    return 0;
+}
+
+#define SMP_TEST_TIMEOUT_US 1000000
+
+// Wait for a counter other CPUs bump to reach target; -1 on timeout
+static int wait_for_count(volatile uint32_t *counter, uint32_t target) {
+    uint64_t deadline = rdtsc() + (uint64_t)SMP_TEST_TIMEOUT_US * timer_tsc_per_us();
+    while (__atomic_load_n(counter, __ATOMIC_ACQUIRE) < target) {
+        if (rdtsc() > deadline) {
+            return -1;
+        }
+        __asm__ __volatile__ ("pause");
+    }
+    return 0;
+}
+
+static volatile uint32_t smp_seen_ids[SMP_MAX_CPUS];
+static volatile uint32_t smp_seen_apic_ids[SMP_MAX_CPUS];
+static volatile uint32_t smp_jobs_done;
+
+static void smp_report_cpu(void *arg) {
+    uint32_t slot = (uint32_t)arg;
+    smp_seen_ids[slot] = this_cpu()->id;
+    smp_seen_apic_ids[slot] = lapic_id();
+    __atomic_fetch_add(&smp_jobs_done, 1, __ATOMIC_RELEASE);
+}
+
+// Work queued on a CPU runs there and sees that CPU's own per-CPU area
+static int test_smp_percpu() {
+    KTEST_ASSERT(this_cpu()->id == 0 && this_cpu()->self == smp_cpu(0));
+    smp_jobs_done = 0;
+    for (uint32_t i = 1; i < smp_cpu_count(); i++) {
+        KTEST_ASSERT(work_queue_on(i, smp_report_cpu, (void *)i) == 0);
+    }
+    KTEST_ASSERT(wait_for_count(&smp_jobs_done, smp_cpu_count() - 1) == 0);
+    for (uint32_t i = 1; i < smp_cpu_count(); i++) {
+        KTEST_ASSERT(smp_seen_ids[i] == i);
+        KTEST_ASSERT(smp_seen_apic_ids[i] == smp_cpu(i)->apic_id);
+    }
+    return 0;
+}
+
+#define SPINLOCK_TEST_INCREMENTS 20000
+
+static spinlock_t test_lock = SPINLOCK_INIT;
+static volatile uint32_t locked_counter;
+
+static void smp_locked_increments(void *arg) {
+    for (uint32_t i = 0; i < SPINLOCK_TEST_INCREMENTS; i++) {
+        uint32_t flags = spin_lock_irqsave(&test_lock);
+        locked_counter = locked_counter + 1; // Not atomic: only the lock keeps updates whole
+        spin_unlock_irqrestore(&test_lock, flags);
+    }
+    __atomic_fetch_add(&smp_jobs_done, 1, __ATOMIC_RELEASE);
+}
+
+// Every CPU increments one counter under the ticket lock and no update is lost
+static int test_smp_spinlock() {
+    locked_counter = 0;
+    smp_jobs_done = 0;
+    for (uint32_t i = 1; i < smp_cpu_count(); i++) {
+        KTEST_ASSERT(work_queue_on(i, smp_locked_increments, 0) == 0);
+    }
+    smp_locked_increments(0);
+    KTEST_ASSERT(wait_for_count(&smp_jobs_done, smp_cpu_count()) == 0);
+    KTEST_ASSERT(locked_counter == smp_cpu_count() * SPINLOCK_TEST_INCREMENTS);
+    KTEST_ASSERT(spin_trylock(&test_lock));
+    KTEST_ASSERT(!spin_trylock(&test_lock));
+    spin_unlock(&test_lock);
+    return 0;
+}
+
+#define STEAL_TEST_ITEMS 64
+
+static void smp_count_item(void *arg) {
+    for (volatile uint32_t spin = 0; spin < 2000; spin++) {
+        // Long enough for the woken CPUs to reach the queue
+    }
+    __atomic_fetch_add(&smp_jobs_done, 1, __ATOMIC_RELEASE);
+}
+
+// Items queued on the boot CPU, which does not run them, are stolen by the others
+static int test_smp_work_steal() {
+    smp_jobs_done = 0;
+    uint32_t stolen_before = 0;
+    for (uint32_t i = 1; i < smp_cpu_count(); i++) {
+        stolen_before += work_stats(i).stolen;
+    }
+    for (uint32_t i = 0; i < STEAL_TEST_ITEMS; i++) {
+        KTEST_ASSERT(work_queue_on(0, smp_count_item, 0) == 0);
+    }
+    if (smp_cpu_count() == 1) {
+        while (work_run_one()) {
+            // Nobody to steal: run them here
+        }
+    }
+    KTEST_ASSERT(wait_for_count(&smp_jobs_done, STEAL_TEST_ITEMS) == 0);
+    uint32_t stolen = 0;
+    for (uint32_t i = 1; i < smp_cpu_count(); i++) {
+        stolen += work_stats(i).stolen;
+    }
+    KTEST_ASSERT(smp_cpu_count() == 1 || stolen - stolen_before == STEAL_TEST_ITEMS);
+    return 0;
+}
+
+// Both entry paths reach the table from ring 3 and keep the registers they promise to
+static int test_syscall_entry() {
+    KTEST_ASSERT(syscall_dispatch(SYSCALL_MAX, 0, 0, 0, 0) == SYSCALL_ENOSYS);
+    syscall_stats_t before = syscall_stats();
+    user_probe_t probe;
+    KTEST_ASSERT(run_user_probe(16, &probe) == 0);
+    syscall_stats_t after = syscall_stats();
+    KTEST_ASSERT(probe.int80_tid == user_probe_tid);
+    KTEST_ASSERT(probe.clobbered == 0);
+    KTEST_ASSERT(after.int80 - before.int80 == 16 + 2); // Null calls, SYS_GETTID and SYS_EXIT
+    if (probe.use_sysenter) {
+        KTEST_ASSERT(probe.sysenter_tid == user_probe_tid);
+        KTEST_ASSERT(after.sysenter - before.sysenter == 16 + 1);
+    }
+    return 0;
+}
+
+#define SYSCALL_TEST_BUFFER (USER_SPACE_START + 0x20000)
+
+// SYS_WRITE refuses buffers ring 3 could not read itself instead of faulting on them
+static int test_syscall_bad_pointer() {
+    uint32_t frame = alloc_frame();
+    KTEST_ASSERT(frame != 0);
+    memcpy((void *)frame, "ok", 2);
+    KTEST_ASSERT(syscall_dispatch(SYS_WRITE, SYSCALL_TEST_BUFFER, 2, 0, 0) == SYSCALL_EFAULT);
+    KTEST_ASSERT(map_range(SYSCALL_TEST_BUFFER, frame, 4096, PAGE_RW) == 0); // Kernel only
+    KTEST_ASSERT(syscall_dispatch(SYS_WRITE, SYSCALL_TEST_BUFFER, 2, 0, 0) == SYSCALL_EFAULT);
+    protect_range(SYSCALL_TEST_BUFFER, 4096, PAGE_USER);
+    KTEST_ASSERT(syscall_dispatch(SYS_WRITE, SYSCALL_TEST_BUFFER, 2, 0, 0) == 2);
+    KTEST_ASSERT(syscall_dispatch(SYS_WRITE, SYSCALL_TEST_BUFFER + 4095, 2, 0, 0) == SYSCALL_EFAULT);
+    KTEST_ASSERT(syscall_dispatch(SYS_WRITE, USER_SPACE_START - 4, 2, 0, 0) == SYSCALL_EFAULT);
+    unmap_range(SYSCALL_TEST_BUFFER, 4096);
+    free_frame(frame);
+    return 0;
+}
+
+#define USER_FAULT_LAZY (USER_SPACE_START + 0x400000)
+
+static void user_fault_thread(void *arg) {
+    user_enter(USER_PROBE_CODE, USER_PROBE_CODE + 4096); // The program never pushes
+}
+
+// A ring 3 read of a lazy (kernel) region kills the thread instead of being served
+static int test_user_page_fault() {
+    uint32_t code = alloc_frame();
+    KTEST_ASSERT(code != 0);
+    uint8_t *program = (uint8_t *)code;
+    program[0] = 0xA1; // mov eax, [USER_FAULT_LAZY]
+    *(uint32_t *)(program + 1) = USER_FAULT_LAZY;
+    program[5] = 0xEB; // jmp $, never reached
+    program[6] = 0xFE;
+    KTEST_ASSERT(reserve_lazy_region(USER_FAULT_LAZY, 4096) == 0);
+    KTEST_ASSERT(map_range(USER_PROBE_CODE, code, 4096, PAGE_USER) == 0);
+    demand_paging_stats_t before = demand_paging_stats();
+    uint32_t exited = sched_stats().threads_exited;
+    thread_t *thread = thread_create("user_fault", user_fault_thread, 0, SCHED_DEFAULT_PRIORITY - 1);
+    demand_paging_stats_t after = demand_paging_stats();
+    unmap_range(USER_PROBE_CODE, 4096);
+    release_lazy_region(USER_FAULT_LAZY);
+    free_frame(code);
+    KTEST_ASSERT(thread != 0);
+    KTEST_ASSERT(after.user_faults - before.user_faults == 1);
+    KTEST_ASSERT(after.read_faults == before.read_faults && after.frames_allocated == before.frames_allocated);
+    KTEST_ASSERT(sched_stats().threads_exited - exited == 1);
+    return 0;
+}
+
+#define FPU_TEST_ROUNDS 4
+
+static volatile uint32_t fpu_test_errors;
+static uint8_t fpu_test_buffer[2][4096];
+
+// Keeps its own value in xmm0 across switches to other FPU users and kernel SIMD copies
+__attribute__((target("sse2")))
+static void fpu_pattern_thread(void *arg) {
+    uint32_t pattern = (uint32_t)arg;
+    __asm__ __volatile__ ("movd %0, %%xmm0\n\tpshufd $0, %%xmm0, %%xmm0" : : "r" (pattern) : "xmm0");
+    for (int round = 0; round < FPU_TEST_ROUNDS; round++) {
+        sched_yield();
+        uint32_t low, high;
+        __asm__ __volatile__ ("movd %%xmm0, %0\n\tpshufd $3, %%xmm0, %%xmm1\n\tmovd %%xmm1, %1"
+                              : "=r" (low), "=r" (high) : : "xmm1");
+        if (low != pattern || high != pattern) {
+            fpu_test_errors++;
+        }
+    }
+    sched_threads_done++;
+}
+
+// Two threads and kmain's memcpy share the registers; each thread's state comes back
+// through the #NM handler when it next uses them
+static int test_fpu_lazy_switch() {
+    if (!fpu_enabled()) {
+        return 0;
+    }
+    fpu_test_errors = 0;
+    sched_threads_done = 0;
+    fpu_stats_t before = fpu_stats();
+    KTEST_ASSERT(thread_create("fpu-a", fpu_pattern_thread, (void *)0x11223344, SCHED_DEFAULT_PRIORITY) != 0);
+    KTEST_ASSERT(thread_create("fpu-b", fpu_pattern_thread, (void *)0x55667788, SCHED_DEFAULT_PRIORITY) != 0);
+    while (sched_threads_done < 2) {
+        memcpy(fpu_test_buffer[0], fpu_test_buffer[1], sizeof(fpu_test_buffer[0]));
+        sched_yield();
+    }
+    fpu_stats_t after = fpu_stats();
+    KTEST_ASSERT(fpu_test_errors == 0);
+    KTEST_ASSERT(after.restores - before.restores >= 2 * FPU_TEST_ROUNDS);
+    KTEST_ASSERT(after.traps - before.traps >= 2 * FPU_TEST_ROUNDS);
+    return 0;
+}
+
+static void fpu_idle_thread(void *arg) {
+    for (int round = 0; round < FPU_TEST_ROUNDS; round++) {
+        sched_yield();
+    }
+    sched_threads_done++;
+}
+
+// Switches between threads that never touch the FPU cost no save, restore or trap
+static int test_fpu_untouched() {
+    if (!fpu_enabled()) {
+        return 0;
+    }
+    sched_threads_done = 0;
+    uint32_t switches = sched_stats().context_switches;
+    fpu_stats_t before = fpu_stats();
+    KTEST_ASSERT(thread_create("no-fpu", fpu_idle_thread, 0, SCHED_DEFAULT_PRIORITY) != 0);
+    while (sched_threads_done < 1) {
+        sched_yield();
+    }
+    fpu_stats_t after = fpu_stats();
+    KTEST_ASSERT(sched_stats().context_switches - switches >= 2 * FPU_TEST_ROUNDS);
+    KTEST_ASSERT(after.saves == before.saves && after.restores == before.restores);
+    KTEST_ASSERT(after.traps == before.traps);
+    return 0;
+}
+
+// LRU order: a block read again outlives the ones read after it
+static int test_bcache_lru() {
+    block_device_t *dev = bcache_scratch_disk();
+    KTEST_ASSERT(dev != 0);
+    KTEST_ASSERT(init_buffer_cache(8, 0) == 0);
+    bcache_stats_t before = bcache_stats();
+    for (uint32_t block = 0; block < 8; block++) {
+        buffer_t *buf = bread(dev, block);
+        KTEST_ASSERT(buf != 0 && *(uint32_t *)buf->data == block);
+        brelse(buf);
+    }
+    buffer_t *buf = bread(dev, 0);
+    KTEST_ASSERT(buf != 0);
+    brelse(buf);
+    buf = bread(dev, 100); // Evicts block 1, the least recently read
+    KTEST_ASSERT(buf != 0 && *(uint32_t *)buf->data == 100);
+    brelse(buf);
+    bcache_stats_t after = bcache_stats();
+    KTEST_ASSERT(after.misses - before.misses == 9 && after.hits - before.hits == 1);
+    KTEST_ASSERT(after.evictions - before.evictions == 1);
+    buf = bread(dev, 0);
+    KTEST_ASSERT(buf != 0);
+    brelse(buf);
+    KTEST_ASSERT(bcache_stats().hits - after.hits == 1);
+    buf = bread(dev, 1);
+    KTEST_ASSERT(buf != 0);
+    brelse(buf);
+    KTEST_ASSERT(bcache_stats().misses - after.misses == 1);
+    KTEST_ASSERT(init_buffer_cache(BCACHE_DEFAULT_BUFFERS, BCACHE_DEFAULT_READAHEAD) == 0);
+    return 0;
+}
+
+// A sequential reader misses once per read-ahead window; random reads fetch one block
+static int test_bcache_readahead() {
+    block_device_t *dev = bcache_scratch_disk();
+    KTEST_ASSERT(dev != 0);
+    KTEST_ASSERT(init_buffer_cache(8, 3) == 0);
+    bcache_invalidate(dev);
+    bcache_stats_t before = bcache_stats();
+    uint32_t requests = dev->stats.reads;
+    for (uint32_t block = 0; block < 16; block++) {
+        buffer_t *buf = bread(dev, block);
+        KTEST_ASSERT(buf != 0 && *(uint32_t *)buf->data == block);
+        brelse(buf);
+    }
+    bcache_stats_t after = bcache_stats();
+    KTEST_ASSERT(after.misses - before.misses == 4 && dev->stats.reads - requests == 4);
+    KTEST_ASSERT(after.readahead - before.readahead == 12);
+    KTEST_ASSERT(after.readahead_hits - before.readahead_hits == 12);
+    buffer_t *buf = bread(dev, 500);
+    KTEST_ASSERT(buf != 0);
+    brelse(buf);
+    buf = bread(dev, 300);
+    KTEST_ASSERT(buf != 0);
+    brelse(buf);
+    KTEST_ASSERT(bcache_stats().readahead == after.readahead);
+    KTEST_ASSERT(bread(dev, BCACHE_SCRATCH_BLOCKS) == 0);
+    KTEST_ASSERT(init_buffer_cache(BCACHE_DEFAULT_BUFFERS, BCACHE_DEFAULT_READAHEAD) == 0);
+    return 0;
+}
+
+// Dirty data reaches the device on sync or eviction, not before
+static int test_bcache_write_back() {
+    block_device_t *dev = bcache_scratch_disk();
+    KTEST_ASSERT(dev != 0);
+    KTEST_ASSERT(init_buffer_cache(8, 0) == 0);
+    uint32_t *on_disk = (uint32_t *)(scratch_base + 7 * BLOCK_SIZE);
+    on_disk[1] = 0;
+    bcache_stats_t before = bcache_stats();
+    buffer_t *buf = bread(dev, 7);
+    KTEST_ASSERT(buf != 0);
+    ((uint32_t *)buf->data)[1] = 0xB10CB10C;
+    bdirty(buf);
+    brelse(buf);
+    KTEST_ASSERT(on_disk[1] == 0);
+    KTEST_ASSERT(bcache_sync(dev) == 0);
+    KTEST_ASSERT(on_disk[1] == 0xB10CB10C);
+
+    on_disk = (uint32_t *)(scratch_base + 9 * BLOCK_SIZE);
+    on_disk[1] = 0;
+    buf = bread(dev, 9);
+    KTEST_ASSERT(buf != 0);
+    ((uint32_t *)buf->data)[1] = 0xB10CB10C;
+    bdirty(buf);
+    brelse(buf);
+    for (uint32_t block = 20; block < 40; block += 2) {
+        buf = bread(dev, block);
+        KTEST_ASSERT(buf != 0);
+        brelse(buf);
+    }
+    KTEST_ASSERT(on_disk[1] == 0xB10CB10C);
+    KTEST_ASSERT(bcache_stats().writebacks - before.writebacks == 2);
+    KTEST_ASSERT(init_buffer_cache(BCACHE_DEFAULT_BUFFERS, BCACHE_DEFAULT_READAHEAD) == 0);
+    return 0;
+}
+
+static void register_kernel_tests() {
+    ktest_register("map_page", test_map_page);
+    ktest_register("kmalloc_small", test_kmalloc_small);
+    ktest_register("kmalloc_pages", test_kmalloc_pages);
+    ktest_register("kmalloc_distinct", test_kmalloc_distinct);
+    ktest_register("kmalloc_too_large", test_kmalloc_too_large);
+    ktest_register("slab_packing", test_slab_packing);
+    ktest_register("slab_large_objects", test_slab_large_objects);
+    ktest_register("sched_round_robin", test_sched_round_robin);
+    ktest_register("sched_priority", test_sched_priority);
+    ktest_register("sched_preempt", test_sched_preempt);
+    ktest_register("smp_percpu", test_smp_percpu);
+    ktest_register("smp_spinlock", test_smp_spinlock);
+    ktest_register("smp_work_steal", test_smp_work_steal);
+    ktest_register("syscall_entry", test_syscall_entry);
+    ktest_register("syscall_bad_pointer", test_syscall_bad_pointer);
+    ktest_register("user_page_fault", test_user_page_fault);
+    ktest_register("fpu_lazy_switch", test_fpu_lazy_switch);
+    ktest_register("fpu_untouched", test_fpu_untouched);
+    ktest_register("bcache_lru", test_bcache_lru);
+    ktest_register("bcache_readahead", test_bcache_readahead);
+    ktest_register("bcache_write_back", test_bcache_write_back);
+}
+
+#define KBENCH_ITERATIONS 1000
+#define KBENCH_MAP_ADDRESS 0xC0400000
+
+static void bench_frame_alloc_free(void *ctx) {
+    free_frame(alloc_frame());
+}
+
+static void bench_frames_alloc_free(void *ctx) {
+    uint32_t count = (uint32_t)ctx;
+    uint32_t addr = alloc_frames(count, 0);
+    if (addr != 0) {
+        free_frames(addr, count);
+    }
+}
+
+static void bench_kmalloc_free(void *ctx) {
+    kfree(kmalloc((uint32_t)ctx));
+}
+
+static void bench_slab_alloc_free(void *ctx) {
+    kmem_cache_t *cache = (kmem_cache_t *)ctx;
+    kmem_cache_free(cache, kmem_cache_alloc(cache));
+}
+
+static uint32_t bench_map_frame;
 
-    // --- MEMORY DUMP DEBUG CODE ---
-    print_string("--- DUMPING MULTIBOOT STRUCT (Offset: Value) ---", 0, 0);
-    for (int i = 0; i < 24; i++) {
-        uint32_t *ptr = (uint32_t *)multiboot_info_addr;
-        uint32_t val = ptr[i];
-        char offset_str[5];
+static void bench_map_unmap(void *ctx) {
+    map_page(KBENCH_MAP_ADDRESS, bench_map_frame);
+    unmap_page(KBENCH_MAP_ADDRESS);
+}
+
+static void bench_breakpoint_handler(registers_t *regs, void *ctx) {
+}
+
+// Exception entry and iret through the common stub
+static void bench_int3(void *ctx) {
+    __asm__ __volatile__ ("int3");
+}
+
+static void bench_noop_work(void *ctx) {
+}
+
+static void bench_defer_run(void *ctx) {
+    defer_work(bench_noop_work, 0);
+    run_deferred_work(1);
+}
+
+static void bench_partner_thread(void *arg) {
+    while (1) {
+        thread_block();
+    }
+}
+
+// Two context switches per call: into the woken higher-priority partner, which blocks
+// straight away, and back
+static void bench_wake_block(void *ctx) {
+    thread_wake((thread_t *)ctx);
+}
+
+// The same with both threads using the FPU after each switch: two #NM traps, each
+// saving one state and restoring the other
+__attribute__((target("sse2")))
+static void bench_fpu_partner_thread(void *arg) {
+    while (1) {
+        thread_block();
+        __asm__ __volatile__ ("pxor %%xmm0, %%xmm0" : : : "xmm0");
+    }
+}
+
+__attribute__((target("sse2")))
+static void bench_wake_block_fpu(void *ctx) {
+    thread_wake((thread_t *)ctx);
+    __asm__ __volatile__ ("pxor %%xmm1, %%xmm1" : : : "xmm1");
+}
+
+// What a SIMD kernel pays on top of its loop
+static void bench_kernel_fpu(void *ctx) {
+    if (kernel_fpu_begin()) {
+        kernel_fpu_end();
+    }
+}
+
+static void bench_yield_self(void *ctx) {
+    sched_yield();
+}
+
+static void bench_bcache_hit(void *ctx) {
+    brelse(bread((block_device_t *)ctx, 0));
+}
+
+// A stride that is never sequential, over more blocks than there are buffers
+static void bench_bcache_miss(void *ctx) {
+    static uint32_t block;
+    block = (block + 7) % BCACHE_SCRATCH_BLOCKS;
+    brelse(bread((block_device_t *)ctx, block));
+}
+
+static void register_kernel_benchmarks() {
+    kbench_register("frame_alloc_free", bench_frame_alloc_free, 0, KBENCH_ITERATIONS);
+    kbench_register("frames_alloc_free_16", bench_frames_alloc_free, (void *)16, KBENCH_ITERATIONS);
+    kbench_register("kmalloc_free_64", bench_kmalloc_free, (void *)64, KBENCH_ITERATIONS);
+    kbench_register("kmalloc_free_8192", bench_kmalloc_free, (void *)8192, KBENCH_ITERATIONS);
+    kmem_cache_t *cache = kmem_cache_create("bench-64", 64, 16);
+    if (cache != 0) {
+        kbench_register("slab_alloc_free_64", bench_slab_alloc_free, cache, KBENCH_ITERATIONS);
+    }
+    bench_map_frame = alloc_frame();
+    if (bench_map_frame != 0) {
+        kbench_register("map_unmap_page", bench_map_unmap, 0, KBENCH_ITERATIONS);
+    }
+    register_irq_handler(3, bench_breakpoint_handler, 0);
+    kbench_register("int3_round_trip", bench_int3, 0, KBENCH_ITERATIONS);
+    kbench_register("defer_and_run", bench_defer_run, 0, KBENCH_ITERATIONS);
+    kbench_register("sched_yield_alone", bench_yield_self, 0, KBENCH_ITERATIONS);
+    thread_t *partner = thread_create("bench", bench_partner_thread, 0, SCHED_DEFAULT_PRIORITY - 1);
+    if (partner != 0) {
+        kbench_register("context_switch_pair", bench_wake_block, partner, KBENCH_ITERATIONS);
+    }
+    if (fpu_enabled()) {
+        thread_t *fpu_partner = thread_create("bench-fpu", bench_fpu_partner_thread, 0, SCHED_DEFAULT_PRIORITY - 1);
+        if (fpu_partner != 0) {
+            kbench_register("context_switch_pair_fpu", bench_wake_block_fpu, fpu_partner, KBENCH_ITERATIONS);
+        }
+        kbench_register("kernel_fpu_begin_end", bench_kernel_fpu, 0, KBENCH_ITERATIONS);
+    }
+    block_device_t *disk = bcache_scratch_disk();
+    if (disk != 0) {
+        kbench_register("bcache_hit", bench_bcache_hit, disk, KBENCH_ITERATIONS);
+        kbench_register("bcache_miss", bench_bcache_miss, disk, KBENCH_ITERATIONS);
+    }
+}
 
-        itoa(i * 4, offset_str);
-        print_string(offset_str, 2 + i, 0);
-        print_string(": ", 2 + i, 4);
-        print_hex(val, 2 + i, 6);
+static void finish_profile() {
+    if (boot_profile) {
+        log_flush();
+        profile_dump();
     }
-    // --- END DEBUG CODE ---
+}
 
+// Nothing else to run: finish deferred work, help with queued work, top up the zero
+// pool, otherwise sleep
+static void idle_loop() {
+    // The boot thread becomes the idle thread: anything else that is ready runs first
+    sched_set_priority(0, SCHED_IDLE_PRIORITY);
     while (1) {
+        __asm__ __volatile__ ("cli");
+        if (deferred_work_pending()) {
+            __asm__ __volatile__ ("sti");
+            run_deferred_work(DEFERRED_IRQ_EXIT_BUDGET); // In chunks: preemption is off meanwhile
+        } else if (work_pending()) {
+            __asm__ __volatile__ ("sti");
+            work_run_one();
+        } else if (zero_pool_count() < ZERO_POOL_SIZE) {
+            __asm__ __volatile__ ("sti");
+            zero_pool_refill(1);
+        } else {
+            __asm__ __volatile__ ("sti\n\thlt"); // No wakeup is lost between the check and hlt
+        }
+    }
+}
+
+void kmain(uint32_t multiboot_magic, uint32_t multiboot_info_addr) {
+    // Own GDT and per-CPU area before anything that uses this_cpu()
+    init_boot_cpu();
+
+    trace_begin("boot");
+    trace_begin("serial_init");
+    serial_init(SERIAL_DEFAULT_BAUD);
+    trace_end("serial_init");
+
+    init_string_lib();
+
+    // printk() queues console output as deferred work, so the ring comes first
+    init_deferred_work();
+    vga_console_init();
+
+    printk(KERN_INFO, "Initializing IDT...");
+    trace_begin("init_idt");
+    init_idt();
+    trace_end("init_idt");
+    init_syscalls();
+    init_fpu();
+    init_string_lib(); // Again: the SSE2 variants need the FPU on
+
+    printk(KERN_INFO, "Kernel running!");
+
+    if (multiboot_magic != 0x2BADB002) {
+        printk(KERN_EMERG, "Error: Invalid Multiboot magic number!");
+        while(1);
+    } else {
+        printk(KERN_INFO, "Multiboot magic number OK.");
     }
+
+    multiboot_info_t *mbi = (multiboot_info_t *)multiboot_info_addr;
+
+    printk(KERN_INFO, "Multiboot info addr: 0x%08x, flags: 0x%08x", multiboot_info_addr, mbi->flags);
+
+    if (mbi->flags & MULTIBOOT_FLAG_CMDLINE) {
+        if (cmdline_has((const char *)mbi->cmdline, "ktest")) {
+            boot_mode = BOOT_KTEST;
+        } else if (cmdline_has((const char *)mbi->cmdline, "kbench")) {
+            boot_mode = BOOT_KBENCH;
+        }
+        boot_profile = cmdline_has((const char *)mbi->cmdline, "profile");
+        boot_selftest = cmdline_has((const char *)mbi->cmdline, "selftest");
+    }
+    if ((mbi->flags & MULTIBOOT_FLAG_CMDLINE) && cmdline_has((const char *)mbi->cmdline, "verbose")) {
+        boot_verbose = 1;
+        log_set_level(LOG_SINK_VGA, KERN_DEBUG);
+    } else {
+        log_set_level(LOG_SINK_SERIAL, KERN_INFO); // Debug messages stay in the ring for log_dump()
+    }
+
+    // Symbols first: the boot loader's copy of them sits in memory the frame allocator hands out
+    init_ksyms(mbi);
+    // Same for the ramdisk image, whose frames the allocator then keeps out
+    init_ramdisk(mbi);
+
+    trace_begin("init_paging");
+    init_paging();
+    trace_end("init_paging");
+    printk(KERN_INFO, "Paging initialized.");
+
+    trace_begin("init_frame_allocator");
+    uint64_t init_start = rdtsc();
+    init_frame_allocator(mbi);
+    uint32_t init_cycles = (uint32_t)(rdtsc() - init_start);
+    trace_end("init_frame_allocator");
+    printk(KERN_INFO, "Frame allocator initialized, TSC cycles: %u", init_cycles);
+
+    // Now that the size of RAM is known, identity map all of it with 4MB pages
+    init_direct_map(frame_allocator_total_count() * 4096);
+    init_demand_paging();
+
+    // Prefer the Local APIC/IOAPIC when the machine has one (-M pc/q35); nolapic keeps the 8259
+    trace_begin("init_timer");
+    if (!((mbi->flags & MULTIBOOT_FLAG_CMDLINE) && cmdline_has((const char *)mbi->cmdline, "nolapic"))) {
+        init_apic();
+    }
+    init_timer();
+    trace_end("init_timer");
+    serial_enable_interrupts();
+    init_sched();
+    trace_begin("init_smp");
+    init_smp();
+    trace_end("init_smp");
+    init_buffer_cache(BCACHE_DEFAULT_BUFFERS, BCACHE_DEFAULT_READAHEAD);
+
+    if (boot_profile) {
+        // Samples arrive from the timer interrupt, so profiled boots run with interrupts on
+        printk(KERN_INFO, "Profiling with %u kernel symbols.", ksyms_count());
+        profile_start(PROFILE_DEFAULT_INTERVAL_US);
+        __asm__ __volatile__ ("sti");
+    }
+
+    register_kernel_tests();
+    if (boot_mode == BOOT_KTEST) {
+        int failures = ktest_run_all();
+        finish_profile();
+        ktest_exit(failures);
+    } else if (boot_mode == BOOT_KBENCH) {
+        register_kernel_benchmarks();
+        kbench_run_all();
+        finish_profile();
+        ktest_exit(0);
+    }
+
+    if (boot_selftest) {
+        trace_begin("ktest_run_all");
+        ktest_run_all();
+        trace_end("ktest_run_all");
+
+        trace_begin("test_frame_latency");
+        test_frame_allocator_latency();
+        trace_end("test_frame_latency");
+        trace_begin("test_frame_backends");
+        test_frame_backends();
+        trace_end("test_frame_backends");
+        trace_begin("bench_large_pages");
+        bench_large_pages();
+        trace_end("bench_large_pages");
+        trace_begin("test_demand_paging");
+        test_demand_paging();
+        trace_end("test_demand_paging");
+        trace_begin("bench_zero_pool");
+        bench_zero_pool();
+        trace_end("bench_zero_pool");
+        trace_begin("test_vmalloc");
+        test_vmalloc();
+        trace_end("test_vmalloc");
+        trace_begin("test_timer");
+        test_timer();
+        trace_end("test_timer");
+        trace_begin("test_deferred_work");
+        test_deferred_work();
+        trace_end("test_deferred_work");
+        trace_begin("test_serial");
+        test_serial();
+        trace_end("test_serial");
+        trace_begin("bench_string_lib");
+        bench_string_lib();
+        trace_end("bench_string_lib");
+        trace_begin("bench_printk");
+        bench_printk();
+        trace_end("bench_printk");
+        trace_begin("bench_smp_frames");
+        bench_smp_frames();
+        trace_end("bench_smp_frames");
+        trace_begin("bench_syscalls");
+        bench_syscalls();
+        trace_end("bench_syscalls");
+        trace_begin("bench_buffer_cache");
+        bench_buffer_cache();
+        trace_end("bench_buffer_cache");
+    }
+
+    // Enable interrupts for good
+    __asm__ __volatile__ ("sti");
+    printk(KERN_INFO, "Interrupts enabled.");
+
+    trace_end("boot");
+    log_flush();
+    trace_dump();
+    finish_profile();
+
+    idle_loop();
 }
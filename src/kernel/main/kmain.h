@@ -3,10 +3,9 @@
 
 #include "../include/types.h" // Include for uint32_t
 
+// Non-zero when the kernel command line contains "verbose"; enables detailed boot output
+extern int boot_verbose;
+
 void kmain(uint32_t multiboot_magic, uint32_t multiboot_info_addr);
-void print_string(const char *s, int row, int col);
-void itoa(int n, char s[]); // Add prototype for itoa
-int strlen(const char *s); // Add prototype for strlen
-void print_hex(uint32_t value, int row, int col);
 
 #endif // KMAIN_H
\ No newline at end of file
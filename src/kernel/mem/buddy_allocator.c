@@ -0,0 +1,139 @@
+#include "../include/buddy_allocator.h"
+#include "../include/types.h"
+#include "../include/kstring.h"
+
+#define PAGE_SIZE 4096
+#define NO_FRAME 0xFFFFFFFF
+#define NOT_FREE 0xFF
+
+// Free-list links live in a side table indexed by frame number, not inside the
+// free blocks, because most of physical memory is not mapped.
+typedef struct {
+    uint32_t next;
+    uint32_t prev;
+} buddy_link_t;
+
+static buddy_link_t *links;
+static uint8_t *block_order; // Order of the free block starting at a frame, or NOT_FREE
+static uint32_t managed_frames;
+static uint32_t free_heads[BUDDY_MAX_ORDER + 1];
+static uint32_t nonempty_orders; // Bit n set while free_heads[n] is not empty
+static uint32_t free_count;
+
+static inline uint32_t bsf(uint32_t value) {
+    uint32_t index;
+    asm("bsf %1, %0" : "=r"(index) : "rm"(value));
+    return index;
+}
+
+static void push_block(uint32_t frame, uint32_t order) {
+    links[frame].prev = NO_FRAME;
+    links[frame].next = free_heads[order];
+    if (free_heads[order] != NO_FRAME) {
+        links[free_heads[order]].prev = frame;
+    }
+    free_heads[order] = frame;
+    block_order[frame] = order;
+    nonempty_orders |= (1 << order);
+}
+
+static void remove_block(uint32_t frame, uint32_t order) {
+    if (links[frame].prev != NO_FRAME) {
+        links[links[frame].prev].next = links[frame].next;
+    } else {
+        free_heads[order] = links[frame].next;
+    }
+    if (links[frame].next != NO_FRAME) {
+        links[links[frame].next].prev = links[frame].prev;
+    }
+    block_order[frame] = NOT_FREE;
+    if (free_heads[order] == NO_FRAME) {
+        nonempty_orders &= ~(1 << order);
+    }
+}
+
+uint32_t buddy_metadata_size(uint32_t num_frames) {
+    return num_frames * (sizeof(buddy_link_t) + sizeof(uint8_t));
+}
+
+void buddy_init(void *metadata, uint32_t num_frames) {
+    links = (buddy_link_t *)metadata;
+    block_order = (uint8_t *)(links + num_frames);
+    managed_frames = num_frames;
+    memset(block_order, NOT_FREE, num_frames);
+    for (int order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        free_heads[order] = NO_FRAME;
+    }
+    nonempty_orders = 0;
+    free_count = 0;
+}
+
+void buddy_add_range(uint32_t first_frame, uint32_t end_frame) {
+    if (end_frame > managed_frames) {
+        end_frame = managed_frames;
+    }
+    // Carve the range into the largest blocks that are both aligned and in range
+    while (first_frame < end_frame) {
+        uint32_t order = BUDDY_MAX_ORDER;
+        while (order > 0 && ((first_frame & ((1 << order) - 1)) != 0 ||
+                             first_frame + (1 << order) > end_frame)) {
+            order--;
+        }
+        push_block(first_frame, order);
+        free_count += 1 << order;
+        first_frame += 1 << order;
+    }
+}
+
+uint32_t buddy_alloc(uint32_t order) {
+    if (order > BUDDY_MAX_ORDER) {
+        return 0;
+    }
+    uint32_t candidates = nonempty_orders & ~((1 << order) - 1);
+    if (candidates == 0) {
+        return 0;
+    }
+    uint32_t found = bsf(candidates);
+    uint32_t frame = free_heads[found];
+    remove_block(frame, found);
+
+    // Split down, returning the upper halves to the free lists
+    while (found > order) {
+        found--;
+        push_block(frame + (1 << found), found);
+    }
+    free_count -= 1 << order;
+    return frame * PAGE_SIZE;
+}
+
+void buddy_free(uint32_t addr, uint32_t order) {
+    uint32_t frame = addr / PAGE_SIZE;
+    if (addr == 0 || order > BUDDY_MAX_ORDER || frame >= managed_frames) {
+        return;
+    }
+    free_count += 1 << order;
+
+    // Merge with the buddy while it is a free block of the same order
+    while (order < BUDDY_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1 << order);
+        if (buddy >= managed_frames || block_order[buddy] != order) {
+            break;
+        }
+        remove_block(buddy, order);
+        frame &= ~(1 << order);
+        order++;
+    }
+    push_block(frame, order);
+}
+
+uint32_t buddy_free_count() {
+    return free_count;
+}
+
+uint32_t buddy_order_for(uint32_t count) {
+    uint32_t order = 0;
+    while ((1u << order) < count && order <= BUDDY_MAX_ORDER) {
+        order++;
+    }
+    return order;
+}
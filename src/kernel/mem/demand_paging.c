@@ -0,0 +1,135 @@
+#include "../include/demand_paging.h"
+#include "../include/types.h"
+#include "../include/paging.h"
+#include "../include/frame_allocator.h"
+#include "../include/zero_pool.h"
+#include "../include/idt.h"
+#include "../include/printk.h"
+#include "../include/sched.h"
+
+#define PAGE_SIZE 4096
+
+typedef struct {
+    uint32_t start;
+    uint32_t end; // 0 marks a free slot
+} lazy_region_t;
+
+static lazy_region_t lazy_regions[MAX_LAZY_REGIONS];
+static uint32_t zero_page; // Physical address of the shared all-zero frame
+static demand_paging_stats_t stats;
+
+static void page_fault_entry(registers_t *regs, void *ctx) {
+    (void)ctx;
+    page_fault_handler(regs);
+}
+
+void init_demand_paging() {
+    zero_page = alloc_zeroed_frame();
+    register_irq_handler(14, page_fault_entry, 0);
+}
+
+int reserve_lazy_region(uint32_t virtual_address, uint32_t size) {
+    if (zero_page == 0 || size == 0 || (virtual_address & (PAGE_SIZE - 1))) {
+        return -1;
+    }
+    for (int i = 0; i < MAX_LAZY_REGIONS; i++) {
+        if (lazy_regions[i].end == 0) {
+            lazy_regions[i].start = virtual_address;
+            lazy_regions[i].end = virtual_address + ((size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void release_lazy_region(uint32_t virtual_address) {
+    for (int i = 0; i < MAX_LAZY_REGIONS; i++) {
+        lazy_region_t *region = &lazy_regions[i];
+        if (region->end == 0 || region->start != virtual_address) {
+            continue;
+        }
+        // Give back private frames; the zero page and unmapped pages need nothing
+        for (uint32_t page = region->start; page < region->end; page += PAGE_SIZE) {
+            uint32_t frame = get_physical_address(page);
+            if (frame != 0 && frame != zero_page) {
+                free_frame(frame);
+            }
+        }
+        unmap_range(region->start, region->end - region->start);
+        region->end = 0;
+        return;
+    }
+}
+
+static lazy_region_t *find_lazy_region(uint32_t address) {
+    for (int i = 0; i < MAX_LAZY_REGIONS; i++) {
+        if (lazy_regions[i].end != 0 && address >= lazy_regions[i].start && address < lazy_regions[i].end) {
+            return &lazy_regions[i];
+        }
+    }
+    return 0;
+}
+
+static void page_fault_panic(uint32_t address, registers_t *regs) {
+    printk(KERN_EMERG, "PAGE FAULT at 0x%08x err 0x%08x eip 0x%08x", address, regs->err_code, regs->eip);
+    log_panic();
+    while (1) {
+        __asm__ __volatile__ ("cli\nhlt");
+    }
+}
+
+// A user program touched memory it may not: it dies, the kernel goes on. Lazy regions
+// are kernel memory and mapped supervisor-only, so serving the fault would only make
+// the program fault again on a new frame, forever.
+static void user_fault_kill(uint32_t address, registers_t *regs) {
+    thread_t *thread = thread_current();
+    if (thread == 0) {
+        page_fault_panic(address, regs);
+    }
+    stats.user_faults++;
+    printk(KERN_ERR, "Thread %u (%s) killed: page fault at 0x%08x err 0x%08x eip 0x%08x",
+           thread->id, thread->name, address, regs->err_code, regs->eip);
+    thread_exit();
+}
+
+void page_fault_handler(registers_t *regs) {
+    uint32_t address;
+    __asm__ __volatile__ ("mov %%cr2, %0" : "=r" (address));
+    uint32_t page = address & ~(PAGE_SIZE - 1);
+
+    if (regs->err_code & PF_USER) {
+        user_fault_kill(address, regs);
+    }
+
+    if ((regs->err_code & (PF_RESERVED | PF_FETCH)) || find_lazy_region(address) == 0) {
+        page_fault_panic(address, regs);
+    }
+
+    if (!(regs->err_code & PF_WRITE)) {
+        if (regs->err_code & PF_PRESENT) {
+            page_fault_panic(address, regs); // Read of a mapped page cannot fault here
+        }
+        // First read: share the zero page read-only until the page is written
+        if (map_range(page, zero_page, PAGE_SIZE, 0) != 0) {
+            page_fault_panic(address, regs);
+        }
+        stats.read_faults++;
+        return;
+    }
+
+    // First write, either to an untouched page or to the shared zero page
+    uint32_t frame = alloc_zeroed_frame();
+    if (frame == 0) {
+        page_fault_panic(address, regs);
+    }
+    if (map_range(page, frame, PAGE_SIZE, PAGE_RW) != 0) {
+        free_frame(frame);
+        page_fault_panic(address, regs);
+    }
+    stats.write_faults++;
+    stats.frames_allocated++;
+}
+
+demand_paging_stats_t demand_paging_stats() {
+    return stats;
+}
@@ -1,53 +1,267 @@
 #include "../include/frame_allocator.h"
 #include "../include/types.h"
 #include "../include/multiboot.h"
-#include "../main/kmain.h" // For print_string and print_hex
+#include "../include/buddy_allocator.h"
+#include "../include/printk.h"
+#include "../include/kstring.h"
+#include "../include/spinlock.h"
+#include "../include/percpu.h"
 
 #define PAGE_SIZE 4096
+#define KERNEL_START 0x100000
 
 static uint32_t *frames_bitmap;
 static uint32_t num_frames;
+static uint32_t num_bitmap_words; // Words in frames_bitmap, tail bits past num_frames stay set
+static uint32_t free_frame_count;
 
+// Second level: bit i of frames_summary is set while frames_bitmap[i] has a free bit,
+// so alloc_frame() skips full words 32 at a time instead of testing each one.
+static uint32_t *frames_summary;
+static uint32_t num_summary_words;
+
+// Next-fit cursor: summary word where the last allocation succeeded
+static uint32_t summary_cursor;
+
+// Boot modules (ramdisk images, the kernel ELF for symbols) stay where the boot loader
+// put them: their frames, end exclusive, are kept out of both backends
+#define MAX_BOOT_MODULES 8
+typedef struct {
+    uint32_t first;
+    uint32_t end;
+} frame_range_t;
+
+static frame_range_t boot_modules[MAX_BOOT_MODULES];
+static uint32_t num_boot_modules;
+
+// Guards the backend (bitmap or buddy lists)
+static spinlock_t frame_lock = SPINLOCK_INIT;
+
+// Per-CPU stack of free single frames in front of the backend. A CPU only takes
+// frame_lock to move FRAME_CACHE_BATCH frames in or out at once.
+typedef struct {
+    uint32_t count;
+    uint32_t frames[FRAME_CACHE_SIZE];
+} __attribute__((aligned(64))) frame_cache_t;
+
+static frame_cache_t frame_caches[SMP_MAX_CPUS];
+static volatile int frame_caches_enabled = 1;
+
+// Index of the lowest set bit (value must be non-zero)
+static inline uint32_t bsf(uint32_t value) {
+    uint32_t index;
+    asm("bsf %1, %0" : "=r"(index) : "rm"(value));
+    return index;
+}
+
+static inline void update_summary(uint32_t word) {
+    if (frames_bitmap[word] != 0xFFFFFFFF) {
+        frames_summary[word / 32] |= (1 << (word % 32));
+    } else {
+        frames_summary[word / 32] &= ~(1 << (word % 32));
+    }
+}
+
+// Single-frame and search helpers used only by the bitmap backend's entry points
+#ifndef FRAME_ALLOCATOR_BUDDY
 static void set_frame_bit(uint32_t frame_addr) {
     uint32_t frame_num = frame_addr / PAGE_SIZE;
-    frames_bitmap[frame_num / 32] |= (1 << (frame_num % 32));
+    if (frame_num >= num_frames) {
+        return;
+    }
+    uint32_t mask = 1 << (frame_num % 32);
+    if (!(frames_bitmap[frame_num / 32] & mask)) {
+        frames_bitmap[frame_num / 32] |= mask;
+        free_frame_count--;
+        update_summary(frame_num / 32);
+    }
 }
 
 static void clear_frame_bit(uint32_t frame_addr) {
     uint32_t frame_num = frame_addr / PAGE_SIZE;
-    frames_bitmap[frame_num / 32] &= ~(1 << (frame_num % 32));
+    if (frame_num >= num_frames) {
+        return;
+    }
+    uint32_t mask = 1 << (frame_num % 32);
+    if (frames_bitmap[frame_num / 32] & mask) {
+        frames_bitmap[frame_num / 32] &= ~mask;
+        free_frame_count++;
+        update_summary(frame_num / 32);
+    }
 }
+#endif
+
+// Number of set bits in a word
+static inline uint32_t popcount(uint32_t value) {
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    value = (value + (value >> 4)) & 0x0F0F0F0F;
+    return (value * 0x01010101) >> 24;
+}
+
+// Mask of bits [low, high) within one bitmap word (0 <= low < high <= 32)
+static inline uint32_t word_mask(uint32_t low, uint32_t high) {
+    uint32_t upper = (high == 32) ? 0xFFFFFFFF : ((1u << high) - 1);
+    return upper & ~((1u << low) - 1);
+}
+
+// Mark frames [first, first + count) as used, one bitmap word at a time
+static void set_frame_range(uint32_t first, uint32_t count) {
+    uint32_t end = first + count;
+    if (end > num_frames) {
+        end = num_frames;
+    }
+    while (first < end) {
+        uint32_t word = first / 32;
+        uint32_t high = (end - word * 32 < 32) ? end - word * 32 : 32;
+        uint32_t mask = word_mask(first % 32, high);
+        free_frame_count -= popcount(~frames_bitmap[word] & mask);
+        frames_bitmap[word] |= mask;
+        update_summary(word);
+        first = word * 32 + high;
+    }
+}
+
+// Mark frames [first, first + count) as free, one bitmap word at a time
+static void clear_frame_range(uint32_t first, uint32_t count) {
+    uint32_t end = first + count;
+    if (end > num_frames) {
+        end = num_frames;
+    }
+    while (first < end) {
+        uint32_t word = first / 32;
+        uint32_t high = (end - word * 32 < 32) ? end - word * 32 : 32;
+        uint32_t mask = word_mask(first % 32, high);
+        free_frame_count += popcount(frames_bitmap[word] & mask);
+        frames_bitmap[word] &= ~mask;
+        update_summary(word);
+        first = word * 32 + high;
+    }
+}
+
+#ifndef FRAME_ALLOCATOR_BUDDY
+// First used frame in [first, end), or end if the whole range is free
+static uint32_t find_used_frame(uint32_t first, uint32_t end) {
+    while (first < end) {
+        uint32_t word = first / 32;
+        uint32_t bits = frames_bitmap[word] & (0xFFFFFFFF << (first % 32));
+        if (bits) {
+            uint32_t frame_num = word * 32 + bsf(bits);
+            return frame_num < end ? frame_num : end;
+        }
+        first = (word + 1) * 32;
+    }
+    return end;
+}
+
+// First free frame at or after first, or num_frames if there is none.
+// Full bitmap words are skipped through the summary, 32 at a time.
+static uint32_t find_free_frame(uint32_t first) {
+    if (first >= num_frames) {
+        return num_frames;
+    }
+    uint32_t word = first / 32;
+    uint32_t bits = ~frames_bitmap[word] & (0xFFFFFFFF << (first % 32));
+    if (bits) {
+        return word * 32 + bsf(bits);
+    }
+    for (word++; word < num_bitmap_words; word = (word | 31) + 1) {
+        uint32_t summary = frames_summary[word / 32] & (0xFFFFFFFF << (word % 32));
+        if (summary) {
+            word = (word & ~31) + bsf(summary);
+            return word * 32 + bsf(~frames_bitmap[word]);
+        }
+    }
+    return num_frames;
+}
+#endif
 
 static uint8_t test_frame_bit(uint32_t frame_addr) {
     uint32_t frame_num = frame_addr / PAGE_SIZE;
     return (frames_bitmap[frame_num / 32] & (1 << (frame_num % 32))) != 0;
 }
 
+#ifdef FRAME_ALLOCATOR_BUDDY
+// Hand frames [first, last) to the buddy allocator minus the boot modules
+static void buddy_add_unreserved(uint32_t first, uint32_t last) {
+    while (first < last) {
+        // Free run up to the nearest module, then continue past it
+        uint32_t stop = last;
+        uint32_t resume = last;
+        for (uint32_t i = 0; i < num_boot_modules; i++) {
+            uint32_t start = boot_modules[i].first > first ? boot_modules[i].first : first;
+            if (boot_modules[i].end > first && start < stop) {
+                stop = start;
+                resume = boot_modules[i].end;
+            }
+        }
+        if (stop > first) {
+            buddy_add_range(first, stop);
+        }
+        first = resume;
+    }
+}
+
+// Hand an available mmap region to the buddy allocator, skipping the frames below
+// FRAME_LOW_RESERVED, the kernel/metadata area [KERNEL_START, reserved_end) and the
+// boot modules
+static void buddy_add_available(uint32_t start, uint32_t end, uint32_t reserved_end) {
+    uint32_t first = (start + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t last = end / PAGE_SIZE;
+    uint32_t hole_first = KERNEL_START / PAGE_SIZE;
+    uint32_t hole_end = (reserved_end + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (first < FRAME_LOW_RESERVED / PAGE_SIZE) {
+        first = FRAME_LOW_RESERVED / PAGE_SIZE;
+    }
+    if (first < hole_first && first < last) {
+        buddy_add_unreserved(first, last < hole_first ? last : hole_first);
+    }
+    if (last > hole_end) {
+        buddy_add_unreserved(first > hole_end ? first : hole_end, last);
+    }
+}
+#endif
+
+// Record the boot modules and return where the metadata goes. QEMU and GRUB load
+// modules right after the kernel, where a large one would run into
+// FRAME_METADATA_BASE, so the metadata moves up past any module below the limit.
+static uint32_t reserve_boot_modules(multiboot_info_t *mbi) {
+    uint32_t metadata_base = FRAME_METADATA_BASE;
+    num_boot_modules = 0;
+    if (!(mbi->flags & MULTIBOOT_FLAG_MODS)) {
+        return metadata_base;
+    }
+    multiboot_module_t *modules = (multiboot_module_t *)mbi->mods_addr;
+    for (uint32_t m = 0; m < mbi->mods_count && num_boot_modules < MAX_BOOT_MODULES; m++) {
+        uint32_t first = modules[m].mod_start / PAGE_SIZE;
+        uint32_t end = (modules[m].mod_end + PAGE_SIZE - 1) / PAGE_SIZE;
+        printk(KERN_DEBUG, "  Boot module at 0x%08x-0x%08x", modules[m].mod_start, modules[m].mod_end);
+        boot_modules[num_boot_modules].first = first;
+        boot_modules[num_boot_modules].end = end;
+        num_boot_modules++;
+        if (modules[m].mod_start >= FRAME_METADATA_LIMIT || end * PAGE_SIZE <= metadata_base) {
+            continue;
+        }
+        if (end * PAGE_SIZE + PAGE_SIZE > FRAME_METADATA_LIMIT) {
+            printk(KERN_WARNING, "  Boot module runs past 0x%08x, the allocator metadata overwrites it", FRAME_METADATA_LIMIT);
+        } else {
+            metadata_base = end * PAGE_SIZE;
+        }
+    }
+    return metadata_base;
+}
+
 void init_frame_allocator(multiboot_info_t *mbi) {
-    int mmap_entry_row = 19; // Adjusted declaration here
-    print_string("--------------------------------------------------------------------------------", 14, 0);
-    print_string("Initializing frame allocator...", 15, 0);
+    printk(KERN_DEBUG, "Initializing frame allocator...");
+    uint32_t metadata_base = reserve_boot_modules(mbi);
     uint32_t max_addr = 0;
     if (mbi->flags & MULTIBOOT_FLAG_MMAP) {
-        print_string("  Multiboot memory map found.", 16, 0);
-        print_string("  mmap_addr: ", 17, 0);
-        print_hex(mbi->mmap_addr, 17, 13);
-        print_string("  mmap_length: ", 18, 0);
-        print_hex(mbi->mmap_length, 18, 15);
+        printk(KERN_DEBUG, "  Multiboot memory map at %p, length %u", mbi->mmap_addr, mbi->mmap_length);
         for (multiboot_mmap_entry_t *mmap = (multiboot_mmap_entry_t *)mbi->mmap_addr;
              (uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
              mmap = (multiboot_mmap_entry_t *)((uint32_t)mmap + mmap->size + sizeof(mmap->size))) {
 
-            print_string("    Entry: addr=", mmap_entry_row, 0);
-            print_hex(mmap->addr_low, mmap_entry_row, 17);
-            print_string(", len=", mmap_entry_row, 28);
-            print_hex(mmap->len_low, mmap_entry_row, 35);
-            print_string(", type=", mmap_entry_row, 46);
-            char type_str[2];
-            itoa(mmap->type, type_str);
-            print_string(type_str, mmap_entry_row, 53);
-            print_string(" (processed)", mmap_entry_row, 55);
-            mmap_entry_row++;
+            printk(KERN_DEBUG, "    Entry: addr=0x%08x, len=0x%08x, type=%u", mmap->addr_low, mmap->len_low, mmap->type);
 
             if (mmap->type == 1) { // Available RAM
                 uint32_t current_end = mmap->addr_low + mmap->len_low;
@@ -58,89 +272,312 @@ void init_frame_allocator(multiboot_info_t *mbi) {
         }
     }
 
-    print_string("  Max physical address: ", mmap_entry_row, 0);
-    print_hex(max_addr, mmap_entry_row, 26);
-    mmap_entry_row++;
-
     num_frames = max_addr / PAGE_SIZE;
-    print_string("  Total frames: ", mmap_entry_row, 0);
-    char num_frames_str[10];
-    itoa(num_frames, num_frames_str);
-    print_string(num_frames_str, mmap_entry_row, 16);
-    mmap_entry_row++;
-
-    frames_bitmap = (uint32_t *)0x200000; // Place at 2MB
-    print_string("  Bitmap placed at: ", mmap_entry_row, 0);
-    print_hex((uint32_t)frames_bitmap, mmap_entry_row, 21);
-    mmap_entry_row++;
-
-    // Mark all frames as used initially
-    print_string("  Marking all frames as used...", mmap_entry_row, 0);
-    mmap_entry_row++;
-    for (uint32_t i = 0; i < num_frames / 32; i++) {
-        frames_bitmap[i] = 0xFFFFFFFF;
-    }
-    // Clear remaining bits if num_frames is not a multiple of 32
-    for (uint32_t i = (num_frames / 32) * 32; i < num_frames; i++) {
-        set_frame_bit(i * PAGE_SIZE); // Mark as used
-    }
-    print_string("  All frames marked used.", mmap_entry_row, 0);
-    mmap_entry_row++;
-
-    // Iterate through memory map and mark available frames as free
+    num_bitmap_words = (num_frames + 31) / 32;
+    num_summary_words = (num_bitmap_words + 31) / 32;
+
+    frames_bitmap = (uint32_t *)metadata_base;
+    frames_summary = frames_bitmap + num_bitmap_words; // Summary follows the bitmap
+
+    // Mark all frames as used initially, including the tail bits past num_frames
+    memset(frames_bitmap, 0xFF, num_bitmap_words * sizeof(uint32_t));
+    memset(frames_summary, 0, num_summary_words * sizeof(uint32_t));
+    free_frame_count = 0;
+    summary_cursor = 0;
+
+    // Mark available RAM as free, whole words at a time. Partial frames at the
+    // region edges stay used.
     if (mbi->flags & MULTIBOOT_FLAG_MMAP) {
-        print_string("  Marking available RAM as free...", mmap_entry_row, 0);
-        mmap_entry_row++;
         for (multiboot_mmap_entry_t *mmap = (multiboot_mmap_entry_t *)mbi->mmap_addr;
              (uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
              mmap = (multiboot_mmap_entry_t *)((uint32_t)mmap + mmap->size + sizeof(mmap->size))) {
 
             if (mmap->type == 1) { // Available RAM
-                for (uint32_t addr = mmap->addr_low; addr < mmap->addr_low + mmap->len_low; addr += PAGE_SIZE) {
-                    clear_frame_bit(addr);
+                uint32_t first = (mmap->addr_low + PAGE_SIZE - 1) / PAGE_SIZE;
+                uint32_t end = (mmap->addr_low + mmap->len_low) / PAGE_SIZE;
+                if (end > first) {
+                    clear_frame_range(first, end - first);
                 }
             }
         }
     }
-    print_string("  Available RAM marked free.", mmap_entry_row, 0);
-    mmap_entry_row++;
 
-    // Mark the bitmap pages as used
-    print_string("  Marking bitmap pages as used...", mmap_entry_row, 0);
-    mmap_entry_row++;
-    for (uint32_t addr = (uint32_t)frames_bitmap; addr < (uint32_t)frames_bitmap + (num_frames / 8); addr += PAGE_SIZE) {
-        set_frame_bit(addr);
+    // Mark the kernel (assumed to be loaded at 1MB and less than 1MB in size),
+    // the bitmap and the summary as used
+    uint32_t bitmap_end = (uint32_t)(frames_summary + num_summary_words);
+    set_frame_range(KERNEL_START / PAGE_SIZE, (bitmap_end + PAGE_SIZE - 1) / PAGE_SIZE - KERNEL_START / PAGE_SIZE);
+
+    // Frame 0 (address 0 is the allocation failure value) and the rest of the low
+    // reserved area are never handed out
+    set_frame_range(0, FRAME_LOW_RESERVED / PAGE_SIZE);
+    for (uint32_t i = 0; i < num_boot_modules; i++) {
+        set_frame_range(boot_modules[i].first, boot_modules[i].end - boot_modules[i].first);
+    }
+
+#ifdef FRAME_ALLOCATOR_BUDDY
+    // The buddy free lists are built from the same memory map; from here on the bitmap
+    // only serves to lay out and reserve the metadata, and nothing allocates from it.
+    // The links sit after the bitmap; if the identity map is too small for all frames,
+    // the buddy covers less.
+    uint32_t buddy_meta = (bitmap_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t buddy_frames = num_frames;
+    uint32_t per_frame = buddy_metadata_size(1);
+    if (buddy_frames > (FRAME_METADATA_LIMIT - buddy_meta) / per_frame) {
+        buddy_frames = (FRAME_METADATA_LIMIT - buddy_meta) / per_frame;
+    }
+    uint32_t reserved_end = buddy_meta + buddy_metadata_size(buddy_frames);
+    set_frame_range(buddy_meta / PAGE_SIZE, (reserved_end - buddy_meta + PAGE_SIZE - 1) / PAGE_SIZE);
+    buddy_init((void *)buddy_meta, buddy_frames);
+    if (mbi->flags & MULTIBOOT_FLAG_MMAP) {
+        for (multiboot_mmap_entry_t *mmap = (multiboot_mmap_entry_t *)mbi->mmap_addr;
+             (uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
+             mmap = (multiboot_mmap_entry_t *)((uint32_t)mmap + mmap->size + sizeof(mmap->size))) {
+
+            if (mmap->type == 1) { // Available RAM
+                buddy_add_available(mmap->addr_low, mmap->addr_low + mmap->len_low, reserved_end);
+            }
+        }
+    }
+#endif
+
+    printk(KERN_DEBUG, "  Max physical address: 0x%08x", max_addr);
+    printk(KERN_DEBUG, "  Total frames: %u, free frames: %u", num_frames, free_frame_count);
+    printk(KERN_DEBUG, "  Bitmap placed at: %p", frames_bitmap);
+#ifdef FRAME_ALLOCATOR_BUDDY
+    printk(KERN_DEBUG, "  Buddy free lists built, frames: %u", buddy_free_count());
+#endif
+    printk(KERN_DEBUG, "Frame allocator initialization complete.");
+}
+
+// Only the backend chosen at build time exists, so nothing can allocate a frame from one
+// that the other still counts as free
+#ifndef FRAME_ALLOCATOR_BUDDY
+uint32_t bitmap_alloc_frame() {
+    // Walk the summary from the next-fit cursor, wrapping once around
+    for (uint32_t n = 0; n < num_summary_words; n++) {
+        uint32_t s = summary_cursor + n;
+        if (s >= num_summary_words) {
+            s -= num_summary_words;
+        }
+        if (frames_summary[s] == 0) {
+            continue; // 32 full bitmap words
+        }
+        uint32_t word = s * 32 + bsf(frames_summary[s]);
+        uint32_t frame_num = word * 32 + bsf(~frames_bitmap[word]);
+        uint32_t frame_addr = frame_num * PAGE_SIZE;
+        set_frame_bit(frame_addr);
+        summary_cursor = s;
+        return frame_addr;
     }
-    print_string("  Bitmap pages marked used.", mmap_entry_row, 0);
-    mmap_entry_row++;
+    return 0; // No free frames
+}
+
+uint32_t bitmap_free_count() {
+    return free_frame_count;
+}
 
-    // Mark kernel pages as used (assuming kernel is loaded at 1MB and is less than 1MB in size)
-    print_string("  Marking kernel pages as used...", mmap_entry_row, 0);
-    mmap_entry_row++;
-    for (uint32_t addr = 0x100000; addr < 0x200000; addr += PAGE_SIZE) { // 1MB to 2MB
-        set_frame_bit(addr);
+uint32_t bitmap_alloc_frames(uint32_t count, uint32_t alignment) {
+    if (count == 0) {
+        return 0;
+    }
+    if (count == 1 && alignment <= PAGE_SIZE) {
+        return bitmap_alloc_frame();
     }
-    print_string("  Kernel pages marked used.", mmap_entry_row, 0);
-    mmap_entry_row++;
+    uint32_t align_frames = alignment > PAGE_SIZE ? alignment / PAGE_SIZE : 1;
 
-    print_string("Frame allocator initialization complete.", mmap_entry_row, 0);
+    // Candidate runs start at free, aligned frames. When a run hits a used frame,
+    // restart at the next free frame after it instead of stepping bit by bit.
+    uint32_t first = find_free_frame(1);
+    while (first < num_frames) {
+        first = (first + align_frames - 1) & ~(align_frames - 1);
+        if (first >= num_frames || count > num_frames - first) {
+            break;
+        }
+        uint32_t used = find_used_frame(first, first + count);
+        if (used == first + count) {
+            set_frame_range(first, count);
+            return first * PAGE_SIZE;
+        }
+        first = find_free_frame(used + 1);
+    }
+    return 0; // No run of free frames is large enough
+}
+
+void bitmap_free_frames(uint32_t addr, uint32_t count) {
+    uint32_t first = addr / PAGE_SIZE;
+    if (first == 0) {
+        return; // Frame 0 stays reserved
+    }
+    // Fast path for backend_free_frame(), which frees every single frame through here:
+    // one test-and-clear instead of the mask and popcount loop. Same result either way,
+    // as both skip frames that are already free and frames past num_frames.
+    if (count == 1) {
+        clear_frame_bit(addr);
+        return;
+    }
+    clear_frame_range(first, count);
+}
+#else
+// Buddy blocks are power-of-two sized and aligned to their size. A stricter alignment
+// is met by taking a larger block and handing its upper buddies straight back.
+static uint32_t buddy_alloc_run(uint32_t count, uint32_t alignment) {
+    uint32_t order = buddy_order_for(count);
+    uint32_t align_order = buddy_order_for(alignment / PAGE_SIZE);
+    if (align_order <= order) {
+        return buddy_alloc(order);
+    }
+    uint32_t addr = buddy_alloc(align_order);
+    if (addr != 0) {
+        for (uint32_t o = order; o < align_order; o++) {
+            buddy_free(addr + (PAGE_SIZE << o), o);
+        }
+    }
+    return addr;
+}
+#endif
+
+// Backend for single frames, called with frame_lock held
+static inline uint32_t backend_alloc_frame() {
+#ifdef FRAME_ALLOCATOR_BUDDY
+    return buddy_alloc(0);
+#else
+    return bitmap_alloc_frame();
+#endif
+}
+
+static inline void backend_free_frame(uint32_t addr) {
+#ifdef FRAME_ALLOCATOR_BUDDY
+    buddy_free(addr, 0);
+#else
+    bitmap_free_frames(addr, 1);
+#endif
 }
 
+// Move frames between a cache and the backend under one lock acquisition
+static void cache_refill(frame_cache_t *cache) {
+    spin_lock(&frame_lock);
+    while (cache->count < FRAME_CACHE_BATCH) {
+        uint32_t addr = backend_alloc_frame();
+        if (addr == 0) {
+            break;
+        }
+        cache->frames[cache->count++] = addr;
+    }
+    spin_unlock(&frame_lock);
+}
+
+static void cache_drain(frame_cache_t *cache, uint32_t keep) {
+    spin_lock(&frame_lock);
+    while (cache->count > keep) {
+        backend_free_frame(cache->frames[--cache->count]);
+    }
+    spin_unlock(&frame_lock);
+}
+
+// Public API, routed to the backend chosen at build time (FRAME_ALLOCATOR in the Makefile).
+// Interrupts stay off while a CPU uses its cache, so a handler cannot interleave with it.
+
 uint32_t alloc_frame() {
-    for (uint32_t i = 0; i < num_frames / 32; i++) {
-        if (frames_bitmap[i] != 0xFFFFFFFF) { // Find a dword with at least one free frame
-            for (uint32_t j = 0; j < 32; j++) {
-                if (!(frames_bitmap[i] & (1 << j))) { // Find a free bit
-                    uint32_t frame_addr = (i * 32 + j) * PAGE_SIZE;
-                    set_frame_bit(frame_addr);
-                    return frame_addr;
-                }
-            }
+    uint32_t flags = irq_save();
+    frame_cache_t *cache = &frame_caches[this_cpu()->id];
+    uint32_t addr = 0;
+    if (frame_caches_enabled) {
+        if (cache->count == 0) {
+            cache_refill(cache);
+        }
+        if (cache->count != 0) {
+            addr = cache->frames[--cache->count];
         }
+    } else {
+        if (cache->count != 0) {
+            cache_drain(cache, 0);
+        }
+        spin_lock(&frame_lock);
+        addr = backend_alloc_frame();
+        spin_unlock(&frame_lock);
     }
-    return 0; // No free frames
+    irq_restore(flags);
+    return addr;
 }
 
 void free_frame(uint32_t addr) {
-    clear_frame_bit(addr);
-}
\ No newline at end of file
+    free_frames(addr, 1);
+}
+
+uint32_t alloc_frames(uint32_t count, uint32_t alignment) {
+    if (count == 0) {
+        return 0;
+    }
+    if (count == 1 && alignment <= PAGE_SIZE) {
+        return alloc_frame();
+    }
+    uint32_t flags = irq_save();
+    uint32_t addr = 0;
+    for (int attempt = 0; attempt < 2 && addr == 0; attempt++) {
+        if (attempt == 1) {
+            // Cached frames may be what splits the run: hand this CPU's back and retry
+            frame_cache_t *cache = &frame_caches[this_cpu()->id];
+            if (cache->count == 0) {
+                break;
+            }
+            cache_drain(cache, 0);
+        }
+        spin_lock(&frame_lock);
+#ifdef FRAME_ALLOCATOR_BUDDY
+        addr = buddy_alloc_run(count, alignment);
+#else
+        addr = bitmap_alloc_frames(count, alignment);
+#endif
+        spin_unlock(&frame_lock);
+    }
+    irq_restore(flags);
+    return addr;
+}
+
+void free_frames(uint32_t addr, uint32_t count) {
+    if (count == 1 && addr != 0) {
+        uint32_t flags = irq_save();
+        frame_cache_t *cache = &frame_caches[this_cpu()->id];
+        if (frame_caches_enabled) {
+            if (cache->count == FRAME_CACHE_SIZE) {
+                cache_drain(cache, FRAME_CACHE_SIZE - FRAME_CACHE_BATCH);
+            }
+            cache->frames[cache->count++] = addr;
+        } else {
+            cache_drain(cache, 0);
+            spin_lock(&frame_lock);
+            backend_free_frame(addr);
+            spin_unlock(&frame_lock);
+        }
+        irq_restore(flags);
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&frame_lock);
+#ifdef FRAME_ALLOCATOR_BUDDY
+    buddy_free(addr, buddy_order_for(count));
+#else
+    bitmap_free_frames(addr, count);
+#endif
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+void frame_cache_set_enabled(int enabled) {
+    frame_caches_enabled = enabled;
+}
+
+// Cached frames are free too, just not in the backend
+uint32_t frame_allocator_free_count() {
+    uint32_t cached = 0;
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        cached += frame_caches[i].count;
+    }
+#ifdef FRAME_ALLOCATOR_BUDDY
+    return buddy_free_count() + cached;
+#else
+    return bitmap_free_count() + cached;
+#endif
+}
+
+uint32_t frame_allocator_total_count() {
+    return num_frames;
+}
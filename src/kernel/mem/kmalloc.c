@@ -1,25 +1,100 @@
 #include "../include/kmalloc.h"
 #include "../include/types.h"
 #include "../include/frame_allocator.h"
+#include "../include/slab.h"
+#include "../include/spinlock.h"
 
 #define PAGE_SIZE 4096
 
+// Small requests go to power-of-two slab caches from 16 bytes up to 2KB. Page-sized
+// requests take a frame: kfree() tells those apart by their being page aligned.
+#define MIN_SIZE_CLASS_SHIFT 4
+#define NUM_SIZE_CLASSES 8
+#define MAX_SIZE_CLASS (1 << (MIN_SIZE_CLASS_SHIFT + NUM_SIZE_CLASSES - 1))
+
+static const char *size_class_names[NUM_SIZE_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+static kmem_cache_t *size_caches[NUM_SIZE_CLASSES];
+
+// Multi-page allocations start with a header holding the run length, so kfree() can
+// release the whole run. Like a slab header it is recognized by magic and self, and the
+// data after it is not page aligned either.
+#define LARGE_MAGIC 0x1A26E000
+
+typedef struct {
+    uint32_t magic;
+    void *self;
+    uint32_t num_pages;
+    uint32_t reserved; // Keeps the data 16-byte aligned
+} large_header_t;
+
+// Guards size_caches creation; the caches have their own locks
+static spinlock_t kmalloc_lock = SPINLOCK_INIT;
+
+// Cache for a small request, created the first time its size class is used
+static kmem_cache_t *size_class_cache(uint32_t size) {
+    uint32_t index = 0;
+    while ((1u << (index + MIN_SIZE_CLASS_SHIFT)) < size) {
+        index++;
+    }
+    if (size_caches[index] == 0) {
+        uint32_t flags = spin_lock_irqsave(&kmalloc_lock);
+        if (size_caches[index] == 0) {
+            uint32_t class_size = 1 << (index + MIN_SIZE_CLASS_SHIFT);
+            size_caches[index] = kmem_cache_create(size_class_names[index], class_size, 8);
+        }
+        spin_unlock_irqrestore(&kmalloc_lock, flags);
+    }
+    return size_caches[index];
+}
+
 void *kmalloc(uint32_t size) {
+    if (size == 0 || size > 0xFFFFFFFF - PAGE_SIZE - sizeof(large_header_t)) {
+        return (void *)0;
+    }
+    if (size <= MAX_SIZE_CLASS) {
+        kmem_cache_t *cache = size_class_cache(size);
+        return cache ? kmem_cache_alloc(cache) : (void *)0;
+    }
     uint32_t num_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
-    uint32_t addr = 0;
+    if (num_pages == 1) {
+        return (void *)alloc_frame();
+    }
 
-    for (uint32_t i = 0; i < num_pages; i++) {
-        uint32_t frame_addr = alloc_frame();
-        if (frame_addr == 0) {
-            return (void *)0;
-        }
-        if (i == 0) {
-            addr = frame_addr;
-        }
+    num_pages = (size + sizeof(large_header_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    large_header_t *header = (large_header_t *)alloc_frames(num_pages, PAGE_SIZE);
+    if (header == 0) {
+        return (void *)0;
     }
-    return (void *)addr;
+    header->magic = LARGE_MAGIC;
+    header->self = header;
+    header->num_pages = num_pages;
+    return header + 1;
 }
 
 void kfree(void *ptr) {
-    free_frame((uint32_t)ptr);
+    uint32_t addr = (uint32_t)ptr;
+    if (addr == 0) {
+        return;
+    }
+    if (addr & (PAGE_SIZE - 1)) {
+        // A multi-page run's header sits right before the data; otherwise the slab
+        // header at the start of the page names the cache
+        large_header_t *header = (large_header_t *)ptr - 1;
+        if ((addr & (PAGE_SIZE - 1)) == sizeof(large_header_t) &&
+            header->magic == LARGE_MAGIC && header->self == header) {
+            header->magic = 0;
+            free_frames((uint32_t)header, header->num_pages);
+            return;
+        }
+        kmem_cache_t *cache = kmem_cache_of(ptr);
+        if (cache) {
+            kmem_cache_free(cache, ptr);
+        }
+        return;
+    }
+    free_frame(addr);
 }
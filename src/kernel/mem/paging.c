@@ -1,34 +1,63 @@
 #include "../include/paging.h"
-#include "../main/kmain.h" // For print_string
 #include "../include/frame_allocator.h" // For alloc_frame
+#include "../include/cpu.h"
+#include "../include/zero_pool.h"
+#include "../include/kstring.h"
+#include "../include/smp.h"
+#include "../include/spinlock.h"
+
+#define PAGE_SIZE 4096
+#define LARGE_PAGE_SIZE 0x400000
+
+#define TLB_BATCH_MAX TLB_FLUSH_THRESHOLD
 
 // Page directory and page tables
 static PAGE_DIRECTORY_ENTRY page_directory[1024] __attribute__((aligned(4096)));
 static PAGE_TABLE_ENTRY first_page_table[1024] __attribute__((aligned(4096)));
 
+static int pse_enabled; // CR4.PSE set: page directory entries may map 4MB pages
+static int pge_enabled; // CR4.PGE set: global mappings survive CR3 reloads
+static uint32_t direct_map_end;
+
 // Function to initialize paging
 void init_paging() {
-    // Initialize page directory
-    for (int i = 0; i < 1024; i++) {
-        page_directory[i].present = 0;
-        page_directory[i].rw = 1; // Allow writes
-        page_directory[i].user = 0; // Kernel-mode only
-        page_directory[i].frame = 0;
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    if (edx & CPUID_EDX_PSE) {
+        cr4 |= CR4_PSE;
+        pse_enabled = 1;
     }
-
-    // Map the first 4MB of virtual memory to the first 4MB of physical memory
-    for (int i = 0; i < 1024; i++) {
-        first_page_table[i].present = 1;
-        first_page_table[i].rw = 1;
-        first_page_table[i].user = 0;
-        first_page_table[i].frame = i; // Identity mapping
+    if (edx & CPUID_EDX_PGE) {
+        cr4 |= CR4_PGE;
+        pge_enabled = 1;
     }
+    asm volatile("mov %0, %%cr4" :: "r"(cr4));
+
+    // Initialize page directory
+    memset(page_directory, 0, sizeof(PAGE_DIRECTORY_ENTRY) * 1024);
+
+    // Map the first 4MB of virtual memory to the first 4MB of physical memory,
+    // with a single global 4MB page when the CPU supports it
+    if (pse_enabled) {
+        map_range(0, 0, LARGE_PAGE_SIZE, PAGE_RW | PAGE_GLOBAL);
+    } else {
+        for (int i = 0; i < 1024; i++) {
+            first_page_table[i].present = 1;
+            first_page_table[i].rw = 1;
+            first_page_table[i].user = 0;
+            first_page_table[i].global = pge_enabled;
+            first_page_table[i].frame = i; // Identity mapping
+        }
 
-    // Add the first page table to the page directory
-    page_directory[0].present = 1;
-    page_directory[0].rw = 1;
-    page_directory[0].user = 0;
-    page_directory[0].frame = (uint32_t)first_page_table >> 12; // Address of the page table
+        // Add the first page table to the page directory
+        page_directory[0].present = 1;
+        page_directory[0].rw = 1;
+        page_directory[0].user = 0;
+        page_directory[0].frame = (uint32_t)first_page_table >> 12; // Address of the page table
+    }
+    direct_map_end = LARGE_PAGE_SIZE;
 
     // Load the page directory into the CR3 register
     asm volatile("mov %0, %%cr3" :: "r"(page_directory));
@@ -37,43 +66,393 @@ void init_paging() {
     uint32_t cr0;
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
     cr0 |= 0x80000000; // Set PG bit
+    cr0 |= 0x00010000; // Set WP bit: read-only pages fault on kernel writes too
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
 }
 
+void init_direct_map(uint32_t ram_end) {
+    if (ram_end > DIRECT_MAP_LIMIT) {
+        ram_end = DIRECT_MAP_LIMIT;
+    }
+    if (!pse_enabled || ram_end <= direct_map_end) {
+        return; // Without large pages the page tables would not be reachable yet
+    }
+    // Round up to a whole large page; mapping a hole past the end of RAM is harmless
+    uint32_t end = (ram_end + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    if (end == 0 || end > DIRECT_MAP_LIMIT) {
+        end = DIRECT_MAP_LIMIT;
+    }
+    map_range(direct_map_end, direct_map_end, end - direct_map_end, PAGE_RW | PAGE_GLOBAL);
+    direct_map_end = end;
+}
+
+uint32_t paging_direct_map_end() {
+    return direct_map_end;
+}
+
+int paging_large_pages_enabled() {
+    return pse_enabled;
+}
+
+// Serializes the page table writers: map_range(), unmap_range(), protect_range() and the
+// table creation and splitting they do. Interrupts stay off while it is held, so a
+// preempted thread cannot leave a half-made change behind. The owner may take it again,
+// for a page fault inside a range call. The TLB batch is flushed after it is released:
+// a CPU spinning on it with interrupts off could not answer the shootdown.
+#define PAGING_NO_OWNER 0xFFFFFFFF
+
+static spinlock_t paging_lock = SPINLOCK_INIT;
+static volatile uint32_t paging_lock_owner = PAGING_NO_OWNER; // CPU id
+static uint32_t paging_lock_depth;
+
+static uint32_t paging_lock_acquire() {
+    uint32_t flags = irq_save();
+    uint32_t self = this_cpu()->id;
+    if (paging_lock_owner != self) {
+        spin_lock(&paging_lock);
+        paging_lock_owner = self;
+    }
+    paging_lock_depth++;
+    return flags;
+}
+
+static void paging_lock_release(uint32_t flags) {
+    if (--paging_lock_depth == 0) {
+        paging_lock_owner = PAGING_NO_OWNER;
+        spin_unlock(&paging_lock);
+    }
+    irq_restore(flags);
+}
+
+// Pending TLB invalidations of one range call, kept on its stack so that a nested call
+// (a page fault while a table is set up) cannot flush or reset a batch it did not fill.
+// Only entries that were present before are queued: x86 never caches not-present
+// translations.
+typedef struct {
+    uint32_t addresses[TLB_BATCH_MAX];
+    uint32_t count;
+    int global;
+} tlb_batch_t;
+
+static void tlb_queue(tlb_batch_t *batch, uint32_t virtual_address, int global) {
+    if (batch->count < TLB_BATCH_MAX) {
+        batch->addresses[batch->count] = virtual_address;
+    }
+    batch->count++;
+    batch->global |= global;
+}
+
+void tlb_invalidate(const uint32_t *addresses, uint32_t count, int global) {
+    if (count > TLB_FLUSH_THRESHOLD) {
+        if (global) {
+            // Global entries survive a CR3 reload; toggling CR4.PGE drops them too
+            uint32_t cr4;
+            asm volatile("mov %%cr4, %0" : "=r"(cr4));
+            asm volatile("mov %0, %%cr4" :: "r"(cr4 & ~CR4_PGE) : "memory");
+            asm volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+        } else {
+            uint32_t cr3;
+            asm volatile("mov %%cr3, %0" : "=r"(cr3));
+            asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+        }
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            asm volatile("invlpg (%0)" :: "r"(addresses[i]) : "memory");
+        }
+    }
+}
+
+// Flush the batch here and on every other CPU, whose TLBs may hold the same entries
+static void tlb_flush_batch(tlb_batch_t *batch) {
+    tlb_invalidate(batch->addresses, batch->count, batch->global);
+    smp_tlb_shootdown(batch->addresses, batch->count, batch->global);
+    batch->count = 0;
+    batch->global = 0;
+}
+
+// Replace a 4MB mapping with a page table holding the same 1024 mappings, with the same
+// caching. The page size and the directory entry's bits change, and Intel asks for an
+// invalidation then, so the old 4MB translation is queued on the batch.
+static int split_large_page(uint32_t pd_index, tlb_batch_t *batch) {
+    uint32_t new_pt_addr = alloc_frame();
+    if (new_pt_addr == 0) {
+        return 0;
+    }
+    PAGE_DIRECTORY_ENTRY *pde = &page_directory[pd_index];
+    PAGE_TABLE_ENTRY *new_pt = (PAGE_TABLE_ENTRY *)(new_pt_addr);
+    for (int i = 0; i < 1024; i++) {
+        *(uint32_t *)&new_pt[i] = 0;
+        new_pt[i].present = 1;
+        new_pt[i].rw = pde->rw;
+        new_pt[i].user = pde->user;
+        new_pt[i].pwt = pde->pwt;
+        new_pt[i].pcd = pde->pcd;
+        new_pt[i].global = pde->global;
+        new_pt[i].frame = pde->frame + i;
+    }
+    tlb_queue(batch, pd_index << 22, pde->global);
+    pde->page_size = 0;
+    pde->global = 0;
+    pde->rw = 1;
+    pde->user = 1; // Per-page user bits decide
+    pde->frame = new_pt_addr >> 12;
+    return 1;
+}
+
+// Give a page directory slot an empty page table
+static int create_page_table(uint32_t pd_index) {
+    // Allocate a new, already zeroed page table
+    uint32_t new_pt_addr = alloc_zeroed_frame();
+    if (new_pt_addr == 0) {
+        // Out of memory for new page table!
+        return 0;
+    }
+
+    *(uint32_t *)&page_directory[pd_index] = 0;
+    page_directory[pd_index].present = 1;
+    page_directory[pd_index].rw = 1;
+    page_directory[pd_index].user = 1; // Per-page user bits decide
+    page_directory[pd_index].frame = new_pt_addr >> 12;
+    return 1;
+}
+
+static inline PAGE_TABLE_ENTRY *page_table_of(uint32_t pd_index) {
+    return (PAGE_TABLE_ENTRY *)(page_directory[pd_index].frame << 12);
+}
+
+// Number of bytes from virtual_address to the end of its 4MB span, capped at remaining
+static inline uint32_t span_bytes(uint32_t virtual_address, uint32_t remaining) {
+    uint32_t span = LARGE_PAGE_SIZE - (virtual_address & (LARGE_PAGE_SIZE - 1));
+    return span < remaining ? span : remaining;
+}
+
+static inline int is_large_span(uint32_t virtual_address, uint32_t physical_address, uint32_t remaining) {
+    return pse_enabled &&
+           (virtual_address & (LARGE_PAGE_SIZE - 1)) == 0 &&
+           (physical_address & (LARGE_PAGE_SIZE - 1)) == 0 &&
+           remaining >= LARGE_PAGE_SIZE;
+}
+
 // Function to map a virtual address to a physical address
 void map_page(uint32_t virtual_address, uint32_t physical_address) {
-    uint32_t pd_index = virtual_address >> 22;
-    uint32_t pt_index = (virtual_address >> 12) & 0x3FF;
-
-    // Check if the page table is present
-    if (!page_directory[pd_index].present) {
-        // Allocate a new page table
-        uint32_t new_pt_addr = alloc_frame();
-        if (new_pt_addr == 0) {
-            // Out of memory for new page table!
-            return;
+    map_range(virtual_address, physical_address, PAGE_SIZE, PAGE_RW);
+}
+
+static int map_range_locked(uint32_t virtual_address, uint32_t physical_address, uint32_t size,
+                            uint32_t flags, tlb_batch_t *batch) {
+    uint32_t remaining = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t global = pge_enabled && (flags & PAGE_GLOBAL);
+
+    // First pass: make sure every span that needs 4KB entries has a page table, so a
+    // failed allocation leaves the existing mappings untouched. A span that will be a
+    // 4MB page keeps no page table. Existing 4MB pages are split only where a partial
+    // span must be mapped inside them.
+    uint32_t v = virtual_address, p = physical_address, left = remaining;
+    while (left > 0) {
+        uint32_t pd_index = v >> 22;
+        uint32_t span = span_bytes(v, left);
+        PAGE_DIRECTORY_ENTRY *pde = &page_directory[pd_index];
+        int large = is_large_span(v, p, left) && (!pde->present || pde->page_size);
+        if (!large) {
+            if (!pde->present) {
+                if (!create_page_table(pd_index)) {
+                    return -1;
+                }
+            } else if (pde->page_size) {
+                if (!split_large_page(pd_index, batch)) {
+                    return -1;
+                }
+            }
         }
-        page_directory[pd_index].present = 1;
-        page_directory[pd_index].rw = 1;
-        page_directory[pd_index].user = 0;
-        page_directory[pd_index].frame = new_pt_addr >> 12;
+        v += span;
+        p += span;
+        left -= span;
+    }
 
-        // Zero out the new page table
-        PAGE_TABLE_ENTRY *new_pt = (PAGE_TABLE_ENTRY *)(new_pt_addr);
-        for (int i = 0; i < 1024; i++) {
-            new_pt[i].present = 0;
+    // Second pass: one page directory lookup per 4MB span, then a tight PTE loop
+    while (remaining > 0) {
+        uint32_t pd_index = virtual_address >> 22;
+        uint32_t span = span_bytes(virtual_address, remaining);
+        PAGE_DIRECTORY_ENTRY *pde = &page_directory[pd_index];
+
+        if (pde->page_size || (!pde->present && is_large_span(virtual_address, physical_address, remaining))) {
+            if (pde->present) {
+                tlb_queue(batch, virtual_address, pde->global);
+            }
+            *(uint32_t *)pde = 0;
+            pde->present = 1;
+            pde->rw = (flags & PAGE_RW) != 0;
+            pde->user = (flags & PAGE_USER) != 0;
+            pde->pwt = (flags & PAGE_PWT) != 0;
+            pde->pcd = (flags & PAGE_PCD) != 0;
+            pde->page_size = 1;
+            pde->global = global;
+            pde->frame = physical_address >> 12;
+        } else {
+            PAGE_TABLE_ENTRY *page_table = page_table_of(pd_index);
+            uint32_t pt_index = (virtual_address >> 12) & 0x3FF;
+            for (uint32_t offset = 0; offset < span; offset += PAGE_SIZE, pt_index++) {
+                PAGE_TABLE_ENTRY *pte = &page_table[pt_index];
+                if (pte->present) {
+                    tlb_queue(batch, virtual_address + offset, pte->global);
+                }
+                *(uint32_t *)pte = 0;
+                pte->present = 1;
+                pte->rw = (flags & PAGE_RW) != 0;
+                pte->user = (flags & PAGE_USER) != 0;
+                pte->pwt = (flags & PAGE_PWT) != 0;
+                pte->pcd = (flags & PAGE_PCD) != 0;
+                pte->global = global;
+                pte->frame = (physical_address + offset) >> 12;
+            }
+        }
+        virtual_address += span;
+        physical_address += span;
+        remaining -= span;
+    }
+    return 0;
+}
+
+// Split every 4MB page the range covers only in part, before anything else changes.
+// Returns 0, or -1 if a page table could not be allocated; pages split so far map the
+// same memory as before.
+static int split_partial_large_pages(uint32_t virtual_address, uint32_t remaining, tlb_batch_t *batch) {
+    while (remaining > 0) {
+        uint32_t span = span_bytes(virtual_address, remaining);
+        PAGE_DIRECTORY_ENTRY *pde = &page_directory[virtual_address >> 22];
+        if (pde->present && pde->page_size && span < LARGE_PAGE_SIZE && !split_large_page(virtual_address >> 22, batch)) {
+            return -1;
+        }
+        virtual_address += span;
+        remaining -= span;
+    }
+    return 0;
+}
+
+static int unmap_range_locked(uint32_t virtual_address, uint32_t size, tlb_batch_t *batch) {
+    uint32_t remaining = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (split_partial_large_pages(virtual_address, remaining, batch) != 0) {
+        return -1;
+    }
+    while (remaining > 0) {
+        uint32_t pd_index = virtual_address >> 22;
+        uint32_t span = span_bytes(virtual_address, remaining);
+        PAGE_DIRECTORY_ENTRY *pde = &page_directory[pd_index];
+
+        if (pde->present && pde->page_size) {
+            tlb_queue(batch, virtual_address, pde->global);
+            *(uint32_t *)pde = 0;
+        } else if (pde->present) {
+            PAGE_TABLE_ENTRY *page_table = page_table_of(pd_index);
+            uint32_t pt_index = (virtual_address >> 12) & 0x3FF;
+            for (uint32_t offset = 0; offset < span; offset += PAGE_SIZE, pt_index++) {
+                PAGE_TABLE_ENTRY *pte = &page_table[pt_index];
+                if (pte->present) {
+                    tlb_queue(batch, virtual_address + offset, pte->global);
+                    *(uint32_t *)pte = 0;
+                }
+            }
+        }
+        virtual_address += span;
+        remaining -= span;
+    }
+    return 0;
+}
+
+static int protect_range_locked(uint32_t virtual_address, uint32_t size, uint32_t flags, tlb_batch_t *batch) {
+    uint32_t remaining = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t global = pge_enabled && (flags & PAGE_GLOBAL);
+    if (split_partial_large_pages(virtual_address, remaining, batch) != 0) {
+        return -1;
+    }
+    while (remaining > 0) {
+        uint32_t pd_index = virtual_address >> 22;
+        uint32_t span = span_bytes(virtual_address, remaining);
+        PAGE_DIRECTORY_ENTRY *pde = &page_directory[pd_index];
+
+        if (pde->present && pde->page_size) {
+            tlb_queue(batch, virtual_address, pde->global);
+            pde->rw = (flags & PAGE_RW) != 0;
+            pde->user = (flags & PAGE_USER) != 0;
+            pde->global = global;
+        } else if (pde->present) {
+            PAGE_TABLE_ENTRY *page_table = page_table_of(pd_index);
+            uint32_t pt_index = (virtual_address >> 12) & 0x3FF;
+            for (uint32_t offset = 0; offset < span; offset += PAGE_SIZE, pt_index++) {
+                PAGE_TABLE_ENTRY *pte = &page_table[pt_index];
+                if (pte->present) {
+                    tlb_queue(batch, virtual_address + offset, pte->global);
+                    pte->rw = (flags & PAGE_RW) != 0;
+                    pte->user = (flags & PAGE_USER) != 0;
+                    pte->global = global;
+                }
+            }
         }
+        virtual_address += span;
+        remaining -= span;
     }
+    return 0;
+}
 
-    // Get the page table
-    PAGE_TABLE_ENTRY *page_table = (PAGE_TABLE_ENTRY *)(page_directory[pd_index].frame << 12);
+int map_range(uint32_t virtual_address, uint32_t physical_address, uint32_t size, uint32_t flags) {
+    tlb_batch_t batch = { .count = 0, .global = 0 };
+    uint32_t irq_flags = paging_lock_acquire();
+    int result = map_range_locked(virtual_address, physical_address, size, flags, &batch);
+    paging_lock_release(irq_flags);
+    tlb_flush_batch(&batch);
+    return result;
+}
 
-    // Map the page
-    page_table[pt_index].present = 1;
-    page_table[pt_index].rw = 1;
-    page_table[pt_index].user = 0;
-    page_table[pt_index].frame = physical_address >> 12;
+int unmap_range(uint32_t virtual_address, uint32_t size) {
+    tlb_batch_t batch = { .count = 0, .global = 0 };
+    uint32_t irq_flags = paging_lock_acquire();
+    int result = unmap_range_locked(virtual_address, size, &batch);
+    paging_lock_release(irq_flags);
+    tlb_flush_batch(&batch);
+    return result;
+}
 
-    // Invalidate TLB for the mapped virtual address
-    asm volatile("invlpg (%0)" :: "r"(virtual_address));
+int protect_range(uint32_t virtual_address, uint32_t size, uint32_t flags) {
+    tlb_batch_t batch = { .count = 0, .global = 0 };
+    uint32_t irq_flags = paging_lock_acquire();
+    int result = protect_range_locked(virtual_address, size, flags, &batch);
+    paging_lock_release(irq_flags);
+    tlb_flush_batch(&batch);
+    return result;
+}
+
+int unmap_page(uint32_t virtual_address) {
+    return unmap_range(virtual_address & ~(PAGE_SIZE - 1), PAGE_SIZE);
+}
+
+uint32_t get_physical_address(uint32_t virtual_address) {
+    PAGE_DIRECTORY_ENTRY *pde = &page_directory[virtual_address >> 22];
+    if (!pde->present) {
+        return 0;
+    }
+    if (pde->page_size) {
+        return (pde->frame << 12) + (virtual_address & (LARGE_PAGE_SIZE - 1));
+    }
+    PAGE_TABLE_ENTRY *pte = &page_table_of(virtual_address >> 22)[(virtual_address >> 12) & 0x3FF];
+    if (!pte->present) {
+        return 0;
+    }
+    return (pte->frame << 12) + (virtual_address & (PAGE_SIZE - 1));
+}
+
+uint32_t get_page_flags(uint32_t virtual_address) {
+    PAGE_DIRECTORY_ENTRY *pde = &page_directory[virtual_address >> 22];
+    if (!pde->present) {
+        return 0;
+    }
+    uint32_t flags = PAGE_PRESENT | (pde->rw ? PAGE_RW : 0) | (pde->user ? PAGE_USER : 0);
+    if (pde->page_size) {
+        return flags;
+    }
+    PAGE_TABLE_ENTRY *pte = &page_table_of(virtual_address >> 22)[(virtual_address >> 12) & 0x3FF];
+    if (!pte->present) {
+        return 0;
+    }
+    // Both levels must allow an access
+    return flags & (PAGE_PRESENT | (pte->rw ? PAGE_RW : 0) | (pte->user ? PAGE_USER : 0));
 }
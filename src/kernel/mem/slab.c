@@ -0,0 +1,219 @@
+#include "../include/slab.h"
+#include "../include/types.h"
+#include "../include/frame_allocator.h"
+#include "../include/paging.h"
+#include "../include/spinlock.h"
+
+#define PAGE_SIZE 4096
+#define SLAB_MAGIC 0x51AB51AB
+
+// Header at the start of every slab. Free objects are chained through their own
+// first word, so the only per-slab metadata is this header. self makes object data
+// at the start of a page within a large slab unlikely to pass for a header.
+struct slab {
+    uint32_t magic;
+    slab_t *self;
+    kmem_cache_t *cache;
+    slab_t *next;
+    slab_t *prev;
+    void *free_list;
+    uint32_t in_use;
+};
+
+// Caches themselves come from a statically set up cache of kmem_cache_t objects
+static kmem_cache_t cache_cache = {
+    .name = "kmem_cache",
+    .object_size = (sizeof(kmem_cache_t) + 7) & ~7,
+    .first_offset = (sizeof(slab_t) + 7) & ~7,
+    .objects_per_slab = (PAGE_SIZE - ((sizeof(slab_t) + 7) & ~7)) / ((sizeof(kmem_cache_t) + 7) & ~7),
+    .slab_pages = 1,
+    .lock = SPINLOCK_INIT,
+};
+
+static void list_push(slab_t **head, slab_t *slab) {
+    slab->prev = 0;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void list_remove(slab_t **head, slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = slab->prev = 0;
+}
+
+static inline int is_slab_header(slab_t *slab) {
+    return slab->magic == SLAB_MAGIC && slab->self == slab;
+}
+
+// Slabs are aligned to their size, so masking an object's address finds the header
+static inline slab_t *slab_of(kmem_cache_t *cache, void *obj) {
+    return (slab_t *)((uint32_t)obj & ~(cache->slab_pages * PAGE_SIZE - 1));
+}
+
+static slab_t *slab_create(kmem_cache_t *cache) {
+    uint32_t frame = alloc_frames(cache->slab_pages, cache->slab_pages * PAGE_SIZE);
+    if (frame == 0) {
+        return 0;
+    }
+    for (uint32_t page = 0; page < cache->slab_pages; page++) {
+        if (frame + page * PAGE_SIZE >= paging_direct_map_end()) {
+            // Slab pages are written through their physical address
+            map_page(frame + page * PAGE_SIZE, frame + page * PAGE_SIZE);
+        }
+    }
+
+    slab_t *slab = (slab_t *)frame;
+    slab->magic = SLAB_MAGIC;
+    slab->self = slab;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->next = slab->prev = 0;
+
+    // Thread the free list through the objects, lowest address first
+    uint8_t *obj = (uint8_t *)frame + cache->first_offset;
+    slab->free_list = obj;
+    for (uint32_t i = 0; i + 1 < cache->objects_per_slab; i++) {
+        *(void **)obj = obj + cache->object_size;
+        obj += cache->object_size;
+    }
+    *(void **)obj = 0;
+
+    cache->num_slabs++;
+    return slab;
+}
+
+static void slab_release(kmem_cache_t *cache, slab_t *slab) {
+    slab->magic = 0;
+    cache->num_slabs--;
+    free_frames((uint32_t)slab, cache->slab_pages);
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, uint32_t size, uint32_t align) {
+    if (align < sizeof(void *)) {
+        align = sizeof(void *);
+    }
+    size = (size + align - 1) & ~(align - 1);
+    if (size == 0 || size > SLAB_MAX_OBJECT_SIZE) {
+        return 0;
+    }
+
+    kmem_cache_t *cache = (kmem_cache_t *)kmem_cache_alloc(&cache_cache);
+    if (cache == 0) {
+        return 0;
+    }
+    cache->name = name;
+    cache->object_size = size;
+    cache->slab_pages = size >= SLAB_LARGE_OBJECT ? SLAB_LARGE_PAGES : 1;
+    cache->first_offset = (sizeof(slab_t) + align - 1) & ~(align - 1);
+    cache->objects_per_slab = (cache->slab_pages * PAGE_SIZE - cache->first_offset) / size;
+    cache->partial = cache->full = cache->empty = 0;
+    cache->active_objects = 0;
+    cache->num_slabs = 0;
+    cache->lock = (spinlock_t)SPINLOCK_INIT;
+    return cache;
+}
+
+void kmem_cache_destroy(kmem_cache_t *cache) {
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    while (cache->partial) {
+        slab_t *slab = cache->partial;
+        list_remove(&cache->partial, slab);
+        slab_release(cache, slab);
+    }
+    if (cache->empty) {
+        slab_release(cache, cache->empty);
+        cache->empty = 0;
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+    kmem_cache_free(&cache_cache, cache);
+}
+
+static void *cache_alloc(kmem_cache_t *cache) {
+    slab_t *slab = cache->partial;
+    if (slab == 0) {
+        slab = cache->empty;
+        if (slab != 0) {
+            cache->empty = 0;
+        } else {
+            slab = slab_create(cache);
+            if (slab == 0) {
+                return 0;
+            }
+        }
+        list_push(&cache->partial, slab);
+    }
+
+    void *obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+    slab->in_use++;
+    cache->active_objects++;
+    if (slab->free_list == 0) {
+        list_remove(&cache->partial, slab);
+        list_push(&cache->full, slab);
+    }
+    return obj;
+}
+
+static void cache_free(kmem_cache_t *cache, void *obj) {
+    slab_t *slab = slab_of(cache, obj);
+    if (!is_slab_header(slab) || slab->cache != cache) {
+        return; // Not an object of this cache
+    }
+
+    if (slab->free_list == 0) {
+        list_remove(&cache->full, slab);
+        list_push(&cache->partial, slab);
+    }
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->active_objects--;
+
+    // Keep one empty slab around to absorb alloc/free ping-pong, release the rest
+    if (slab->in_use == 0) {
+        list_remove(&cache->partial, slab);
+        if (cache->empty == 0) {
+            cache->empty = slab;
+        } else {
+            slab_release(cache, slab);
+        }
+    }
+}
+
+// Each cache has its own lock, so CPUs working on different caches do not contend
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    void *obj = cache_alloc(cache);
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    cache_free(cache, obj);
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+// The header is at the start of the object's page for a one-page slab, or at the
+// start of the SLAB_LARGE_PAGES run holding it otherwise
+kmem_cache_t *kmem_cache_of(void *obj) {
+    slab_t *slab = (slab_t *)((uint32_t)obj & ~(PAGE_SIZE - 1));
+    if ((uint32_t)obj != (uint32_t)slab && is_slab_header(slab) && slab->cache->slab_pages == 1) {
+        return slab->cache;
+    }
+    slab = (slab_t *)((uint32_t)obj & ~(SLAB_LARGE_PAGES * PAGE_SIZE - 1));
+    if ((uint32_t)obj != (uint32_t)slab && is_slab_header(slab) && slab->cache->slab_pages == SLAB_LARGE_PAGES) {
+        return slab->cache;
+    }
+    return 0;
+}
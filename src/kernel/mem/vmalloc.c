@@ -0,0 +1,271 @@
+#include "../include/vmalloc.h"
+#include "../include/types.h"
+#include "../include/frame_allocator.h"
+#include "../include/paging.h"
+#include "../include/slab.h"
+#include "../include/spinlock.h"
+
+#define PAGE_SIZE 4096
+
+// Busy virtual ranges live in an AVL tree keyed by start address,
+// so vfree() finds its range in O(log n)
+typedef struct vm_area {
+    uint32_t start;
+    uint32_t size;  // Mapped bytes, without the guard pages
+    uint32_t span;  // Reserved bytes, including the guard pages
+    int io;         // Set for ioremap() ranges, whose frames are not ours to free
+    struct vm_area *left;
+    struct vm_area *right;
+    int height;
+} vm_area_t;
+
+static vm_area_t *vm_root;
+static kmem_cache_t *vm_area_cache;
+static uint32_t vmalloc_cursor = VMALLOC_START; // End of the highest busy range
+
+// Guards vm_root and vmalloc_cursor. Frames are mapped and unmapped outside it: a range
+// stays in the tree from reservation until it is unmapped, so no one else is handed it.
+static spinlock_t vmalloc_lock = SPINLOCK_INIT;
+
+static int height(vm_area_t *node) {
+    return node ? node->height : 0;
+}
+
+static void update_height(vm_area_t *node) {
+    int left = height(node->left);
+    int right = height(node->right);
+    node->height = (left > right ? left : right) + 1;
+}
+
+static vm_area_t *rotate_right(vm_area_t *node) {
+    vm_area_t *pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static vm_area_t *rotate_left(vm_area_t *node) {
+    vm_area_t *pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static vm_area_t *rebalance(vm_area_t *node) {
+    update_height(node);
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1) {
+        if (height(node->left->left) < height(node->left->right)) {
+            node->left = rotate_left(node->left);
+        }
+        return rotate_right(node);
+    }
+    if (balance < -1) {
+        if (height(node->right->right) < height(node->right->left)) {
+            node->right = rotate_right(node->right);
+        }
+        return rotate_left(node);
+    }
+    return node;
+}
+
+static vm_area_t *tree_insert(vm_area_t *node, vm_area_t *area) {
+    if (node == 0) {
+        return area;
+    }
+    if (area->start < node->start) {
+        node->left = tree_insert(node->left, area);
+    } else {
+        node->right = tree_insert(node->right, area);
+    }
+    return rebalance(node);
+}
+
+// Unlink the smallest node of a subtree, returning the new subtree root
+static vm_area_t *tree_remove_min(vm_area_t *node, vm_area_t **min) {
+    if (node->left == 0) {
+        *min = node;
+        return node->right;
+    }
+    node->left = tree_remove_min(node->left, min);
+    return rebalance(node);
+}
+
+static vm_area_t *tree_remove(vm_area_t *node, uint32_t start, vm_area_t **removed) {
+    if (node == 0) {
+        return 0;
+    }
+    if (start < node->start) {
+        node->left = tree_remove(node->left, start, removed);
+    } else if (start > node->start) {
+        node->right = tree_remove(node->right, start, removed);
+    } else {
+        *removed = node;
+        if (node->left == 0) {
+            return node->right;
+        }
+        if (node->right == 0) {
+            return node->left;
+        }
+        vm_area_t *successor;
+        vm_area_t *right = tree_remove_min(node->right, &successor);
+        successor->left = node->left;
+        successor->right = right;
+        return rebalance(successor);
+    }
+    return rebalance(node);
+}
+
+static vm_area_t *tree_find(vm_area_t *node, uint32_t start) {
+    while (node != 0 && node->start != start) {
+        node = start < node->start ? node->left : node->right;
+    }
+    return node;
+}
+
+// First gap of at least span bytes between busy ranges, in address order
+static uint32_t find_gap(vm_area_t *node, uint32_t *prev_end, uint32_t span) {
+    if (node == 0) {
+        return 0;
+    }
+    uint32_t found = find_gap(node->left, prev_end, span);
+    if (found) {
+        return found;
+    }
+    if (node->start - *prev_end >= span) {
+        return *prev_end;
+    }
+    *prev_end = node->start + node->span;
+    return find_gap(node->right, prev_end, span);
+}
+
+static uint32_t reserve_virtual(uint32_t span) {
+    // Common case: bump past the highest range; otherwise reuse a freed gap
+    if (VMALLOC_END - vmalloc_cursor >= span) {
+        uint32_t start = vmalloc_cursor;
+        vmalloc_cursor += span;
+        return start;
+    }
+    uint32_t prev_end = VMALLOC_START;
+    uint32_t start = find_gap(vm_root, &prev_end, span);
+    if (start == 0 && VMALLOC_END - prev_end >= span) {
+        start = prev_end;
+    }
+    return start;
+}
+
+// Reserve virtual space for mapped bytes plus the guard pages and record it in the tree.
+// Returns 0 if the window or the vm_area cache is out of space.
+static vm_area_t *reserve_area(uint32_t mapped, int io) {
+    if (vm_area_cache == 0) {
+        uint32_t flags = spin_lock_irqsave(&vmalloc_lock);
+        if (vm_area_cache == 0) {
+            vm_area_cache = kmem_cache_create("vm_area", sizeof(vm_area_t), 4);
+        }
+        spin_unlock_irqrestore(&vmalloc_lock, flags);
+        if (vm_area_cache == 0) {
+            return 0;
+        }
+    }
+    vm_area_t *area = (vm_area_t *)kmem_cache_alloc(vm_area_cache);
+    if (area == 0) {
+        return 0;
+    }
+    uint32_t span = mapped + VMALLOC_GUARD_PAGES * PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&vmalloc_lock);
+    uint32_t start = reserve_virtual(span);
+    if (start == 0) {
+        spin_unlock_irqrestore(&vmalloc_lock, flags);
+        kmem_cache_free(vm_area_cache, area);
+        return 0;
+    }
+    area->start = start;
+    area->size = mapped;
+    area->span = span;
+    area->io = io;
+    area->left = area->right = 0;
+    area->height = 1;
+    vm_root = tree_insert(vm_root, area);
+    spin_unlock_irqrestore(&vmalloc_lock, flags);
+    return area;
+}
+
+// Drop an area whose pages are already unmapped, giving its space back
+static void release_area(vm_area_t *area) {
+    vm_area_t *removed = 0;
+    uint32_t flags = spin_lock_irqsave(&vmalloc_lock);
+    vm_root = tree_remove(vm_root, area->start, &removed);
+    if (area->start + area->span == vmalloc_cursor) {
+        vmalloc_cursor = area->start;
+    }
+    spin_unlock_irqrestore(&vmalloc_lock, flags);
+    kmem_cache_free(vm_area_cache, area);
+}
+
+void *vmalloc(uint32_t size) {
+    if (size == 0 || size > VMALLOC_END - VMALLOC_START) {
+        return 0;
+    }
+    uint32_t mapped = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    vm_area_t *area = reserve_area(mapped, 0);
+    if (area == 0) {
+        return 0;
+    }
+    uint32_t start = area->start;
+
+    // Back each page with whatever frame is free; contiguity is only virtual
+    for (uint32_t offset = 0; offset < mapped; offset += PAGE_SIZE) {
+        uint32_t frame = alloc_frame();
+        if (frame == 0 || map_range(start + offset, frame, PAGE_SIZE, PAGE_RW | PAGE_GLOBAL) != 0) {
+            if (frame != 0) {
+                free_frame(frame);
+            }
+            for (uint32_t undo = 0; undo < offset; undo += PAGE_SIZE) {
+                free_frame(get_physical_address(start + undo));
+            }
+            unmap_range(start, offset);
+            release_area(area);
+            return 0;
+        }
+    }
+    return (void *)start;
+}
+
+void vfree(void *ptr) {
+    uint32_t flags = spin_lock_irqsave(&vmalloc_lock);
+    vm_area_t *area = tree_find(vm_root, (uint32_t)ptr);
+    spin_unlock_irqrestore(&vmalloc_lock, flags);
+    if (area == 0) {
+        return;
+    }
+    for (uint32_t offset = 0; !area->io && offset < area->size; offset += PAGE_SIZE) {
+        free_frame(get_physical_address(area->start + offset));
+    }
+    unmap_range(area->start, area->size); // One TLB flush for the whole range
+    release_area(area);
+}
+
+void *ioremap(uint32_t physical_address, uint32_t size) {
+    uint32_t first = physical_address & ~(PAGE_SIZE - 1);
+    uint32_t mapped = (physical_address + size - first + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (size == 0 || mapped > VMALLOC_END - VMALLOC_START) {
+        return 0;
+    }
+    vm_area_t *area = reserve_area(mapped, 1);
+    if (area == 0) {
+        return 0;
+    }
+    if (map_range(area->start, first, mapped, PAGE_RW | PAGE_GLOBAL | PAGE_PCD | PAGE_PWT) != 0) {
+        release_area(area);
+        return 0;
+    }
+    return (void *)(area->start + (physical_address - first));
+}
+
+void iounmap(void *ptr) {
+    vfree((void *)((uint32_t)ptr & ~(PAGE_SIZE - 1)));
+}
@@ -0,0 +1,78 @@
+#include "../include/zero_pool.h"
+#include "../include/types.h"
+#include "../include/frame_allocator.h"
+#include "../include/spinlock.h"
+#include "../include/kstring.h"
+
+#define PAGE_SIZE 4096
+
+static uint32_t pool[ZERO_POOL_SIZE];
+static uint32_t pool_count;
+static zero_pool_stats_t stats;
+
+// Guards pool, pool_count and stats. Page faults take frames too, so interrupts stay off
+// while it is held; the zeroing itself runs outside it.
+static spinlock_t pool_lock = SPINLOCK_INIT;
+
+// Frames are reachable through the direct map. rep stosd rather than memset(): the SSE2
+// variant's kernel_fpu_begin() costs more than it saves on one page.
+void zero_frame(uint32_t frame) {
+    memset_rep((void *)frame, 0, PAGE_SIZE);
+}
+
+uint32_t alloc_zeroed_frame() {
+    uint32_t flags = spin_lock_irqsave(&pool_lock);
+    if (pool_count > 0) {
+        uint32_t frame = pool[--pool_count];
+        stats.hits++;
+        spin_unlock_irqrestore(&pool_lock, flags);
+        return frame;
+    }
+    stats.misses++;
+    spin_unlock_irqrestore(&pool_lock, flags);
+
+    uint32_t frame = alloc_frame();
+    if (frame != 0) {
+        zero_frame(frame);
+    }
+    return frame;
+}
+
+uint32_t zero_pool_refill(uint32_t max_frames) {
+    uint32_t added = 0;
+    while (added < max_frames) {
+        // Only the slow part, the zeroing, runs without the lock and with interrupts enabled
+        uint32_t flags = spin_lock_irqsave(&pool_lock);
+        int room = pool_count < ZERO_POOL_SIZE;
+        spin_unlock_irqrestore(&pool_lock, flags);
+        uint32_t frame = room ? alloc_frame() : 0;
+        if (frame == 0) {
+            break;
+        }
+
+        // Pool frames wait until a fault takes them, so the zeroes need not stay cached
+        memzero_nontemporal((void *)frame, PAGE_SIZE);
+
+        flags = spin_lock_irqsave(&pool_lock);
+        if (pool_count < ZERO_POOL_SIZE) {
+            pool[pool_count++] = frame;
+            stats.refills++;
+            frame = 0;
+        }
+        spin_unlock_irqrestore(&pool_lock, flags);
+        if (frame != 0) {
+            free_frame(frame); // Pool filled up meanwhile
+            break;
+        }
+        added++;
+    }
+    return added;
+}
+
+uint32_t zero_pool_count() {
+    return pool_count;
+}
+
+zero_pool_stats_t zero_pool_stats() {
+    return stats;
+}
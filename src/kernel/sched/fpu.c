@@ -0,0 +1,147 @@
+#include "../include/fpu.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/idt.h"
+#include "../include/sched.h"
+#include "../include/percpu.h"
+#include "../include/printk.h"
+
+// Vector of the Device Not Available exception, raised by FPU/SSE instructions while
+// CR0.TS is set
+#define FPU_NM_VECTOR 7
+
+static int enabled;
+static fpu_stats_t stats;
+
+// Clean state for a thread's first FPU instruction: fninit defaults and MXCSR 0x1F80
+// (all SSE exceptions masked)
+static uint8_t initial_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+static inline void clts() {
+    __asm__ __volatile__ ("clts" ::: "memory");
+}
+
+// CR0 writes serialize the pipeline, so skip the ones that change nothing
+static inline void stts() {
+    uint32_t cr0;
+    __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (cr0));
+    if (!(cr0 & CR0_TS)) {
+        __asm__ __volatile__ ("mov %0, %%cr0" :: "r" (cr0 | CR0_TS) : "memory");
+    }
+}
+
+static inline void fxsave(uint8_t *state) {
+    __asm__ __volatile__ ("fxsave (%0)" :: "r" (state) : "memory");
+}
+
+static inline void fxrstor(const uint8_t *state) {
+    __asm__ __volatile__ ("fxrstor (%0)" :: "r" (state) : "memory");
+}
+
+// The registers hold the owner's state, if any: write it back to its thread
+static void save_owner(cpu_t *cpu) {
+    if (cpu->fpu_owner != 0) {
+        fxsave(cpu->fpu_owner->fpu_state);
+        cpu->fpu_owner = 0;
+        stats.saves++;
+    }
+}
+
+// The running thread used the FPU while another state (or none) was loaded. Entered
+// through an interrupt gate, so nothing else runs on this CPU meanwhile.
+static void fpu_trap(registers_t *regs, void *ctx) {
+    cpu_t *cpu = this_cpu();
+    thread_t *current = cpu->current;
+    clts();
+    stats.traps++;
+    if (current == 0 || cpu->fpu_owner == current) {
+        return; // No threads on this CPU (the APs), or TS was left set with the state loaded
+    }
+    save_owner(cpu);
+    fxrstor(current->fpu_used ? current->fpu_state : initial_state);
+    current->fpu_used = 1;
+    cpu->fpu_owner = current;
+    stats.restores++;
+}
+
+void fpu_init_cpu() {
+    uint32_t cr0, cr4;
+    __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (cr0));
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE; // wait/fwait honour TS too; x87 errors raise #MF, not IRQ 13
+    __asm__ __volatile__ ("mov %0, %%cr0" :: "r" (cr0));
+    __asm__ __volatile__ ("mov %%cr4, %0" : "=r" (cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ __volatile__ ("mov %0, %%cr4" :: "r" (cr4));
+    __asm__ __volatile__ ("fninit");
+}
+
+void init_fpu() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_FPU) || !(edx & CPUID_EDX_FXSR)) {
+        printk(KERN_WARNING, "No FXSAVE/FXRSTOR, FPU and SSE left disabled");
+        return;
+    }
+    fpu_init_cpu();
+    fxsave(initial_state);
+    register_irq_handler(FPU_NM_VECTOR, fpu_trap, 0);
+    enabled = 1;
+    printk(KERN_INFO, "FPU enabled (x87%s), thread state switched lazily", (edx & CPUID_EDX_SSE) ? ", SSE" : "");
+}
+
+int fpu_enabled() {
+    return enabled;
+}
+
+int kernel_fpu_begin() {
+    if (!enabled) {
+        return 0;
+    }
+    uint32_t flags = irq_save();
+    cpu_t *cpu = this_cpu();
+    if (cpu->fpu_in_kernel) {
+        irq_restore(flags); // An interrupt inside another section: its registers are live
+        return 0;
+    }
+    preempt_disable();
+    cpu->fpu_in_kernel = 1;
+    clts();
+    save_owner(cpu);
+    stats.kernel_uses++;
+    irq_restore(flags);
+    return 1;
+}
+
+// Nothing is loaded any more, so whichever thread touches the FPU next must trap
+void kernel_fpu_end() {
+    uint32_t flags = irq_save();
+    stts();
+    this_cpu()->fpu_in_kernel = 0;
+    irq_restore(flags);
+    preempt_enable();
+}
+
+void fpu_switch(thread_t *next) {
+    if (!enabled) {
+        return;
+    }
+    if (this_cpu()->fpu_owner == next) {
+        clts();
+    } else {
+        stts();
+    }
+}
+
+void fpu_release(thread_t *thread) {
+    uint32_t flags = irq_save();
+    cpu_t *cpu = this_cpu();
+    if (cpu->fpu_owner == thread) {
+        cpu->fpu_owner = 0;
+    }
+    irq_restore(flags);
+}
+
+fpu_stats_t fpu_stats() {
+    return stats;
+}
@@ -0,0 +1,311 @@
+#include "../include/sched.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/idt.h"
+#include "../include/timer.h"
+#include "../include/slab.h"
+#include "../include/frame_allocator.h"
+#include "../include/printk.h"
+#include "../include/percpu.h"
+#include "../include/gdt.h"
+#include "../include/fpu.h"
+
+#define PAGE_SIZE 4096
+
+// Saves the callee-saved registers on the old stack, stores its esp in *old_esp, loads
+// new_esp and pops the new thread's registers (switch.asm)
+extern void switch_context(uint32_t *old_esp, uint32_t new_esp);
+
+typedef struct {
+    thread_t *head;
+    thread_t *tail;
+} run_queue_t;
+
+// One FIFO per priority, and bit p of ready_bitmap set while queue p is non-empty, so
+// the next thread is found with one bsf whatever the number of threads
+static run_queue_t run_queues[SCHED_PRIORITIES];
+static uint32_t ready_bitmap;
+
+// Threads all run on the boot CPU. Its running thread, preemption count and pending
+// reschedule live in its per-CPU area; on the other CPUs current stays 0, so
+// preempt_enable() and the interrupt exit never switch there.
+static thread_t boot_thread;
+static thread_t *zombie;          // Exited thread waiting to be freed off its own stack
+static kmem_cache_t *thread_cache;
+static uint32_t next_id;
+static sched_stats_t stats;
+
+// Index of the lowest set bit (value must be non-zero)
+static inline uint32_t bsf(uint32_t value) {
+    uint32_t index;
+    __asm__ ("bsf %1, %0" : "=r" (index) : "rm" (value));
+    return index;
+}
+
+static void enqueue(thread_t *thread) {
+    run_queue_t *queue = &run_queues[thread->priority];
+    thread->next = 0;
+    thread->prev = queue->tail;
+    if (queue->tail) {
+        queue->tail->next = thread;
+    } else {
+        queue->head = thread;
+    }
+    queue->tail = thread;
+    ready_bitmap |= 1u << thread->priority;
+    thread->state = THREAD_READY;
+}
+
+static void dequeue(thread_t *thread) {
+    run_queue_t *queue = &run_queues[thread->priority];
+    if (thread->prev) {
+        thread->prev->next = thread->next;
+    } else {
+        queue->head = thread->next;
+    }
+    if (thread->next) {
+        thread->next->prev = thread->prev;
+    } else {
+        queue->tail = thread->prev;
+    }
+    if (queue->head == 0) {
+        ready_bitmap &= ~(1u << thread->priority);
+    }
+}
+
+// The boot CPU's running thread
+static inline thread_t *running() {
+    return this_cpu()->current;
+}
+
+// A preemption became due outside an interrupt and nothing holds it off
+static inline int switch_due() {
+    cpu_t *cpu = this_cpu();
+    return cpu->need_resched && cpu->preempt_count == 0 && !in_interrupt();
+}
+
+static void slice_expired(registers_t *regs, void *ctx) {
+    this_cpu()->need_resched = 1;
+}
+
+// Round-robin only matters while another thread of the running priority is ready
+static void update_slice() {
+    if (run_queues[running()->priority].head != 0) {
+        timer_arm_client(TIMER_CLIENT_SCHED, SCHED_TIMESLICE_US);
+    } else {
+        timer_cancel_client(TIMER_CLIENT_SCHED);
+    }
+}
+
+// A newly ready thread either outranks the running one or shares its priority
+static void check_preempt(thread_t *thread) {
+    thread_t *current = running();
+    if (thread->priority < current->priority) {
+        this_cpu()->need_resched = 1;
+    } else if (thread->priority == current->priority && current->state == THREAD_RUNNING) {
+        update_slice();
+    }
+}
+
+static void reap() {
+    if (zombie != 0 && zombie != running()) {
+        free_frames(zombie->stack, THREAD_STACK_PAGES);
+        kmem_cache_free(thread_cache, zombie);
+        zombie = 0;
+    }
+}
+
+void schedule() {
+    uint32_t flags = irq_save();
+    cpu_t *cpu = this_cpu();
+    cpu->need_resched = 0;
+    thread_t *prev = cpu->current;
+    if (prev->stack != 0 && *(uint32_t *)prev->stack != THREAD_STACK_MAGIC) {
+        printk(KERN_EMERG, "Kernel stack overflow in thread %s", prev->name);
+        log_panic();
+        while (1) {
+            __asm__ __volatile__ ("cli\n\thlt");
+        }
+    }
+    if (prev->state == THREAD_RUNNING) {
+        enqueue(prev);
+    }
+
+    // Nothing ready (only if the boot thread itself blocked): wait for an interrupt to wake someone
+    while (ready_bitmap == 0) {
+        __asm__ __volatile__ ("sti\n\thlt\n\tcli" ::: "memory");
+    }
+    thread_t *next = run_queues[bsf(ready_bitmap)].head;
+    dequeue(next);
+    next->state = THREAD_RUNNING;
+    if (next != prev) {
+        uint64_t now = rdtsc();
+        prev->runtime += now - prev->switched_in;
+        next->switched_in = now;
+        next->switches++;
+        stats.context_switches++;
+        cpu->current = next;
+        if (next->stack != 0) {
+            // Where interrupts, int 0x80 and SYSENTER from its user mode land
+            gdt_set_kernel_stack(next->stack + THREAD_STACK_PAGES * PAGE_SIZE);
+        }
+        fpu_switch(next);
+        update_slice();
+        switch_context(&prev->esp, next->esp);
+        reap(); // Back on prev's stack, whichever thread switched to it
+    }
+    irq_restore(flags);
+}
+
+// First code a new thread runs, entered from switch_context() with interrupts off
+static void thread_start() {
+    reap();
+    __asm__ __volatile__ ("sti");
+    running()->entry(running()->arg);
+    thread_exit();
+}
+
+void init_sched() {
+    thread_cache = kmem_cache_create("thread", sizeof(thread_t), 32);
+    boot_thread.id = next_id++;
+    boot_thread.name = "kmain";
+    boot_thread.priority = SCHED_DEFAULT_PRIORITY;
+    boot_thread.state = THREAD_RUNNING;
+    boot_thread.switched_in = rdtsc();
+    this_cpu()->current = &boot_thread;
+    timer_set_client_callback(TIMER_CLIENT_SCHED, slice_expired, 0);
+}
+
+thread_t *thread_create(const char *name, thread_fn_t entry, void *arg, int priority) {
+    thread_t *thread = thread_cache ? kmem_cache_alloc(thread_cache) : 0;
+    if (thread == 0) {
+        return 0;
+    }
+    uint32_t stack = alloc_frames(THREAD_STACK_PAGES, 0);
+    if (stack == 0) {
+        kmem_cache_free(thread_cache, thread);
+        return 0;
+    }
+    *(uint32_t *)stack = THREAD_STACK_MAGIC;
+
+    // The frame switch_context() pops: edi, esi, ebx, ebp (0 ends stack walks), then the
+    // return into thread_start, which itself never returns
+    uint32_t *sp = (uint32_t *)(stack + THREAD_STACK_PAGES * PAGE_SIZE);
+    *--sp = 0;
+    *--sp = (uint32_t)thread_start;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+
+    thread->esp = (uint32_t)sp;
+    thread->name = name;
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->stack = stack;
+    thread->priority = priority < 0 ? 0 : (priority >= SCHED_PRIORITIES ? SCHED_IDLE_PRIORITY : priority);
+    thread->runtime = 0;
+    thread->switches = 0;
+    thread->fpu_used = 0;
+
+    uint32_t flags = irq_save();
+    thread->id = next_id++;
+    stats.threads_created++;
+    enqueue(thread);
+    check_preempt(thread);
+    irq_restore(flags);
+    if (switch_due()) {
+        schedule();
+    }
+    return thread;
+}
+
+void thread_exit() {
+    irq_save();
+    stats.threads_exited++;
+    reap(); // Only one zombie at a time
+    fpu_release(running());
+    running()->state = THREAD_DEAD;
+    zombie = running();
+    schedule();
+    while (1) {
+        // Never switched back to
+    }
+}
+
+void sched_yield() {
+    schedule();
+}
+
+void thread_block() {
+    uint32_t flags = irq_save();
+    running()->state = THREAD_BLOCKED;
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_wake(thread_t *thread) {
+    uint32_t flags = irq_save();
+    if (thread->state == THREAD_BLOCKED) {
+        enqueue(thread);
+        check_preempt(thread);
+    }
+    irq_restore(flags);
+    if (switch_due()) {
+        schedule();
+    }
+}
+
+void sched_set_priority(thread_t *thread, int priority) {
+    if (thread == 0) {
+        thread = running();
+    }
+    if (priority < 0 || priority >= SCHED_PRIORITIES) {
+        return;
+    }
+    uint32_t flags = irq_save();
+    if (thread->state == THREAD_READY) {
+        dequeue(thread);
+        thread->priority = priority;
+        enqueue(thread);
+        check_preempt(thread);
+    } else {
+        thread->priority = priority;
+        if (thread == running() && ready_bitmap != 0 && bsf(ready_bitmap) < (uint32_t)priority) {
+            this_cpu()->need_resched = 1; // Lowered below a ready thread
+        } else if (thread == running()) {
+            update_slice();
+        }
+    }
+    irq_restore(flags);
+    if (switch_due()) {
+        schedule();
+    }
+}
+
+thread_t *thread_current() {
+    return running();
+}
+
+void preempt_disable() {
+    this_cpu()->preempt_count++;
+}
+
+void preempt_enable() {
+    cpu_t *cpu = this_cpu();
+    if (--cpu->preempt_count == 0 && cpu->need_resched && cpu->current != 0 && !in_interrupt()) {
+        schedule();
+    }
+}
+
+void sched_irq_exit() {
+    cpu_t *cpu = this_cpu();
+    if (cpu->need_resched && cpu->preempt_count == 0 && cpu->current != 0) {
+        stats.preemptions++;
+        schedule();
+    }
+}
+
+sched_stats_t sched_stats() {
+    return stats;
+}
@@ -0,0 +1,23 @@
+bits 32
+section .text
+
+; void switch_context(uint32_t *old_esp, uint32_t new_esp)
+;
+; Called from schedule() with interrupts off. Only the callee-saved registers need
+; saving: the C caller has already spilled everything else. The old thread resumes
+; by returning from its own call to switch_context().
+global switch_context
+switch_context:
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov eax, [esp + 20]   ; old_esp
+    mov edx, [esp + 24]   ; new_esp
+    mov [eax], esp
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
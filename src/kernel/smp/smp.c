@@ -0,0 +1,195 @@
+#include "../include/smp.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/gdt.h"
+#include "../include/idt.h"
+#include "../include/apic.h"
+#include "../include/timer.h"
+#include "../include/frame_allocator.h"
+#include "../include/workqueue.h"
+#include "../include/kstring.h"
+#include "../include/printk.h"
+#include "../include/fpu.h"
+#include "../include/paging.h"
+#include "../include/spinlock.h"
+
+#define PAGE_SIZE 4096
+
+// Waits of the INIT-SIPI-SIPI sequence (Intel MP specification, appendix B.4)
+#define INIT_DELAY_US        10000
+#define SIPI_DELAY_US        200
+#define AP_ONLINE_TIMEOUT_US 100000
+
+// trampoline.asm, linked into the kernel and copied below 1MB
+extern uint8_t trampoline_start[];
+extern uint8_t trampoline_end[];
+extern uint32_t trampoline_cr0;
+extern uint32_t trampoline_cr3;
+extern uint32_t trampoline_cr4;
+extern uint32_t trampoline_stack;
+extern uint32_t trampoline_cpu;
+extern uint32_t trampoline_entry;
+
+// Address of a trampoline variable in the low-memory copy
+#define TRAMPOLINE_VAR(name) \
+    ((volatile uint32_t *)(SMP_TRAMPOLINE_BASE + ((uint32_t)&(name) - (uint32_t)trampoline_start)))
+
+static cpu_t cpus[SMP_MAX_CPUS];
+static volatile uint32_t cpus_online;
+
+// The shootdown in flight. tlb_lock lets one CPU send at a time; tlb_waiting has a bit
+// for each CPU id that has not flushed the request yet.
+static spinlock_t tlb_lock = SPINLOCK_INIT;
+static uint32_t tlb_addresses[TLB_FLUSH_THRESHOLD];
+static uint32_t tlb_count;
+static int tlb_global;
+static volatile uint32_t tlb_waiting;
+
+void init_boot_cpu() {
+    cpus[0].id = 0;
+    cpus[0].online = 1;
+    cpus_online = 1;
+    gdt_init_cpu(&cpus[0]);
+}
+
+uint32_t smp_cpu_count() {
+    return cpus_online;
+}
+
+cpu_t *smp_cpu(uint32_t id) {
+    return &cpus[id];
+}
+
+void smp_wake(cpu_t *cpu) {
+    lapic_send_ipi(cpu->apic_id, ICR_FIXED | SMP_WAKE_VECTOR);
+}
+
+static void smp_wake_handler(registers_t *regs, void *ctx) {
+    // The interrupt itself is the wakeup: work_loop() looks at the queues after hlt
+}
+
+// Flush for the request in flight, if this CPU has not yet
+static void tlb_serve() {
+    uint32_t bit = 1u << this_cpu()->id;
+    if (__atomic_load_n(&tlb_waiting, __ATOMIC_ACQUIRE) & bit) {
+        tlb_invalidate(tlb_addresses, tlb_count, tlb_global);
+        __atomic_fetch_and(&tlb_waiting, ~bit, __ATOMIC_RELEASE);
+    }
+}
+
+static void smp_tlb_handler(registers_t *regs, void *ctx) {
+    tlb_serve();
+}
+
+void smp_tlb_shootdown(const uint32_t *addresses, uint32_t count, int global) {
+    uint32_t online = __atomic_load_n(&cpus_online, __ATOMIC_ACQUIRE);
+    if (count == 0 || online <= 1) {
+        return;
+    }
+    // Not spin_lock(): two CPUs sending at once would each wait for the other's answer
+    uint32_t flags = irq_save();
+    while (!spin_trylock(&tlb_lock)) {
+        tlb_serve();
+        __asm__ __volatile__ ("pause");
+    }
+    memcpy(tlb_addresses, addresses, (count < TLB_FLUSH_THRESHOLD ? count : TLB_FLUSH_THRESHOLD) * sizeof(uint32_t));
+    tlb_count = count;
+    tlb_global = global;
+
+    uint32_t self = this_cpu()->id;
+    uint32_t targets = 0;
+    for (uint32_t id = 0; id < online; id++) {
+        if (id != self) {
+            targets |= 1u << id;
+        }
+    }
+    __atomic_store_n(&tlb_waiting, targets, __ATOMIC_RELEASE);
+    for (uint32_t id = 0; id < online; id++) {
+        if (id != self) {
+            lapic_send_ipi(cpus[id].apic_id, ICR_FIXED | SMP_TLB_VECTOR);
+        }
+    }
+    while (__atomic_load_n(&tlb_waiting, __ATOMIC_ACQUIRE) != 0) {
+        __asm__ __volatile__ ("pause");
+    }
+    spin_unlock(&tlb_lock);
+    irq_restore(flags);
+}
+
+// First C code on an application processor, entered from the trampoline with paging on
+static void ap_main(cpu_t *cpu) {
+    gdt_init_cpu(cpu);
+    idt_load();
+    init_apic_ap();
+    if (fpu_enabled()) {
+        fpu_init_cpu();
+    }
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+    work_loop();
+}
+
+// INIT, then up to two startup IPIs until the AP reports in
+static int start_ap(cpu_t *cpu) {
+    uint32_t cr0, cr3, cr4;
+    __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (cr0));
+    __asm__ __volatile__ ("mov %%cr3, %0" : "=r" (cr3));
+    __asm__ __volatile__ ("mov %%cr4, %0" : "=r" (cr4));
+    *TRAMPOLINE_VAR(trampoline_cr0) = cr0;
+    *TRAMPOLINE_VAR(trampoline_cr3) = cr3;
+    *TRAMPOLINE_VAR(trampoline_cr4) = cr4;
+    *TRAMPOLINE_VAR(trampoline_stack) = cpu->stack + SMP_AP_STACK_PAGES * PAGE_SIZE;
+    *TRAMPOLINE_VAR(trampoline_cpu) = (uint32_t)cpu;
+    *TRAMPOLINE_VAR(trampoline_entry) = (uint32_t)ap_main;
+
+    lapic_send_ipi(cpu->apic_id, ICR_INIT | ICR_LEVEL_ASSERT | ICR_LEVEL_TRIGGER);
+    timer_udelay(INIT_DELAY_US);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        lapic_send_ipi(cpu->apic_id, ICR_STARTUP | (SMP_TRAMPOLINE_BASE >> 12));
+        timer_udelay(SIPI_DELAY_US);
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+    }
+    for (uint32_t waited = 0; waited < AP_ONLINE_TIMEOUT_US; waited += 100) {
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        timer_udelay(100);
+    }
+    return -1;
+}
+
+uint32_t init_smp() {
+    cpus[0].apic_id = apic_active() ? lapic_id() : 0;
+    register_irq_handler(SMP_WAKE_VECTOR, smp_wake_handler, 0);
+    register_irq_handler(SMP_TLB_VECTOR, smp_tlb_handler, 0);
+    if (!apic_active() || apic_cpu_count() <= 1) {
+        printk(KERN_INFO, "SMP: 1 CPU (%s)", apic_active() ? "no other CPU in the MADT" : "no Local APIC");
+        return cpus_online;
+    }
+
+    memcpy((void *)SMP_TRAMPOLINE_BASE, trampoline_start, trampoline_end - trampoline_start);
+
+    // One AP at a time: they share the trampoline variables
+    for (uint32_t i = 0; i < apic_cpu_count() && cpus_online < SMP_MAX_CPUS; i++) {
+        if (apic_cpu_id(i) == cpus[0].apic_id) {
+            continue;
+        }
+        cpu_t *cpu = &cpus[cpus_online];
+        cpu->id = cpus_online;
+        cpu->apic_id = apic_cpu_id(i);
+        cpu->stack = alloc_frames(SMP_AP_STACK_PAGES, 0);
+        if (cpu->stack == 0) {
+            break;
+        }
+        if (start_ap(cpu) != 0) {
+            // It may still come up late on these trampoline variables, so its stack and
+            // per-CPU area stay reserved and no further CPU is started
+            printk(KERN_WARNING, "SMP: CPU with APIC ID %u did not start", cpu->apic_id);
+            break;
+        }
+        cpus_online++;
+    }
+    printk(KERN_INFO, "SMP: %u of %u CPUs online", cpus_online, apic_cpu_count());
+    return cpus_online;
+}
@@ -0,0 +1,73 @@
+; Application processor start-up code. init_smp() copies trampoline_start..trampoline_end
+; to SMP_TRAMPOLINE_BASE (smp.h), below 1MB, fills in the variables at the end and sends
+; a startup IPI with vector SMP_TRAMPOLINE_BASE >> 12. The AP starts executing here in
+; real mode at SMP_TRAMPOLINE_BASE:0, so every address is computed relative to the copy.
+
+TRAMPOLINE_BASE equ 0x8000
+%define REL(label) ((label) - trampoline_start + TRAMPOLINE_BASE)
+
+section .text
+bits 16
+
+global trampoline_start
+global trampoline_end
+global trampoline_cr0
+global trampoline_cr3
+global trampoline_cr4
+global trampoline_stack
+global trampoline_cpu
+global trampoline_entry
+
+trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [REL(trampoline_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1                       ; PE
+    mov cr0, eax
+    jmp dword 0x08:REL(trampoline_32)
+
+bits 32
+trampoline_32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; The boot CPU's paging setup: 4MB pages and global pages first, then its page
+    ; directory, then PG (the trampoline page is identity mapped)
+    mov eax, [REL(trampoline_cr4)]
+    mov cr4, eax
+    mov eax, [REL(trampoline_cr3)]
+    mov cr3, eax
+    mov eax, [REL(trampoline_cr0)]
+    mov cr0, eax
+
+    ; ap_main(cpu) on the AP's own stack, with EBP = 0 to end stack walks
+    mov esp, [REL(trampoline_stack)]
+    xor ebp, ebp
+    push dword [REL(trampoline_cpu)]
+    push ebp                        ; No return address: ap_main() never returns
+    jmp [REL(trampoline_entry)]
+
+align 8
+trampoline_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF           ; 0x08: flat ring 0 code
+    dq 0x00CF92000000FFFF           ; 0x10: flat ring 0 data
+trampoline_gdt_ptr:
+    dw trampoline_gdt_ptr - trampoline_gdt - 1
+    dd REL(trampoline_gdt)
+
+align 4
+trampoline_cr0:   dd 0
+trampoline_cr3:   dd 0
+trampoline_cr4:   dd 0
+trampoline_stack: dd 0
+trampoline_cpu:   dd 0
+trampoline_entry: dd 0
+trampoline_end:
@@ -0,0 +1,137 @@
+#include "../include/workqueue.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/smp.h"
+#include "../include/spinlock.h"
+
+#define QUEUE_MASK (WORK_QUEUE_SIZE - 1)
+
+typedef struct {
+    work_fn_t fn;
+    void *ctx;
+} work_item_t;
+
+// Double-ended queue per CPU: the owner pushes and pops at the tail, thieves take from
+// the head. Each sits on its own cache lines so CPUs only contend when stealing.
+typedef struct {
+    spinlock_t lock;
+    uint32_t head;     // Oldest item
+    uint32_t tail;     // Next free slot
+    work_stats_t stats;
+    work_item_t items[WORK_QUEUE_SIZE];
+} __attribute__((aligned(64))) work_queue_t;
+
+static work_queue_t queues[SMP_MAX_CPUS];
+
+// Wake an idle CPU other than the caller and the one in skip, so it comes to steal
+static void wake_idle_cpu(cpu_t *skip) {
+    cpu_t *self = this_cpu();
+    for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+        cpu_t *cpu = smp_cpu(i);
+        if (cpu != self && cpu != skip && __atomic_load_n(&cpu->idle, __ATOMIC_SEQ_CST)) {
+            smp_wake(cpu);
+            return;
+        }
+    }
+}
+
+int work_queue_on(uint32_t cpu, work_fn_t fn, void *ctx) {
+    work_queue_t *queue = &queues[cpu];
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    if (queue->tail - queue->head == WORK_QUEUE_SIZE) {
+        spin_unlock_irqrestore(&queue->lock, flags);
+        return -1;
+    }
+    work_item_t *item = &queue->items[queue->tail & QUEUE_MASK];
+    item->fn = fn;
+    item->ctx = ctx;
+    queue->tail++;
+    queue->stats.queued++;
+    uint32_t depth = queue->tail - queue->head;
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    // Pairs with the idle flag store in work_loop(): either the target sees the item
+    // before it halts, or this sees it idle and sends the IPI
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    cpu_t *target = smp_cpu(cpu);
+    if (target != this_cpu() && __atomic_load_n(&target->idle, __ATOMIC_SEQ_CST)) {
+        smp_wake(target);
+    } else if (depth > 1 || target == this_cpu()) {
+        wake_idle_cpu(target); // Busy target, or the caller is busy right now: get help
+    }
+    return 0;
+}
+
+int work_queue(work_fn_t fn, void *ctx) {
+    return work_queue_on(this_cpu()->id, fn, ctx);
+}
+
+// Take one item from a queue, from the tail for its owner or the head for a thief
+static int take(work_queue_t *queue, int own, work_item_t *item) {
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    if (queue->head == queue->tail) {
+        spin_unlock_irqrestore(&queue->lock, flags);
+        return 0;
+    }
+    if (own) {
+        queue->tail--;
+        *item = queue->items[queue->tail & QUEUE_MASK];
+    } else {
+        *item = queue->items[queue->head & QUEUE_MASK];
+        queue->head++;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+    return 1;
+}
+
+int work_run_one() {
+    uint32_t self = this_cpu()->id;
+    uint32_t count = smp_cpu_count();
+    work_item_t item;
+    if (!take(&queues[self], 1, &item)) {
+        // Victims in order after ourselves, so thieves spread over different queues
+        uint32_t i;
+        for (i = 1; i < count; i++) {
+            if (take(&queues[(self + i) % count], 0, &item)) {
+                break;
+            }
+        }
+        if (i == count) {
+            return 0;
+        }
+        __atomic_fetch_add(&queues[self].stats.stolen, 1, __ATOMIC_RELAXED);
+    }
+    item.fn(item.ctx);
+    __atomic_fetch_add(&queues[self].stats.run, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int work_pending() {
+    for (uint32_t i = 0; i < smp_cpu_count(); i++) {
+        if (__atomic_load_n(&queues[i].head, __ATOMIC_RELAXED) != __atomic_load_n(&queues[i].tail, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void work_loop() {
+    cpu_t *cpu = this_cpu();
+    __asm__ __volatile__ ("sti");
+    while (1) {
+        if (work_run_one()) {
+            continue;
+        }
+        __asm__ __volatile__ ("cli");
+        __atomic_store_n(&cpu->idle, 1, __ATOMIC_SEQ_CST);
+        if (!work_pending()) {
+            __asm__ __volatile__ ("sti\n\thlt" ::: "memory"); // The wake IPI ends the hlt
+        }
+        __atomic_store_n(&cpu->idle, 0, __ATOMIC_SEQ_CST);
+        __asm__ __volatile__ ("sti");
+    }
+}
+
+work_stats_t work_stats(uint32_t cpu) {
+    return queues[cpu].stats;
+}
@@ -0,0 +1,110 @@
+bits 32
+section .text
+
+; GDT selectors (src/kernel/include/gdt.h)
+KERNEL_DATA equ 0x10
+USER_CODE   equ 0x18 | 3
+USER_DATA   equ 0x20 | 3
+PERCPU      equ 0x28
+
+extern syscall_dispatch
+extern syscall_counts      ; syscall_stats_t: int80 at +0, sysenter at +4
+
+; Both entries end up in syscall_dispatch(eax, ebx, esi, edi, ebp). The arguments are
+; pushed from the registers as they arrived; nothing is read from the user stack.
+; ebx, esi, edi and ebp are callee-saved in C, so only ecx and edx need saving around
+; the call, and eax carries the result back.
+
+; Kernel segments for C code, saving the caller's. Clobbers ecx, which is saved first.
+%macro ENTER_KERNEL_SEGMENTS 0
+    push ds
+    push es
+    push fs
+    push gs
+    mov cx, KERNEL_DATA
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    mov cx, PERCPU
+    mov gs, cx
+%endmacro
+
+%macro LEAVE_KERNEL_SEGMENTS 0
+    pop gs
+    pop fs
+    pop es
+    pop ds
+%endmacro
+
+%macro DISPATCH 0
+    push ebp
+    push edi
+    push esi
+    push ebx
+    push eax
+    cld                     ; The user's direction flag must not reach C code
+    sti
+    call syscall_dispatch
+    cli
+    add esp, 20
+%endmacro
+
+; int 0x80 through the DPL 3 interrupt gate: the CPU switched to tss.esp0 and pushed
+; ss, esp, eflags, cs and eip. Every register but eax comes back unchanged.
+global syscall_int80_entry
+syscall_int80_entry:
+    push ecx
+    push edx
+    ENTER_KERNEL_SEGMENTS
+    inc dword [syscall_counts]
+    DISPATCH
+    LEAVE_KERNEL_SEGMENTS
+    pop edx
+    pop ecx
+    iret
+
+; SYSENTER: cs is MSR 0x174, eip MSR 0x176 and esp MSR 0x175, which points at this
+; CPU's tss.esp0 rather than at a stack. Interrupts are off and nothing was pushed.
+; The caller passed its esp in ecx and its return address in edx, which is where
+; SYSEXIT sends it back.
+global sysenter_entry
+sysenter_entry:
+    mov esp, [esp]          ; The running thread's kernel stack
+    push ecx
+    push edx
+    ENTER_KERNEL_SEGMENTS
+    inc dword [syscall_counts + 4]
+    DISPATCH
+    LEAVE_KERNEL_SEGMENTS
+    pop edx                 ; User eip
+    pop ecx                 ; User esp
+    sti                     ; Takes effect after SYSEXIT, which lands with interrupts on
+    sysexit
+
+; void user_enter(uint32_t eip, uint32_t esp)
+;
+; iret to ring 3 with the user data segments loaded and interrupts enabled. General
+; registers are cleared so nothing of the kernel's leaks to the program.
+global user_enter
+user_enter:
+    mov eax, [esp + 4]      ; eip
+    mov ecx, [esp + 8]      ; esp
+    mov dx, USER_DATA
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    mov gs, dx
+    push dword USER_DATA    ; ss
+    push ecx                ; esp
+    pushfd
+    or dword [esp], 0x200   ; IF
+    push dword USER_CODE    ; cs
+    push eax                ; eip
+    xor eax, eax
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    iret
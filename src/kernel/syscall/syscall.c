@@ -0,0 +1,133 @@
+#include "../include/syscall.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/gdt.h"
+#include "../include/idt.h"
+#include "../include/sched.h"
+#include "../include/printk.h"
+#include "../include/percpu.h"
+#include "../include/paging.h"
+#include "../include/kstring.h"
+
+// Model-specific registers SYSENTER loads cs, esp and eip from. SYSEXIT returns to
+// GDT_KERNEL_CODE + 16 and + 24 with RPL 3, which gdt.h lays out as the user selectors.
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+// Longest piece of a SYS_WRITE buffer printed as one log record
+#define SYS_WRITE_CHUNK 120
+
+// entry.asm
+extern void syscall_int80_entry();
+extern void sysenter_entry();
+
+static syscall_fn_t syscall_table[SYSCALL_MAX];
+static int sysenter_supported;
+
+// Bumped by the entry stubs; unknown numbers are counted here
+syscall_stats_t syscall_counts;
+
+static uint32_t sys_exit(uint32_t status, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    printk(KERN_DEBUG, "Thread %u (%s) exited with status %u", thread_current()->id, thread_current()->name, status);
+    thread_exit();
+}
+
+static uint32_t sys_null(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    return 0;
+}
+
+static uint32_t sys_gettid(uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    return thread_current()->id;
+}
+
+// Non-zero if ring 3 could read every byte of [address, address + length): inside the
+// user window and on present PAGE_USER pages. Checked right before the copy with
+// preemption off, so nothing unmaps the pages in between and the kernel never takes a
+// fault on a program's behalf.
+static int user_readable(uint32_t address, uint32_t length) {
+    if (address < USER_SPACE_START || address >= USER_SPACE_END || length > USER_SPACE_END - address) {
+        return 0;
+    }
+    for (uint32_t page = address & ~0xFFF; page < address + length; page += 0x1000) {
+        if ((get_page_flags(page) & (PAGE_PRESENT | PAGE_USER)) != (PAGE_PRESENT | PAGE_USER)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Prints the buffer one log record at a time. Returns the bytes written, or
+// SYSCALL_EFAULT if the first piece was not readable.
+static uint32_t sys_write(uint32_t buffer, uint32_t length, uint32_t arg3, uint32_t arg4) {
+    const char *source = (const char *)buffer;
+    char line[SYS_WRITE_CHUNK + 1];
+    uint32_t done = 0;
+    while (done < length) {
+        uint32_t n = length - done < SYS_WRITE_CHUNK ? length - done : SYS_WRITE_CHUNK;
+        preempt_disable();
+        if (!user_readable(buffer + done, n)) {
+            preempt_enable();
+            return done == 0 ? SYSCALL_EFAULT : done;
+        }
+        memcpy(line, source + done, n);
+        preempt_enable();
+        line[n] = '\0';
+        printk(KERN_INFO, "%s", line);
+        done += n;
+    }
+    return length;
+}
+
+int syscall_sysenter_supported() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_SEP)) {
+        return 0;
+    }
+    // Early Pentium Pro parts report SEP without implementing it
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+void init_syscalls() {
+    // Interrupt gate with DPL 3 (0xEE): entered with interrupts off, like the IRQ stubs
+    set_idt_entry(SYSCALL_VECTOR, (uint32_t)syscall_int80_entry, GDT_KERNEL_CODE, 0xEE);
+
+    syscall_register(SYS_EXIT, sys_exit);
+    syscall_register(SYS_NULL, sys_null);
+    syscall_register(SYS_GETTID, sys_gettid);
+    syscall_register(SYS_WRITE, sys_write);
+
+    // SYSENTER loads esp from the MSR rather than the TSS. Pointing it at this CPU's
+    // tss.esp0 lets the entry stub fetch the running thread's kernel stack with one
+    // load, so thread switches update the TSS only. Threads run on the boot CPU alone,
+    // so the other CPUs never need the MSRs.
+    sysenter_supported = syscall_sysenter_supported();
+    if (sysenter_supported) {
+        wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t)&gdt_tss(this_cpu())->esp0);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    }
+    printk(KERN_INFO, "System calls: int 0x%02x%s", SYSCALL_VECTOR, sysenter_supported ? " and SYSENTER" : "");
+}
+
+void syscall_register(uint32_t number, syscall_fn_t fn) {
+    if (number < SYSCALL_MAX) {
+        syscall_table[number] = fn;
+    }
+}
+
+uint32_t syscall_dispatch(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4) {
+    if (number >= SYSCALL_MAX || syscall_table[number] == 0) {
+        syscall_counts.unknown++;
+        return SYSCALL_ENOSYS;
+    }
+    return syscall_table[number](arg1, arg2, arg3, arg4);
+}
+
+syscall_stats_t syscall_stats() {
+    return syscall_counts;
+}
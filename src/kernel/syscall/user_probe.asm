@@ -0,0 +1,105 @@
+bits 32
+section .text
+
+; Ring 3 test program for the system call paths, copied to a user page by the kernel
+; tests (src/kernel/main/kmain.c). It only uses relative jumps and calls, so it runs
+; wherever it lands.
+;
+; On entry esp points at the probe block (user_probe_t in kmain.c):
+PROBE_ITERATIONS      equ 0  ; Null calls to time per entry method (at least 1)
+PROBE_INT80_TID       equ 4  ; SYS_GETTID through int 0x80
+PROBE_SYSENTER_TID    equ 8  ; SYS_GETTID through SYSENTER
+PROBE_CLOBBERED       equ 12 ; Preserved registers that came back changed
+PROBE_INT80_CYCLES    equ 16 ; TSC cycles for the int 0x80 null calls
+PROBE_SYSENTER_CYCLES equ 20 ; TSC cycles for the SYSENTER null calls
+PROBE_USE_SYSENTER    equ 24 ; Non-zero to run the SYSENTER half
+
+; System call numbers (src/kernel/include/syscall.h)
+SYS_EXIT   equ 0
+SYS_NULL   equ 1
+SYS_GETTID equ 2
+
+global user_probe_start
+global user_probe_end
+
+user_probe_start:
+    mov ebp, esp                    ; Probe block; ebp survives every call
+    push ebp                        ; Copy to check ebp against, at [esp + 4]
+    push dword 0                    ; Loop counter at [esp]
+
+    ; Thread id through int 0x80, with marker values in the registers it must keep
+    mov ebx, 0x11111111
+    mov esi, 0x22222222
+    mov edi, 0x33333333
+    mov eax, SYS_GETTID
+    int 0x80
+    mov [ebp + PROBE_INT80_TID], eax
+    call .check_preserved
+
+    ; Null calls through int 0x80
+    mov eax, [ebp + PROBE_ITERATIONS]
+    mov [esp], eax
+    rdtsc
+    mov esi, eax
+.int80_loop:
+    mov eax, SYS_NULL
+    int 0x80
+    dec dword [esp]
+    jnz .int80_loop
+    rdtsc
+    sub eax, esi
+    mov [ebp + PROBE_INT80_CYCLES], eax
+
+    cmp dword [ebp + PROBE_USE_SYSENTER], 0
+    je .exit
+
+    ; The same through SYSENTER
+    mov ebx, 0x11111111
+    mov esi, 0x22222222
+    mov edi, 0x33333333
+    mov eax, SYS_GETTID
+    call .sysenter
+    mov [ebp + PROBE_SYSENTER_TID], eax
+    call .check_preserved
+
+    mov eax, [ebp + PROBE_ITERATIONS]
+    mov [esp], eax
+    rdtsc
+    mov esi, eax
+.sysenter_loop:
+    mov eax, SYS_NULL
+    call .sysenter
+    dec dword [esp]
+    jnz .sysenter_loop
+    rdtsc
+    sub eax, esi
+    mov [ebp + PROBE_SYSENTER_CYCLES], eax
+
+.exit:
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    int 0x80                        ; Does not return
+
+; SYSENTER as a function: SYSEXIT resumes at our return address with the return
+; address popped, as ret would
+.sysenter:
+    mov edx, [esp]
+    lea ecx, [esp + 4]
+    sysenter
+
+.check_preserved:
+    cmp ebx, 0x11111111
+    jne .clobbered
+    cmp esi, 0x22222222
+    jne .clobbered
+    cmp edi, 0x33333333
+    jne .clobbered
+    cmp ebp, [esp + 8]              ; Past the return address and the loop counter
+    je .preserved
+.clobbered:
+    mov ebp, [esp + 8]
+    inc dword [ebp + PROBE_CLOBBERED]
+.preserved:
+    ret
+
+user_probe_end:
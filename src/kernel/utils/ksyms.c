@@ -0,0 +1,130 @@
+#include "../include/ksyms.h"
+#include "../include/types.h"
+#include "../include/multiboot.h"
+#include "../include/elf.h"
+#include "../include/printk.h"
+#include "../include/kstring.h"
+
+typedef struct {
+    uint32_t address;
+    uint32_t end;     // First byte past the function
+    uint32_t name;    // Offset into name_pool
+} ksym_t;
+
+// Sorted by address once init_ksyms() returns
+static ksym_t symbols[KSYMS_MAX];
+static uint32_t num_symbols;
+static char name_pool[KSYMS_NAME_POOL];
+static uint32_t name_pool_used;
+
+// Section data lives at its load address (boot loader) or at its file offset (module)
+static const uint8_t *section_data(const elf32_section_header_t *section, const uint8_t *file) {
+    return file ? file + section->offset : (const uint8_t *)section->addr;
+}
+
+static void add_symbol(uint32_t address, uint32_t size, const char *name) {
+    uint32_t length = strlen(name) + 1;
+    if (num_symbols == KSYMS_MAX || name_pool_used + length > KSYMS_NAME_POOL) {
+        return;
+    }
+    memcpy(name_pool + name_pool_used, name, length);
+    symbols[num_symbols].address = address;
+    symbols[num_symbols].end = address + size;
+    symbols[num_symbols].name = name_pool_used;
+    name_pool_used += length;
+    num_symbols++;
+}
+
+// Copy the STT_FUNC entries of the first SHT_SYMTAB among the given section headers.
+// file is the start of the ELF image for a module, or 0 for boot loader sections.
+static void load_symtab(const elf32_section_header_t *sections, uint32_t count, const uint8_t *file) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (sections[i].type != SHT_SYMTAB || sections[i].link >= count) {
+            continue;
+        }
+        const elf32_symbol_t *syms = (const elf32_symbol_t *)section_data(&sections[i], file);
+        const char *strings = (const char *)section_data(&sections[sections[i].link], file);
+        uint32_t n = sections[i].size / sizeof(elf32_symbol_t);
+        for (uint32_t s = 0; s < n; s++) {
+            if (ELF32_ST_TYPE(syms[s].info) == STT_FUNC && syms[s].value != 0) {
+                add_symbol(syms[s].value, syms[s].size, strings + syms[s].name);
+            }
+        }
+        return;
+    }
+}
+
+// Insertion sort: the linker emits symbols mostly in address order
+static void sort_symbols() {
+    for (uint32_t i = 1; i < num_symbols; i++) {
+        ksym_t sym = symbols[i];
+        uint32_t j = i;
+        while (j > 0 && symbols[j - 1].address > sym.address) {
+            symbols[j] = symbols[j - 1];
+            j--;
+        }
+        symbols[j] = sym;
+    }
+    // Symbols without a size (assembly labels) run up to the next one
+    for (uint32_t i = 0; i < num_symbols; i++) {
+        if (symbols[i].end == symbols[i].address) {
+            symbols[i].end = i + 1 < num_symbols ? symbols[i + 1].address : symbols[i].address + 1;
+        }
+    }
+}
+
+uint32_t init_ksyms(multiboot_info_t *mbi) {
+    num_symbols = 0;
+    name_pool_used = 0;
+
+    if ((mbi->flags & MULTIBOOT_FLAG_ELF) && mbi->elf_size == sizeof(elf32_section_header_t)) {
+        load_symtab((const elf32_section_header_t *)mbi->elf_addr, mbi->elf_num, 0);
+    }
+    if (num_symbols == 0 && (mbi->flags & MULTIBOOT_FLAG_MODS)) {
+        multiboot_module_t *modules = (multiboot_module_t *)mbi->mods_addr;
+        for (uint32_t m = 0; m < mbi->mods_count && num_symbols == 0; m++) {
+            const uint8_t *file = (const uint8_t *)modules[m].mod_start;
+            const elf32_header_t *header = (const elf32_header_t *)file;
+            if (modules[m].mod_end - modules[m].mod_start < sizeof(elf32_header_t) ||
+                *(const uint32_t *)header->ident != ELF_MAGIC ||
+                header->shentsize != sizeof(elf32_section_header_t)) {
+                continue;
+            }
+            load_symtab((const elf32_section_header_t *)(file + header->shoff), header->shnum, file);
+        }
+    }
+
+    sort_symbols();
+    printk(KERN_DEBUG, "Kernel symbols: %u functions, %u bytes of names", num_symbols, name_pool_used);
+    return num_symbols;
+}
+
+int ksym_index(uint32_t addr) {
+    // Last symbol starting at or below addr
+    uint32_t low = 0;
+    uint32_t high = num_symbols;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (symbols[mid].address <= addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0 || addr >= symbols[low - 1].end) {
+        return -1;
+    }
+    return low - 1;
+}
+
+const char *ksym_name(int index) {
+    return name_pool + symbols[index].name;
+}
+
+uint32_t ksym_address(int index) {
+    return symbols[index].address;
+}
+
+uint32_t ksyms_count() {
+    return num_symbols;
+}
@@ -0,0 +1,144 @@
+#include "../include/ktest.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/io.h"
+#include "../include/printk.h"
+
+typedef struct {
+    const char *name;
+    ktest_fn_t fn;
+} ktest_case_t;
+
+typedef struct {
+    const char *name;
+    kbench_fn_t fn;
+    void *ctx;
+    uint32_t iterations;
+} kbench_case_t;
+
+static ktest_case_t tests[KTEST_MAX_CASES];
+static uint32_t test_count;
+static kbench_case_t benches[KBENCH_MAX_CASES];
+static uint32_t bench_count;
+
+static uint32_t samples[KBENCH_MAX_ITERATIONS];
+
+// Where the running test failed
+static const char *fail_expr;
+static const char *fail_file;
+static int fail_line;
+
+void ktest_register(const char *name, ktest_fn_t fn) {
+    if (test_count == KTEST_MAX_CASES) {
+        printk(KERN_ERR, "ktest: no room for test %s", name);
+        return;
+    }
+    tests[test_count].name = name;
+    tests[test_count].fn = fn;
+    test_count++;
+}
+
+void kbench_register(const char *name, kbench_fn_t fn, void *ctx, uint32_t iterations) {
+    if (bench_count == KBENCH_MAX_CASES) {
+        printk(KERN_ERR, "ktest: no room for benchmark %s", name);
+        return;
+    }
+    if (iterations == 0 || iterations > KBENCH_MAX_ITERATIONS) {
+        iterations = KBENCH_MAX_ITERATIONS;
+    }
+    benches[bench_count].name = name;
+    benches[bench_count].fn = fn;
+    benches[bench_count].ctx = ctx;
+    benches[bench_count].iterations = iterations;
+    bench_count++;
+}
+
+void ktest_fail(const char *expr, const char *file, int line) {
+    fail_expr = expr;
+    fail_file = file;
+    fail_line = line;
+}
+
+int ktest_run_all() {
+    uint32_t failed = 0;
+    printk(KERN_NOTICE, "KTEST_START");
+    for (uint32_t i = 0; i < test_count; i++) {
+        fail_expr = 0;
+        uint64_t start = rdtsc();
+        int result = tests[i].fn();
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        if (result == 0) {
+            printk(KERN_NOTICE, "KTEST PASS %s %u", tests[i].name, cycles);
+        } else if (fail_expr != 0) {
+            printk(KERN_ERR, "KTEST FAIL %s %u %s:%d %s", tests[i].name, cycles, fail_file, fail_line, fail_expr);
+            failed++;
+        } else {
+            printk(KERN_ERR, "KTEST FAIL %s %u", tests[i].name, cycles);
+            failed++;
+        }
+        log_flush(); // One test's output per flush keeps the ring from overflowing
+    }
+    printk(KERN_NOTICE, "KTEST_STOP %u %u", test_count - failed, failed);
+    log_flush();
+    return failed;
+}
+
+// Insertion sort: the sample count is small and mostly sorted after the warm-up
+static void sort_samples(uint32_t *values, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t value = values[i];
+        uint32_t j = i;
+        while (j > 0 && values[j - 1] > value) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+}
+
+// Cycles of an empty rdtsc pair, the floor every sample is measured against
+static uint32_t rdtsc_overhead() {
+    uint32_t best = 0xFFFFFFFF;
+    for (int i = 0; i < 64; i++) {
+        uint64_t start = rdtsc();
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+void kbench_run_all() {
+    uint32_t overhead = rdtsc_overhead();
+    printk(KERN_NOTICE, "KBENCH_START");
+    for (uint32_t i = 0; i < bench_count; i++) {
+        kbench_case_t *bench = &benches[i];
+        bench->fn(bench->ctx);
+        for (uint32_t n = 0; n < bench->iterations; n++) {
+            uint64_t start = rdtsc();
+            bench->fn(bench->ctx);
+            uint32_t cycles = (uint32_t)(rdtsc() - start);
+            samples[n] = cycles > overhead ? cycles - overhead : 0;
+        }
+        sort_samples(samples, bench->iterations);
+        uint32_t p99 = bench->iterations * 99 / 100;
+        if (p99 >= bench->iterations) {
+            p99 = bench->iterations - 1;
+        }
+        printk(KERN_NOTICE, "KBENCH %s %u %u %u %u", bench->name, bench->iterations,
+               samples[0], samples[bench->iterations / 2], samples[p99]);
+        log_flush();
+    }
+    printk(KERN_NOTICE, "KBENCH_STOP");
+    log_flush();
+}
+
+void ktest_exit(int failures) {
+    log_flush();
+    serial_set_sync(1); // Push out whatever is still in the TX ring
+    outb(KTEST_EXIT_PORT, failures ? 1 : 0);
+    while (1) {
+        __asm__ __volatile__ ("cli\n\thlt");
+    }
+}
@@ -0,0 +1,297 @@
+#include "printk.h"
+#include "vga.h"
+#include "io.h"
+#include "cpu.h"
+#include "deferred.h"
+#include "timer.h"
+#include "kstring.h"
+#include <stdarg.h>
+
+#define RING_MASK (LOG_RING_RECORDS - 1)
+
+// One message. sequence is the message number + 1 once the record is complete, and 0
+// while a writer fills it, so readers can tell a finished record from one being reused.
+typedef struct {
+    volatile uint32_t sequence;
+    uint8_t level;
+    uint8_t length;
+    uint16_t reserved;
+    uint64_t tsc;
+    char text[LOG_TEXT_MAX];
+} log_record_t;
+
+typedef struct {
+    void (*write)(const log_record_t *record);
+    int level;
+    uint32_t cursor; // Next message number to print
+    uint32_t lost;
+} log_sink_t;
+
+static log_record_t ring[LOG_RING_RECORDS];
+static volatile uint32_t log_head; // Next message number to hand out
+static volatile int flush_pending;
+static volatile int flushing;
+
+static void vga_sink_write(const log_record_t *record);
+static void serial_sink_write(const log_record_t *record);
+
+static log_sink_t sinks[LOG_NUM_SINKS] = {
+    { vga_sink_write,    KERN_INFO,  0, 0 },
+    { serial_sink_write, KERN_DEBUG, 0, 0 },
+};
+
+static const uint8_t level_colors[] = {
+    VGA_COLOR_LIGHT_RED, VGA_COLOR_LIGHT_RED, VGA_COLOR_LIGHT_RED, VGA_COLOR_RED,
+    VGA_COLOR_YELLOW, VGA_COLOR_GREEN, VGA_COLOR_GREEN, VGA_COLOR_LIGHT_GREY
+};
+
+typedef struct {
+    char *buffer;
+    uint32_t size;
+    uint32_t length;
+} format_out_t;
+
+static void put(format_out_t *out, char c) {
+    if (out->length + 1 < out->size) {
+        out->buffer[out->length++] = c;
+    }
+}
+
+static void put_number(format_out_t *out, uint32_t value, uint32_t base, int negative,
+                       int width, char pad, int upper) {
+    char digits[11];
+    int n = base == 16 ? utoa_hex(value, digits, 1, upper) : utoa_dec(value, digits);
+    if (negative) {
+        width--;
+        if (pad == '0') {
+            put(out, '-');
+        }
+    }
+    for (int i = n; i < width; i++) {
+        put(out, pad);
+    }
+    if (negative && pad != '0') {
+        put(out, '-');
+    }
+    for (int i = 0; i < n; i++) {
+        put(out, digits[i]);
+    }
+}
+
+static uint32_t format(char *buffer, uint32_t size, const char *fmt, va_list args) {
+    format_out_t out = { buffer, size, 0 };
+    for (; *fmt != '\0'; fmt++) {
+        if (*fmt != '%') {
+            put(&out, *fmt);
+            continue;
+        }
+        fmt++;
+        char pad = ' ';
+        int width = 0;
+        if (*fmt == '0') {
+            pad = '0';
+            fmt++;
+        }
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
+        while (*fmt == 'l') {
+            fmt++; // long is the same size as int here
+        }
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int value = va_arg(args, int);
+            put_number(&out, value < 0 ? -(uint32_t)value : (uint32_t)value, 10, value < 0, width, pad, 0);
+            break;
+        }
+        case 'u':
+            put_number(&out, va_arg(args, uint32_t), 10, 0, width, pad, 0);
+            break;
+        case 'x':
+        case 'X':
+            put_number(&out, va_arg(args, uint32_t), 16, 0, width, pad, *fmt == 'X');
+            break;
+        case 'p':
+            put(&out, '0');
+            put(&out, 'x');
+            put_number(&out, (uint32_t)va_arg(args, void *), 16, 0, 8, '0', 0);
+            break;
+        case 'c':
+            put(&out, (char)va_arg(args, int));
+            break;
+        case 's': {
+            const char *s = va_arg(args, const char *);
+            int length = 0;
+            if (s == 0) {
+                s = "(null)";
+            }
+            while (s[length] != '\0') {
+                length++;
+            }
+            for (int i = length; i < width; i++) {
+                put(&out, ' ');
+            }
+            while (*s != '\0') {
+                put(&out, *s++);
+            }
+            break;
+        }
+        case '%':
+            put(&out, '%');
+            break;
+        case '\0':
+            fmt--;
+            break;
+        default:
+            put(&out, '%');
+            put(&out, *fmt);
+            break;
+        }
+    }
+    out.buffer[out.length] = '\0';
+    return out.length;
+}
+
+static void vga_sink_write(const log_record_t *record) {
+    vga_console_write_line(record->text, level_colors[record->level]);
+}
+
+static uint32_t format_string(char *buffer, uint32_t size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    uint32_t length = format(buffer, size, fmt, args);
+    va_end(args);
+    return length;
+}
+
+static void serial_sink_write(const log_record_t *record) {
+    uint32_t tsc_per_us = timer_tsc_per_us();
+    if (tsc_per_us != 0) {
+        // [seconds.microseconds] once the TSC is calibrated
+        char prefix[24];
+        // Two-step divisions: the TSC need not have started at 0, and microseconds
+        // pass 2^32 after 72 minutes
+        uint32_t us;
+        uint32_t seconds = (uint32_t)udiv64(udiv64(record->tsc, tsc_per_us, 0), 1000000, &us);
+        format_string(prefix, sizeof(prefix), "[%u.%06u] ", seconds, us);
+        serial_write_string(prefix);
+    }
+    serial_write_string(record->text);
+    serial_write('\n');
+}
+
+// Copy out the record for message number seq. Returns 1 if copied, 0 if it is not
+// complete yet, -1 if it was already overwritten by a newer message.
+static int read_record(uint32_t seq, log_record_t *copy) {
+    log_record_t *record = &ring[seq & RING_MASK];
+    uint32_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+    if (sequence == seq + 1) {
+        *copy = *record;
+        // A writer may have reused the slot while we copied
+        return __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) == seq + 1 ? 1 : -1;
+    }
+    if (sequence == 0 || (int)(sequence - (seq + 1)) < 0) {
+        return 0;
+    }
+    return -1;
+}
+
+static void flush_sink(log_sink_t *sink) {
+    log_record_t copy;
+    while (sink->cursor != log_head) {
+        uint32_t head = log_head;
+        if (head - sink->cursor > LOG_RING_RECORDS) {
+            sink->lost += head - sink->cursor - LOG_RING_RECORDS;
+            sink->cursor = head - LOG_RING_RECORDS;
+        }
+        int result = read_record(sink->cursor, &copy);
+        if (result == 0) {
+            break; // Still being written; the writer schedules another flush
+        }
+        if (result < 0) {
+            sink->lost++;
+        } else if (copy.level <= sink->level) {
+            sink->write(&copy);
+        }
+        sink->cursor++;
+    }
+}
+
+void log_flush() {
+    if (__atomic_exchange_n(&flushing, 1, __ATOMIC_ACQUIRE)) {
+        return; // Whoever is flushing will also see our records
+    }
+    for (int i = 0; i < LOG_NUM_SINKS; i++) {
+        flush_sink(&sinks[i]);
+    }
+    __atomic_store_n(&flushing, 0, __ATOMIC_RELEASE);
+}
+
+static void log_flush_work(void *ctx) {
+    (void)ctx;
+    __atomic_store_n(&flush_pending, 0, __ATOMIC_RELEASE);
+    log_flush();
+}
+
+void printk(int level, const char *fmt, ...) {
+    if (level < KERN_EMERG) {
+        level = KERN_EMERG;
+    } else if (level > KERN_DEBUG) {
+        level = KERN_DEBUG;
+    }
+
+    uint32_t seq = __atomic_fetch_add(&log_head, 1, __ATOMIC_RELAXED);
+    log_record_t *record = &ring[seq & RING_MASK];
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELEASE);
+
+    va_list args;
+    va_start(args, fmt);
+    record->length = format(record->text, LOG_TEXT_MAX, fmt, args);
+    va_end(args);
+    record->level = level;
+    record->tsc = rdtsc();
+    __atomic_store_n(&record->sequence, seq + 1, __ATOMIC_RELEASE);
+
+    if (level <= KERN_ERR) {
+        log_flush();
+    } else if (!__atomic_exchange_n(&flush_pending, 1, __ATOMIC_ACQUIRE)) {
+        if (defer_work(log_flush_work, 0) != 0) {
+            __atomic_store_n(&flush_pending, 0, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+void log_set_level(int sink, int level) {
+    if (sink >= 0 && sink < LOG_NUM_SINKS) {
+        sinks[sink].level = level;
+    }
+}
+
+void log_dump() {
+    log_record_t copy;
+    uint32_t head = log_head;
+    uint32_t seq = head > LOG_RING_RECORDS ? head - LOG_RING_RECORDS : 0;
+    serial_write_string("LOG_DUMP_START\n");
+    for (; seq != head; seq++) {
+        if (read_record(seq, &copy) == 1) {
+            serial_write('<');
+            serial_write('0' + copy.level);
+            serial_write('>');
+            serial_sink_write(&copy);
+        }
+    }
+    serial_write_string("LOG_DUMP_STOP\n");
+}
+
+void log_panic() {
+    __asm__ __volatile__ ("cli");
+    serial_set_sync(1);
+    flushing = 0; // The panic may have interrupted a flush that will never finish
+    log_flush();
+    log_dump();
+}
+
+uint32_t log_lost(int sink) {
+    return sink >= 0 && sink < LOG_NUM_SINKS ? sinks[sink].lost : 0;
+}
@@ -0,0 +1,224 @@
+#include "../include/profile.h"
+#include "../include/types.h"
+#include "../include/idt.h"
+#include "../include/timer.h"
+#include "../include/ksyms.h"
+#include "../include/io.h"
+#include "../include/kstring.h"
+#include "../include/paging.h"
+
+// Lines are written straight to COM1 like trace_dump(): folded stacks are longer than
+// a printk record
+
+typedef struct {
+    uint32_t depth;
+    uint32_t pcs[PROFILE_MAX_DEPTH]; // Leaf first
+} profile_sample_t;
+
+static profile_sample_t samples[PROFILE_MAX_SAMPLES];
+static volatile uint32_t sample_count;
+static volatile uint32_t dropped;
+static volatile int running;
+static uint32_t interval;
+
+// Per-symbol sample counts for the flat profile, plus the index order to print them in
+static uint32_t flat_counts[KSYMS_MAX];
+static uint16_t order[PROFILE_MAX_SAMPLES];
+
+// Follow saved EBPs from the interrupted frame. Each frame holds the caller's EBP at
+// [ebp] and the return address at [ebp + 4]; a frame pointer that does not move up
+// the same stack, or leaves the direct map, ends the walk (kmain's caller starts with
+// EBP = 0).
+static void record_sample(registers_t *regs) {
+    if (sample_count == PROFILE_MAX_SAMPLES) {
+        dropped++;
+        return;
+    }
+    profile_sample_t *sample = &samples[sample_count];
+    sample->pcs[0] = regs->eip;
+    sample->depth = 1;
+
+    uint32_t ebp = regs->ebp;
+    uint32_t limit = ebp + PROFILE_STACK_SPAN;
+    if (limit > paging_direct_map_end() - 8) {
+        limit = paging_direct_map_end() - 8;
+    }
+    while (sample->depth < PROFILE_MAX_DEPTH && ebp != 0 && (ebp & 3) == 0 && ebp < limit) {
+        uint32_t *frame = (uint32_t *)ebp;
+        uint32_t return_address = frame[1];
+        if (return_address == 0) {
+            break;
+        }
+        sample->pcs[sample->depth++] = return_address - 1; // Inside the call instruction
+        if (frame[0] <= ebp) {
+            break;
+        }
+        ebp = frame[0];
+    }
+    sample_count++;
+}
+
+static void profile_tick(registers_t *regs, void *ctx) {
+    if (!running) {
+        return;
+    }
+    record_sample(regs);
+    timer_arm(interval);
+}
+
+void profile_start(uint32_t interval_us) {
+    sample_count = 0;
+    dropped = 0;
+    interval = interval_us ? interval_us : PROFILE_DEFAULT_INTERVAL_US;
+    running = 1;
+    timer_set_callback(profile_tick, 0);
+    timer_arm(interval);
+}
+
+void profile_stop() {
+    running = 0;
+    timer_cancel();
+    timer_set_callback(0, 0);
+}
+
+uint32_t profile_sample_count() {
+    return sample_count;
+}
+
+static void write_dec(uint32_t value) {
+    char digits[12];
+    utoa_dec(value, digits);
+    serial_write_string(digits);
+}
+
+static void write_pc(uint32_t pc) {
+    int index = ksym_index(pc);
+    if (index >= 0) {
+        serial_write_string(ksym_name(index));
+    } else {
+        char digits[9];
+        utoa_hex(pc, digits, 8, 0);
+        serial_write_string("0x");
+        serial_write_string(digits);
+    }
+}
+
+// Replace every pc with the start of its function, so samples from anywhere in the
+// same functions compare equal
+static void canonicalize(profile_sample_t *sample) {
+    for (uint32_t i = 0; i < sample->depth; i++) {
+        int index = ksym_index(sample->pcs[i]);
+        if (index >= 0) {
+            sample->pcs[i] = ksym_address(index);
+        }
+    }
+}
+
+static int compare_stacks(const profile_sample_t *a, const profile_sample_t *b) {
+    for (uint32_t i = 0; i < a->depth && i < b->depth; i++) {
+        uint32_t pa = a->pcs[a->depth - 1 - i];
+        uint32_t pb = b->pcs[b->depth - 1 - i];
+        if (pa != pb) {
+            return pa < pb ? -1 : 1;
+        }
+    }
+    return (int)a->depth - (int)b->depth;
+}
+
+static void dump_flat(uint32_t count) {
+    uint32_t unknown = 0;
+    memset(flat_counts, 0, sizeof(flat_counts));
+    for (uint32_t i = 0; i < count; i++) {
+        int index = ksym_index(samples[i].pcs[0]);
+        if (index >= 0) {
+            flat_counts[index]++;
+        } else {
+            unknown++;
+        }
+    }
+    // Hottest first; each pass takes the largest count left
+    while (1) {
+        uint32_t best = 0;
+        int best_index = -1;
+        for (uint32_t s = 0; s < ksyms_count(); s++) {
+            if (flat_counts[s] > best) {
+                best = flat_counts[s];
+                best_index = s;
+            }
+        }
+        if (best_index < 0) {
+            break;
+        }
+        uint32_t permille = best * 1000 / count;
+        serial_write_string("FLAT ");
+        write_dec(best);
+        serial_write(' ');
+        write_dec(permille / 10);
+        serial_write('.');
+        write_dec(permille % 10);
+        serial_write_string("% ");
+        serial_write_string(ksym_name(best_index));
+        serial_write('\n');
+        flat_counts[best_index] = 0;
+    }
+    if (unknown != 0) {
+        serial_write_string("FLAT ");
+        write_dec(unknown);
+        serial_write_string(" - [unknown]\n");
+    }
+}
+
+static void dump_folded(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        canonicalize(&samples[i]);
+        order[i] = i;
+    }
+    // Insertion sort of indices, then one line per run of equal stacks
+    for (uint32_t i = 1; i < count; i++) {
+        uint16_t current = order[i];
+        uint32_t j = i;
+        while (j > 0 && compare_stacks(&samples[order[j - 1]], &samples[current]) > 0) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = current;
+    }
+    for (uint32_t i = 0; i < count;) {
+        profile_sample_t *sample = &samples[order[i]];
+        uint32_t same = 1;
+        while (i + same < count && compare_stacks(&samples[order[i + same]], sample) == 0) {
+            same++;
+        }
+        serial_write_string("FOLDED ");
+        for (uint32_t d = sample->depth; d-- > 0;) {
+            write_pc(sample->pcs[d]);
+            if (d != 0) {
+                serial_write(';');
+            }
+        }
+        serial_write(' ');
+        write_dec(same);
+        serial_write('\n');
+        i += same;
+    }
+}
+
+void profile_dump() {
+    if (running) {
+        profile_stop(); // Samples must not change under the sort
+    }
+    uint32_t count = sample_count;
+
+    serial_write_string("PROFILE_START ");
+    write_dec(count);
+    serial_write(' ');
+    write_dec(dropped);
+    serial_write(' ');
+    write_dec(interval);
+    serial_write('\n');
+    if (count != 0) {
+        dump_flat(count);
+        dump_folded(count);
+    }
+    serial_write_string("PROFILE_STOP\n");
+}
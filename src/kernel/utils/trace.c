@@ -0,0 +1,54 @@
+#include "../include/trace.h"
+#include "../include/types.h"
+#include "../include/cpu.h"
+#include "../include/io.h"
+
+typedef struct {
+    const char *name; // Must point to a string that outlives the trace (a literal)
+    uint64_t tsc;
+    char type;        // 'B' for begin, 'E' for end
+} trace_event_t;
+
+static trace_event_t trace_ring[TRACE_RING_SIZE];
+static uint32_t trace_count; // Total events recorded, including overwritten ones
+
+static void trace_record(const char *name, char type) {
+    trace_event_t *event = &trace_ring[trace_count % TRACE_RING_SIZE];
+    event->tsc = rdtsc();
+    event->name = name;
+    event->type = type;
+    trace_count++;
+}
+
+void trace_begin(const char *name) {
+    trace_record(name, 'B');
+}
+
+void trace_end(const char *name) {
+    trace_record(name, 'E');
+}
+
+static void serial_write_hex32(uint32_t value) {
+    static const char hex_digits[] = "0123456789abcdef";
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        serial_write(hex_digits[(value >> shift) & 0xF]);
+    }
+}
+
+void trace_dump() {
+    uint32_t first = trace_count > TRACE_RING_SIZE ? trace_count - TRACE_RING_SIZE : 0;
+
+    serial_write_string("TRACE_START\n");
+    for (uint32_t i = first; i < trace_count; i++) {
+        trace_event_t *event = &trace_ring[i % TRACE_RING_SIZE];
+        serial_write_string("TRACE ");
+        serial_write(event->type);
+        serial_write(' ');
+        serial_write_hex32((uint32_t)(event->tsc >> 32));
+        serial_write_hex32((uint32_t)event->tsc);
+        serial_write(' ');
+        serial_write_string(event->name);
+        serial_write('\n');
+    }
+    serial_write_string("TRACE_STOP\n");
+}
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Turn the TRACE lines the kernel writes to COM1 into a per-phase breakdown.
+
+Usage: tools/boot_trace.py [qemu_output.log] [--mhz N]
+
+The kernel dumps its trace ring at the end of boot (see src/kernel/utils/trace.c):
+
+    TRACE_START
+    TRACE B 0000000012345678 init_paging
+    TRACE E 0000000012349abc init_paging
+    TRACE_STOP
+
+Begin/end events are paired by name. Nested phases are indented under the
+phase that was open when they began.
+"""
+
+import argparse
+import sys
+
+
+def parse_events(lines):
+    """Return (type, tsc, name) tuples from the last complete trace dump."""
+    events = None
+    current = None
+    for line in lines:
+        line = line.strip()
+        if line == "TRACE_START":
+            current = []
+        elif line == "TRACE_STOP" and current is not None:
+            events = current
+            current = None
+        elif line.startswith("TRACE ") and current is not None:
+            parts = line.split(None, 3)
+            if len(parts) == 4 and parts[1] in ("B", "E"):
+                current.append((parts[1], int(parts[2], 16), parts[3]))
+    return events
+
+
+def build_phases(events):
+    """Pair begin/end events into (depth, name, start, cycles) in begin order."""
+    phases = []
+    open_phases = []
+    for kind, tsc, name in events:
+        if kind == "B":
+            open_phases.append((name, tsc, len(phases)))
+            phases.append(None)
+            continue
+        for i in range(len(open_phases) - 1, -1, -1):
+            if open_phases[i][0] == name:
+                _, start, slot = open_phases.pop(i)
+                phases[slot] = (i, name, start, tsc - start)
+                break
+    return [p for p in phases if p is not None]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", default="qemu_output.log")
+    parser.add_argument("--mhz", type=float, help="TSC frequency, to also print microseconds")
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as f:
+        events = parse_events(f)
+    if not events:
+        sys.exit("no complete TRACE_START/TRACE_STOP block in " + args.log)
+
+    phases = build_phases(events)
+    first = min(tsc for _, tsc, _ in events)
+    total = max(tsc for _, tsc, _ in events) - first
+
+    header = "%-32s %14s %14s %7s" % ("phase", "start", "cycles", "%")
+    if args.mhz:
+        header += " %12s" % "us"
+    print(header)
+    for depth, name, start, cycles in phases:
+        row = "%-32s %14d %14d %6.1f%%" % ("  " * depth + name, start - first, cycles,
+                                           100.0 * cycles / total if total else 0.0)
+        if args.mhz:
+            row += " %12.1f" % (cycles / args.mhz)
+        print(row)
+    print("%-32s %14s %14d" % ("total", "", total))
+
+
+if __name__ == "__main__":
+    main()
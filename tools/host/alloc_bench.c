@@ -0,0 +1,322 @@
+// Host build of the memory subsystem: frame_allocator.c, buddy_allocator.c, slab.c and
+// kmalloc.c compiled for Linux (KERNEL_HOST_BUILD) and driven by randomized workloads.
+//
+// Usage: alloc_bench [-v] [--ram MB] [--ops N] [--seed S]
+//
+// The allocators hand out physical addresses and also dereference them (bitmap,
+// buddy links, slab headers), so the synthetic RAM is mapped at its own addresses,
+// the way the kernel's direct map works. A synthetic multiboot memory map describes
+// it with the same holes QEMU reports. Built once per frame allocator backend by
+// "make host-bench".
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "host_shim.h"
+#include "../../src/kernel/include/multiboot.h"
+#include "../../src/kernel/include/frame_allocator.h"
+#include "../../src/kernel/include/buddy_allocator.h"
+#include "../../src/kernel/include/kmalloc.h"
+#include "../../src/kernel/include/printk.h"
+
+#define PAGE_SIZE 4096
+#define RAM_BASE  0x10000 // Lowest address Linux lets us map (vm.mmap_min_addr)
+
+#define FRAME_SLOTS  1024
+#define KMALLOC_SLOTS 512
+#define LIFO_DEPTH   256
+
+// The buddy backend never hands out more than one top-order block at a time
+#ifdef FRAME_ALLOCATOR_BUDDY
+#define BACKEND_NAME "buddy"
+#define MAX_RUN (1u << BUDDY_MAX_ORDER)
+#else
+#define BACKEND_NAME "bitmap"
+#define MAX_RUN 0xFFFFFFFF
+#endif
+
+typedef struct {
+    uint32_t addr;
+    uint32_t size; // Frames for frame workloads, bytes for kmalloc workloads
+} slot_t;
+
+static slot_t slots[FRAME_SLOTS];
+static uint32_t rng_state;
+static uint32_t total_ops;
+
+// xorshift32: fast and reproducible for a given --seed
+static uint32_t rng() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rng_range(uint32_t low, uint32_t high) {
+    return low + rng() % (high - low + 1);
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Map [RAM_BASE, ram_end) at its own addresses and describe it like QEMU's BIOS does
+static void setup_ram(uint32_t ram_mb, multiboot_info_t *mbi) {
+    host_ram_end = ram_mb * 1024 * 1024;
+    void *ram = mmap((void *)RAM_BASE, host_ram_end - RAM_BASE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (ram != (void *)RAM_BASE) {
+        perror("mmap of the synthetic physical memory");
+        exit(2);
+    }
+
+    // The table sits in the first available page; it is only read during init
+    static const multiboot_mmap_entry_t layout[] = {
+        { 20, RAM_BASE, 0, 0x9FC00 - RAM_BASE, 0, 1 },
+        { 20, 0x9FC00, 0, 0x400, 0, 2 },
+        { 20, 0xF0000, 0, 0x10000, 0, 2 },
+        { 20, 0x100000, 0, 0, 0, 1 }, // Length filled in below
+    };
+    multiboot_mmap_entry_t *table = (multiboot_mmap_entry_t *)RAM_BASE;
+    memcpy(table, layout, sizeof(layout));
+    table[3].len_low = host_ram_end - 0x100000;
+
+    memset(mbi, 0, sizeof(*mbi));
+    mbi->flags = MULTIBOOT_FLAG_MMAP;
+    mbi->mmap_addr = RAM_BASE;
+    mbi->mmap_length = sizeof(layout);
+}
+
+// Largest run alloc_frames() can currently satisfy (up to limit), found by bisection
+static uint32_t largest_free_run(uint32_t limit) {
+    uint32_t low = 0;
+    uint32_t high = limit;
+    while (low < high) {
+        uint32_t mid = low + (high - low + 1) / 2;
+        uint32_t addr = alloc_frames(mid, 0);
+        if (addr != 0) {
+            free_frames(addr, mid);
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// How far the largest free run falls short of the largest one the backend could hand
+// out from this much free memory: 0% when all free memory is one run
+static double fragmentation() {
+    uint32_t best = frame_allocator_free_count();
+    if (best > MAX_RUN) {
+        best = MAX_RUN;
+    }
+    return best ? 100.0 * (1.0 - (double)largest_free_run(best) / best) : 0.0;
+}
+
+static void report(const char *name, uint32_t ops, double ns, double frag, uint32_t failures) {
+    printf("%-8s %-22s %9u %9.1f %9.1f%% %9u\n", BACKEND_NAME, name, ops, ops ? ns / ops : 0.0,
+           frag, failures);
+}
+
+static void free_frame_slots(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (slots[i].addr != 0) {
+            free_frames(slots[i].addr, slots[i].size);
+            slots[i].addr = 0;
+        }
+    }
+}
+
+// Random slots flip between allocated (1-16 frames) and free
+static void frames_uniform() {
+    uint32_t failures = 0;
+    double start = now_ns();
+    for (uint32_t op = 0; op < total_ops; op++) {
+        slot_t *slot = &slots[rng() % FRAME_SLOTS];
+        if (slot->addr != 0) {
+            free_frames(slot->addr, slot->size);
+            slot->addr = 0;
+        } else {
+            slot->size = rng_range(1, 16);
+            slot->addr = alloc_frames(slot->size, 0);
+            failures += slot->addr == 0;
+        }
+    }
+    double ns = now_ns() - start;
+    report("frames-uniform", total_ops, ns, fragmentation(), failures);
+    free_frame_slots(FRAME_SLOTS);
+}
+
+// Bursts of allocations released in reverse order, like nested scopes
+static void frames_lifo() {
+    uint32_t failures = 0;
+    uint32_t ops = 0;
+    double start = now_ns();
+    while (ops < total_ops) {
+        for (uint32_t i = 0; i < LIFO_DEPTH; i++) {
+            slots[i].size = rng_range(1, 8);
+            slots[i].addr = alloc_frames(slots[i].size, 0);
+            failures += slots[i].addr == 0;
+        }
+        for (uint32_t i = LIFO_DEPTH; i-- > 0;) {
+            if (slots[i].addr != 0) {
+                free_frames(slots[i].addr, slots[i].size);
+                slots[i].addr = 0;
+            }
+        }
+        ops += 2 * LIFO_DEPTH;
+    }
+    report("frames-lifo", ops, now_ns() - start, fragmentation(), failures);
+}
+
+// Fill memory with single frames, free every other one plus a random quarter of the
+// rest, then ask for 2-16 frame runs that only fit where neighbours happened to go
+static void frames_fragmenting() {
+    uint32_t count = frame_allocator_free_count();
+    uint32_t *singles = malloc(count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        singles[i] = alloc_frame();
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (singles[i] != 0 && (i % 2 == 0 || rng() % 4 == 0)) {
+            free_frame(singles[i]);
+            singles[i] = 0;
+        }
+    }
+    double frag = fragmentation();
+
+    uint32_t failures = 0;
+    uint32_t runs = total_ops < FRAME_SLOTS ? total_ops : FRAME_SLOTS;
+    double start = now_ns();
+    for (uint32_t i = 0; i < runs; i++) {
+        slots[i].size = rng_range(2, 16);
+        slots[i].addr = alloc_frames(slots[i].size, 0);
+        failures += slots[i].addr == 0;
+    }
+    double ns = now_ns() - start;
+    report("frames-fragmenting", runs, ns, frag, failures);
+
+    free_frame_slots(runs);
+    for (uint32_t i = 0; i < count; i++) {
+        if (singles[i] != 0) {
+            free_frame(singles[i]);
+        }
+    }
+    free(singles);
+}
+
+// Mostly slab-sized requests, with one in ten spanning 2-4 pages
+static uint32_t kmalloc_size() {
+    return rng() % 10 ? rng_range(16, 2048) : rng_range(2 * PAGE_SIZE, 4 * PAGE_SIZE);
+}
+
+static void print_overhead(uint32_t frames_before, uint64_t live_bytes) {
+    uint32_t frames_used = frames_before - frame_allocator_free_count();
+    if (live_bytes != 0) {
+        printf("%-8s %-22s %9s memory/live bytes %.2f\n", BACKEND_NAME, "", "",
+               (double)frames_used * PAGE_SIZE / live_bytes);
+    }
+}
+
+static void kmalloc_uniform() {
+    uint32_t failures = 0;
+    uint64_t live_bytes = 0;
+    uint32_t frames_before = frame_allocator_free_count();
+    double start = now_ns();
+    for (uint32_t op = 0; op < total_ops; op++) {
+        slot_t *slot = &slots[rng() % KMALLOC_SLOTS];
+        if (slot->addr != 0) {
+            kfree((void *)(unsigned long)slot->addr);
+            live_bytes -= slot->size;
+            slot->addr = 0;
+        } else {
+            slot->size = kmalloc_size();
+            slot->addr = (uint32_t)(unsigned long)kmalloc(slot->size);
+            if (slot->addr != 0) {
+                live_bytes += slot->size;
+            } else {
+                failures++;
+            }
+        }
+    }
+    double ns = now_ns() - start;
+    report("kmalloc-uniform", total_ops, ns, fragmentation(), failures);
+    print_overhead(frames_before, live_bytes);
+    for (uint32_t i = 0; i < KMALLOC_SLOTS; i++) {
+        if (slots[i].addr != 0) {
+            kfree((void *)(unsigned long)slots[i].addr);
+            slots[i].addr = 0;
+        }
+    }
+}
+
+static void kmalloc_lifo() {
+    uint32_t failures = 0;
+    uint32_t ops = 0;
+    double start = now_ns();
+    while (ops < total_ops) {
+        for (uint32_t i = 0; i < LIFO_DEPTH; i++) {
+            slots[i].addr = (uint32_t)(unsigned long)kmalloc(rng_range(16, 2048));
+            failures += slots[i].addr == 0;
+        }
+        for (uint32_t i = LIFO_DEPTH; i-- > 0;) {
+            kfree((void *)(unsigned long)slots[i].addr);
+            slots[i].addr = 0;
+        }
+        ops += 2 * LIFO_DEPTH;
+    }
+    report("kmalloc-lifo", ops, now_ns() - start, fragmentation(), failures);
+}
+
+int main(int argc, char **argv) {
+    uint32_t ram_mb = 64;
+    total_ops = 200000;
+    rng_state = 2463534242u;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            host_log_level = KERN_DEBUG;
+        } else if (strcmp(argv[i], "--ram") == 0 && i + 1 < argc) {
+            ram_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            total_ops = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rng_state = atoi(argv[++i]) | 1;
+        } else {
+            fprintf(stderr, "usage: %s [-v] [--ram MB] [--ops N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (ram_mb < 8 || ram_mb > 3072) {
+        fprintf(stderr, "--ram must be between 8 and 3072 MB\n");
+        return 2;
+    }
+
+    multiboot_info_t mbi;
+    setup_ram(ram_mb, &mbi);
+    double start = now_ns();
+    init_frame_allocator(&mbi);
+    printf("%-8s init_frame_allocator %.1f us, %u of %u frames free\n", BACKEND_NAME,
+           (now_ns() - start) / 1000, frame_allocator_free_count(), frame_allocator_total_count());
+
+    uint32_t free_at_start = frame_allocator_free_count();
+    printf("%-8s %-22s %9s %9s %10s %9s\n", "backend", "workload", "ops", "ns/op", "frag", "failures");
+    frames_uniform();
+    frames_lifo();
+    frames_fragmenting();
+    // The frame workloads give back everything they take; slab pages may stay cached
+    if (frame_allocator_free_count() != free_at_start) {
+        printf("error: %u frames free after the frame workloads, %u at start\n",
+               frame_allocator_free_count(), free_at_start);
+        return 1;
+    }
+    kmalloc_uniform();
+    kmalloc_lifo();
+    return 0;
+}
@@ -0,0 +1,47 @@
+// Platform shim for the host build of the memory subsystem (see alloc_bench.c).
+// Stands in for the kernel pieces frame_allocator.c, buddy_allocator.c, slab.c and
+// kmalloc.c call into: printk, the direct map and the per-CPU area.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_shim.h"
+#include "../../src/kernel/include/printk.h"
+#include "../../src/kernel/include/paging.h"
+#include "../../src/kernel/include/percpu.h"
+
+int host_log_level = KERN_WARNING;
+uint32_t host_ram_end;
+
+// The kernel's formats are a subset of printf's; %p arguments are 32-bit in the kernel
+// but only show up in debug messages, which are off unless -v is given
+void printk(int level, const char *fmt, ...) {
+    if (level > host_log_level) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "<%d> ", level);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+// All synthetic RAM is mapped at its own address, like the kernel's direct map
+uint32_t paging_direct_map_end() {
+    return host_ram_end;
+}
+
+// Nothing above the direct map exists on the host, so nothing should need mapping
+void map_page(uint32_t virtual_address, uint32_t physical_address) {
+    fprintf(stderr, "map_page(0x%08x, 0x%08x) outside the synthetic RAM\n", virtual_address, physical_address);
+    abort();
+}
+
+// A single CPU, id 0
+static cpu_t host_cpu = { .self = &host_cpu };
+
+cpu_t *this_cpu() {
+    return &host_cpu;
+}
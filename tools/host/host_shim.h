@@ -0,0 +1,12 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include "../../src/kernel/include/types.h"
+
+// Messages up to this level reach stderr (KERN_WARNING by default)
+extern int host_log_level;
+
+// End of the synthetic physical memory, set up by the benchmark
+extern uint32_t host_ram_end;
+
+#endif // HOST_SHIM_H
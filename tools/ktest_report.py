@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Summarize the KTEST/KBENCH lines the kernel writes to COM1.
+
+Usage: tools/ktest_report.py [qemu_output.log] [--baseline FILE] [--tolerance F] [--save FILE]
+
+The in-kernel harness (see src/kernel/utils/ktest.c) logs, after the printk
+timestamp:
+
+    KTEST_START
+    KTEST PASS map_page 18234
+    KTEST FAIL kmalloc_small 912 src/kernel/main/kmain.c:612 ptr != 0
+    KTEST_STOP 5 1
+    KBENCH_START
+    KBENCH frame_alloc_free 1000 86 91 240
+    KBENCH_STOP
+
+Exits non-zero if a test failed, the run never reached its STOP line (a hang
+or a panic), or a benchmark median is more than --tolerance above the one in
+the --baseline file. --save writes the benchmark results in the baseline
+format: one "<name> <median>" per line.
+"""
+
+import argparse
+import sys
+
+
+def strip_prefix(line):
+    """Drop the "[seconds.micros] " printk prefix, if any."""
+    line = line.strip()
+    if line.startswith("["):
+        end = line.find("] ")
+        if end != -1:
+            line = line[end + 2:]
+    return line
+
+
+def parse(lines):
+    """Return (tests, benches, test_done, bench_done) from the last run in the log."""
+    tests, benches = [], []
+    test_done = bench_done = False
+    for line in lines:
+        line = strip_prefix(line)
+        parts = line.split()
+        if not parts:
+            continue
+        if parts[0] == "KTEST_START":
+            tests, test_done = [], False
+        elif parts[0] == "KTEST_STOP":
+            test_done = True
+        elif parts[0] == "KTEST" and len(parts) >= 4:
+            detail = " ".join(parts[4:])
+            tests.append((parts[1], parts[2], int(parts[3]), detail))
+        elif parts[0] == "KBENCH_START":
+            benches, bench_done = [], False
+        elif parts[0] == "KBENCH_STOP":
+            bench_done = True
+        elif parts[0] == "KBENCH" and len(parts) == 6:
+            benches.append((parts[1],) + tuple(int(p) for p in parts[2:]))
+    return tests, benches, test_done, bench_done
+
+
+def load_baseline(path):
+    baseline = {}
+    with open(path) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) == 2 and not line.startswith("#"):
+                baseline[parts[0]] = int(parts[1])
+    return baseline
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", default="qemu_output.log")
+    parser.add_argument("--baseline", help="file of '<name> <median>' lines to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.2,
+                        help="allowed median increase over the baseline (default 0.2 = 20%%)")
+    parser.add_argument("--save", help="write this run's medians in the baseline format")
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as f:
+        tests, benches, test_done, bench_done = parse(f)
+    if not tests and not benches:
+        sys.exit("no KTEST or KBENCH output in " + args.log)
+
+    ok = True
+    if tests:
+        failed = [t for t in tests if t[0] != "PASS"]
+        for result, name, cycles, detail in tests:
+            print("%-4s %-32s %12d %s" % (result, name, cycles, detail))
+        print("%d passed, %d failed" % (len(tests) - len(failed), len(failed)))
+        if failed:
+            ok = False
+        if not test_done:
+            print("error: no KTEST_STOP, the run did not finish")
+            ok = False
+
+    if benches:
+        baseline = load_baseline(args.baseline) if args.baseline else {}
+        print("%-32s %6s %10s %10s %10s %10s" % ("benchmark", "iters", "min", "median", "p99", "baseline"))
+        for name, iterations, low, median, p99 in benches:
+            row = "%-32s %6d %10d %10d %10d" % (name, iterations, low, median, p99)
+            if name in baseline:
+                row += " %10d" % baseline[name]
+                if median > baseline[name] * (1 + args.tolerance):
+                    row += "  REGRESSION %+.0f%%" % (100.0 * (median - baseline[name]) / baseline[name])
+                    ok = False
+            print(row)
+        if not bench_done:
+            print("error: no KBENCH_STOP, the run did not finish")
+            ok = False
+        if args.save:
+            with open(args.save, "w") as f:
+                f.write("# benchmark median-cycles\n")
+                for name, _, _, median, _ in benches:
+                    f.write("%s %d\n" % (name, median))
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()